@@ -0,0 +1,1508 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "libbr/br.hpp"
+#include "libbr/buffer.hpp"
+#include "libbr/checksum.hpp"
+#include "libbr/decimal.hpp"
+#include "libbr/erasure.hpp"
+#include "libbr/jit.hpp"
+#include "libbr/nttcache.hpp"
+#include "libbr/partition.hpp"
+#include "libbr/poly.hpp"
+#include "libbr/polyhash.hpp"
+#include "libbr/polymul.hpp"
+#include "libbr/random.hpp"
+#include "libbr/recurrence.hpp"
+#include "libbr/rollhash.hpp"
+#include "libbr/shamir.hpp"
+
+namespace
+{
+
+// Keeps results alive so the benchmarked work is not optimized away.
+volatile uint64_t sink = 0;
+
+// Wall times of the timed runs of one measurement, in seconds.
+struct RunStats
+{
+    double best{0};
+    double median{0};
+    double mean{0};
+    double stddev{0};
+    std::size_t runs{0};
+};
+
+// The runs of the last measure() call, picked up by the report functions for the JSON results.
+RunStats last_run;
+
+// Best wall time of 'reps' runs of 'f', in seconds. A first, untimed run warms up the caches, the page tables and
+// the branch predictors, so that it does not inflate the statistics.
+template <typename F> auto measure(F &&f, const std::size_t reps = 5) -> double
+{
+    f();
+    std::vector<double> times(reps);
+    for (std::size_t i = 0; i < reps; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const auto stop = std::chrono::steady_clock::now();
+        times[i] = std::chrono::duration<double>(stop - start).count();
+    }
+    RunStats st;
+    st.runs = reps;
+    std::sort(times.begin(), times.end());
+    st.best = times[0];
+    st.median = reps % 2 == 1 ? times[reps / 2] : (times[reps / 2 - 1] + times[reps / 2]) / 2;
+    for (const double t : times)
+    {
+        st.mean += t / static_cast<double>(reps);
+    }
+    for (const double t : times)
+    {
+        st.stddev += (t - st.mean) * (t - st.mean);
+    }
+    st.stddev = reps > 1 ? std::sqrt(st.stddev / static_cast<double>(reps - 1)) : 0;
+    last_run = st;
+    return st.best;
+}
+
+// One result of the JSON output, in nanoseconds per element of work (a byte, a value, a call, ...).
+struct Result
+{
+    std::string name;
+    std::string unit;
+    double ns{0};        // best run
+    double median_ns{0}; // median run
+    double mean_ns{0};   // mean and sample standard deviation of the runs
+    double stddev_ns{0};
+    std::size_t runs{0};
+    double cycles{-1}; // hardware cycles per element, < 0 when not measured
+};
+
+std::vector<Result> results;
+std::string result_prefix; // table and modulus of the reducer suite rows
+
+void record(const std::string &name, const std::string &unit, const RunStats &st, const std::size_t elements,
+            const double cycles = -1)
+{
+    Result r;
+    r.name = result_prefix + name;
+    // Names repeat in some tables; keep the keys of the comparison unique.
+    for (int k = 2; std::any_of(results.begin(), results.end(), [&](const Result &o) { return o.name == r.name; });
+         ++k)
+    {
+        r.name = result_prefix + name + " #" + std::to_string(k);
+    }
+    r.unit = unit;
+    const double scale = 1e9 / static_cast<double>(elements);
+    r.ns = st.best * scale;
+    r.median_ns = st.median * scale;
+    r.mean_ns = st.mean * scale;
+    r.stddev_ns = st.stddev * scale;
+    r.runs = st.runs;
+    r.cycles = cycles;
+    results.push_back(r);
+}
+
+void report(const std::string &name, const double seconds, const std::size_t bytes)
+{
+    std::cout << std::left << std::setw(52) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << static_cast<double>(bytes) / seconds / 1e9 << " GB/s\n";
+    record(name, "byte", last_run, bytes);
+}
+
+// Throughput in millions of 'unit' per second, for work that is not measured in bytes.
+void report_rate(const std::string &name, const double seconds, const std::size_t count, const std::string &unit)
+{
+    std::cout << std::left << std::setw(52) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << static_cast<double>(count) / seconds / 1e6 << " M" << unit << "/s\n";
+    record(name, unit, last_run, count);
+}
+
+// Time per call in microseconds, for single operations with no natural throughput unit.
+void report_latency(const std::string &name, const double seconds)
+{
+    std::cout << std::left << std::setw(52) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << seconds * 1e6 << " us\n";
+    record(name, "call", last_run, 1);
+}
+
+auto random_bytes(const std::size_t len) -> std::vector<uint8_t>
+{
+    std::mt19937 gen(12345);
+    std::uniform_int_distribution<uint32_t> distr(0, UINT8_MAX);
+    std::vector<uint8_t> data(len);
+    for (auto &c : data)
+    {
+        c = distr(gen);
+    }
+    return data;
+}
+
+// Hardware counters of the calling thread: cycles, instructions, branch misses and cache misses, read as one
+// perf_event_open group so they cover the same interval. User-space only (exclude_kernel), which the default
+// perf_event_paranoid level permits. When the leader cannot be opened (not Linux, access denied, no PMU in a
+// VM) the counters are unavailable and the suite prints throughput only; events that fail alone read as -1.
+class PerfCounters
+{
+  public:
+    static constexpr std::size_t num_events = 4;
+
+    // Per value: cycles, instructions, branch misses, cache misses.
+    struct Sample
+    {
+        bool valid{false};
+        std::array<double, num_events> v{};
+    };
+
+    PerfCounters()
+    {
+#ifdef __linux__
+        constexpr std::array<uint64_t, num_events> configs = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                              PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+        for (std::size_t i = 0; i < num_events; ++i)
+        {
+            perf_event_attr attr{};
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = i == 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+            fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0));
+            if (fds[i] < 0)
+            {
+                if (i == 0)
+                {
+                    reason = std::strerror(errno);
+                    return;
+                }
+                continue;
+            }
+            ::ioctl(fds[i], PERF_EVENT_IOC_ID, &ids[i]);
+        }
+#else
+        reason = "not Linux";
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (const int fd : fds)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    auto operator=(const PerfCounters &) -> PerfCounters & = delete;
+
+    [[nodiscard]] auto available() const -> bool
+    {
+        return fds[0] >= 0;
+    }
+
+    // Why the counters are unavailable.
+    [[nodiscard]] auto why() const -> const std::string &
+    {
+        return reason;
+    }
+
+    // Counts of one run of 'f', divided by 'values'.
+    template <typename F> auto run(F &&f, const std::size_t values) -> Sample
+    {
+        Sample res;
+#ifdef __linux__
+        if (!available())
+        {
+            f();
+            return res;
+        }
+        ::ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ::ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        f();
+        ::ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        // nr, then (value, id) per opened event.
+        std::array<uint64_t, 1 + 2 * num_events> buf{};
+        if (::read(fds[0], buf.data(), sizeof(buf)) <= 0)
+        {
+            return res;
+        }
+        for (std::size_t i = 0; i < num_events; ++i)
+        {
+            res.v[i] = -1;
+            for (std::size_t j = 0; j < buf[0]; ++j)
+            {
+                if (fds[i] >= 0 && buf[2 + 2 * j] == ids[i])
+                {
+                    res.v[i] = static_cast<double>(buf[1 + 2 * j]) / static_cast<double>(values);
+                }
+            }
+        }
+        res.valid = true;
+#else
+        f();
+        static_cast<void>(values);
+#endif
+        return res;
+    }
+
+  private:
+    std::array<int, num_events> fds{-1, -1, -1, -1};
+    std::array<uint64_t, num_events> ids{};
+    std::string reason;
+};
+
+auto perf() -> PerfCounters &
+{
+    static PerfCounters counters;
+    return counters;
+}
+
+// Reducer suite: every reducer against '%' with a run-time modulus, '%' with a compile-time constant (which the
+// compiler turns into a multiplication), Montgomery multiplication and '__int128' division, per modulus size.
+// Throughput is measured over batches of 1K, 64K and 4M values (L1, L2 and memory resident), and latency as
+// the time per step of a dependent chain, in which no two reductions overlap: x = f(x + c) for the reductions,
+// c keeping the inputs large, and x = x * w mod n for the products. Where hardware counters
+// are available, cycles, IPC, branch misses and cache misses per value are read over the 64K batches.
+constexpr std::array<std::size_t, 3> batch_sizes = {1U << 10U, 1U << 16U, 1U << 22U};
+constexpr std::size_t batch_total = 1U << 22U; // values per measurement, for every batch size
+constexpr std::size_t chain_steps = 1U << 20U;
+
+// Montgomery multiplication modulo an odd n < 2^63, for comparison only. Operands in Montgomery form.
+class Montgomery64
+{
+    using uint128_t = unsigned __int128;
+
+  public:
+    explicit Montgomery64(const uint64_t _n) : n(_n)
+    {
+        // -n^-1 mod 2^64 by Newton iteration.
+        uint64_t inv = n;
+        for (int i = 0; i < 5; ++i)
+        {
+            inv *= 2 - n * inv;
+        }
+        n_neg_inv = 0 - inv;
+        r2 = static_cast<uint64_t>((~static_cast<uint128_t>(0) % n + 1) % n);
+    }
+
+    // t * 2^-64 mod n, for t < n * 2^64.
+    [[nodiscard]] auto reduce(const uint128_t t) const -> uint64_t
+    {
+        const uint64_t m = static_cast<uint64_t>(t) * n_neg_inv;
+        const auto u = static_cast<uint64_t>((t + static_cast<uint128_t>(m) * n) >> 64U);
+        return u >= n ? u - n : u;
+    }
+
+    [[nodiscard]] auto mul(const uint64_t a, const uint64_t b) const -> uint64_t
+    {
+        return reduce(static_cast<uint128_t>(a) * b);
+    }
+
+    [[nodiscard]] auto to_mont(const uint64_t a) const -> uint64_t
+    {
+        return mul(a % n, r2);
+    }
+
+  private:
+    uint64_t n;
+    uint64_t n_neg_inv{0};
+    uint64_t r2{0};
+};
+
+// A modulus the compiler cannot see through.
+template <typename T> auto opaque(const T v) -> T
+{
+    volatile T tmp = v;
+    return tmp;
+}
+
+constexpr std::array<const char *, batch_sizes.size()> batch_names = {"1K", "64K", "4M"};
+
+struct BatchResult
+{
+    std::array<double, batch_sizes.size()> rates{}; // M values/s
+    std::array<RunStats, batch_sizes.size()> runs{};
+    PerfCounters::Sample counts; // per value, 64K batches
+};
+
+// Throughput of 'pass(size)', which processes the first 'size' values, for each batch size.
+template <typename F> auto batch_rates(F &&pass) -> BatchResult
+{
+    BatchResult res;
+    for (std::size_t k = 0; k < batch_sizes.size(); ++k)
+    {
+        const std::size_t size = batch_sizes[k];
+        const auto all = [&] {
+            for (std::size_t done = 0; done < batch_total; done += size)
+            {
+                pass(size);
+            }
+        };
+        const double seconds = measure(all, 3);
+        res.rates[k] = static_cast<double>(batch_total) / seconds / 1e6;
+        res.runs[k] = last_run;
+        if (size == (1U << 16U))
+        {
+            res.counts = perf().run(all, batch_total);
+        }
+    }
+    return res;
+}
+
+// Runs of chain_steps steps of the chain x = step(x), from x0.
+template <typename F> auto chain_runs(F &&step, const uint64_t x0) -> RunStats
+{
+    measure(
+        [&] {
+            uint64_t x = x0;
+            for (std::size_t i = 0; i < chain_steps; ++i)
+            {
+                x = step(x);
+            }
+            sink = x;
+        },
+        3);
+    return last_run;
+}
+
+void report_header(const std::string &title)
+{
+    result_prefix = title + " ";
+    std::cout << title << "\n"
+              << std::left << std::setw(42) << "  (M values/s, ns per chained step)" << std::right << std::setw(10)
+              << "1K" << std::setw(10) << "64K" << std::setw(10) << "4M" << std::setw(10) << "chain";
+    if (perf().available())
+    {
+        std::cout << std::setw(10) << "cyc/val" << std::setw(8) << "IPC" << std::setw(12) << "brmiss/val"
+                  << std::setw(12) << "cmiss/val";
+    }
+    else
+    {
+        std::cout << "  (no hardware counters: " << perf().why() << ")";
+    }
+    std::cout << "\n";
+}
+
+// Modulus line of a suite table.
+void report_modulus(const std::string &bits, const uint64_t n)
+{
+    const std::string title = result_prefix.substr(0, result_prefix.find(':') + 1);
+    result_prefix = title + " " + bits + " ";
+    std::cout << "  " << bits << " n = " << n << "\n";
+}
+
+// One line of a suite table.
+void report_row(const std::string &name, const BatchResult &res, const RunStats &chain)
+{
+    std::cout << "    " << std::left << std::setw(38) << name << std::right << std::fixed << std::setprecision(1);
+    for (const double r : res.rates)
+    {
+        std::cout << std::setw(10) << r;
+    }
+    for (std::size_t k = 0; k < batch_sizes.size(); ++k)
+    {
+        const bool counted = res.counts.valid && batch_sizes[k] == (1U << 16U);
+        record(name + " @" + batch_names[k], "value", res.runs[k], batch_total, counted ? res.counts.v[0] : -1);
+    }
+    std::cout << std::setw(10) << std::setprecision(2) << chain.best / static_cast<double>(chain_steps) * 1e9;
+    record(name + " chain", "step", chain, chain_steps);
+    if (res.counts.valid)
+    {
+        // cycles, instructions, branch misses, cache misses; -1 for an event that could not be opened.
+        const std::array<double, PerfCounters::num_events> &v = res.counts.v;
+        const auto cell = [](const double x, const int width, const int prec) {
+            if (x < 0)
+            {
+                std::cout << std::setw(width) << "-";
+                return;
+            }
+            std::cout << std::setw(width) << std::setprecision(prec) << x;
+        };
+        cell(v[0], 10, 2);
+        cell(v[0] > 0 && v[1] >= 0 ? v[1] / v[0] : -1, 8, 2);
+        cell(v[2], 12, 4);
+        cell(v[3], 12, 4);
+    }
+    std::cout << "\n";
+}
+
+template <typename T> auto random_below(const std::size_t count, const T bound) -> std::vector<T>
+{
+    std::mt19937_64 gen(12345);
+    std::uniform_int_distribution<T> distr(0, bound - 1);
+    std::vector<T> v(count);
+    for (auto &x : v)
+    {
+        x = distr(gen);
+    }
+    return v;
+}
+
+// x mod n for 32-bit x (x < n^2 when n^2 fits in 32 bits, as BarrettRed32::calc() requires).
+// The chain adds bound - n - n / 2: its inputs are close to the largest allowed, and the residues hop by about n / 2
+// (a multiple of n would leave x fixed). Batch methods chain one-value batches.
+template <uint32_t N> void bench_reduce32(const std::string &bits)
+{
+    report_modulus(bits, N);
+    const uint64_t n2 = static_cast<uint64_t>(N) * N;
+    const auto bound = static_cast<uint32_t>(n2 > UINT32_MAX ? UINT32_MAX : n2);
+    const std::vector<uint32_t> x = random_below<uint32_t>(batch_total, bound);
+    std::vector<uint32_t> out(batch_total);
+    const uint32_t n = opaque(N);
+    const uint32_t c = bound - N - N / 2;
+    const auto loop = [&](auto &&f) {
+        return [&, f](const std::size_t size) {
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                out[i] = f(x[i]);
+            }
+            sink = out[size - 1];
+        };
+    };
+    const auto chain = [c](auto &&f) {
+        return chain_runs([&f, c](const uint64_t v) { return f(static_cast<uint32_t>(v) + c); }, 0);
+    };
+    const br::BarrettRed32 br32(N);
+    const br::Plantard32 pl(N);
+    const auto mod = [n](const uint32_t v) { return v % n; };
+    const auto mod_const = [](const uint32_t v) { return v % N; };
+    const auto calc = [&br32](const uint32_t v) { return br32.calc(v); };
+    const auto calc_batch = [&br32](uint32_t v) {
+        br32.calc(&v, &v, 1);
+        return v;
+    };
+    const auto plantard_batch = [&pl](uint32_t v) {
+        pl.calc(&v, &v, 1);
+        return v;
+    };
+    report_row("%", batch_rates(loop(mod)), chain(mod));
+    report_row("% constant", batch_rates(loop(mod_const)), chain(mod_const));
+    report_row("BarrettRed32::calc", batch_rates(loop(calc)), chain(calc));
+    report_row("BarrettRed32::calc batch", batch_rates([&](const std::size_t size) {
+                   br32.calc(x.data(), out.data(), size);
+                   sink = out[size - 1];
+               }),
+               chain(calc_batch));
+    report_row("Plantard32::calc batch", batch_rates([&](const std::size_t size) {
+                   pl.calc(x.data(), out.data(), size);
+                   sink = out[size - 1];
+               }),
+               chain(plantard_batch));
+}
+
+// x mod n for any 64-bit x. The chain adds a constant with high bits set; the JIT chains one-value batches.
+template <uint64_t N> void bench_reduce64(const std::string &bits)
+{
+    report_modulus(bits, N);
+    const std::vector<uint64_t> x = random_below<uint64_t>(batch_total, UINT64_MAX);
+    std::vector<uint64_t> out(batch_total);
+    const uint64_t n = opaque(N);
+    const uint64_t c = 0x9e3779b97f4a7c15UL;
+    const auto loop = [&](auto &&f) {
+        return [&, f](const std::size_t size) {
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                out[i] = f(x[i]);
+            }
+            sink = out[size - 1];
+        };
+    };
+    const auto chain = [c](auto &&f) { return chain_runs([&f, c](const uint64_t v) { return f(v + c); }, 0); };
+    const br::BarrettJit64 jit(N);
+    const br::BarrettRed64 &br64 = jit.reducer();
+    const auto mod = [n](const uint64_t v) { return v % n; };
+    const auto mod_const = [](const uint64_t v) { return v % N; };
+    const auto calc_full = [&br64](const uint64_t v) { return br64.calc_full(v); };
+    const auto jit_batch = [&jit](uint64_t v) {
+        jit.calc(&v, &v, 1);
+        return v;
+    };
+    report_row("%", batch_rates(loop(mod)), chain(mod));
+    report_row("% constant", batch_rates(loop(mod_const)), chain(mod_const));
+    report_row("BarrettRed64::calc_full", batch_rates(loop(calc_full)), chain(calc_full));
+    report_row(jit.jitted() ? "BarrettJit64 batch" : "BarrettJit64 batch (fallback)",
+               batch_rates([&](const std::size_t size) {
+                   jit.calc(x.data(), out.data(), size);
+                   sink = out[size - 1];
+               }),
+               chain(jit_batch));
+}
+
+// a * b mod n for a, b < n: throughput over arrays, latency of x = x * w mod n.
+template <typename T, typename F> void product_row(const std::string &name, const std::vector<T> &a,
+                                                   const std::vector<T> &b, std::vector<T> &out, const T w, F &&f)
+{
+    const auto rates = batch_rates([&](const std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            out[i] = f(a[i], b[i]);
+        }
+        sink = out[size - 1];
+    });
+    const RunStats chain = chain_runs([&](const uint64_t x) { return f(static_cast<T>(x), w); }, 1);
+    report_row(name, rates, chain);
+}
+
+// Montgomery products, with the operands converted to Montgomery form beforehand.
+void bench_montgomery(const uint64_t n, const std::vector<uint64_t> &a, const std::vector<uint64_t> &b,
+                      std::vector<uint64_t> &out, const uint64_t w)
+{
+    const Montgomery64 mont(n);
+    std::vector<uint64_t> am(a.size());
+    std::vector<uint64_t> bm(b.size());
+    std::transform(a.begin(), a.end(), am.begin(), [&mont](const uint64_t x) { return mont.to_mont(x); });
+    std::transform(b.begin(), b.end(), bm.begin(), [&mont](const uint64_t x) { return mont.to_mont(x); });
+    product_row("Montgomery64::mul", am, bm, out, mont.to_mont(w),
+                [&mont](const uint64_t x, const uint64_t y) { return mont.mul(x, y); });
+}
+
+// Products by a fixed factor w with Shoup's precomputed quotient.
+void bench_shoup(const uint64_t n, const std::vector<uint64_t> &a, const std::vector<uint64_t> &b,
+                 std::vector<uint64_t> &out, const uint64_t w)
+{
+    const uint64_t w_shoup = br::util::shoup_precomp(w, n);
+    product_row("Shoup (x * w)", a, b, out, w, [n, w, w_shoup](const uint64_t x, const uint64_t) {
+        return br::util::shoup_mul(x, w, w_shoup, n);
+    });
+}
+
+// Products modulo n < 2^16, in 32-bit arithmetic.
+template <uint32_t N> void bench_mul32(const std::string &bits)
+{
+    report_modulus(bits, N);
+    const std::vector<uint32_t> a = random_below<uint32_t>(batch_total, N);
+    const std::vector<uint32_t> b = random_below<uint32_t>(batch_total, N);
+    std::vector<uint32_t> out(batch_total);
+    const uint32_t n = opaque(N);
+    const uint32_t w = N / 3;
+    const br::BarrettRed32 br32(N);
+    const br::Plantard32 pl(N);
+    const uint64_t w_prep = pl.prepare(w);
+    product_row("%", a, b, out, w, [n](const uint32_t x, const uint32_t y) { return x * y % n; });
+    product_row("% constant", a, b, out, w, [](const uint32_t x, const uint32_t y) { return x * y % N; });
+    product_row("BarrettRed32::calc", a, b, out, w,
+                [&br32](const uint32_t x, const uint32_t y) { return br32.calc(x * y); });
+    // A fixed factor w: Plantard prepares its constants.
+    product_row("Plantard32::mul (x * w)", a, b, out, w,
+                [&pl, w_prep](const uint32_t x, const uint32_t) { return pl.mul(x, w_prep); });
+}
+
+// Products modulo n < 2^32, in 64-bit arithmetic.
+template <uint64_t N> void bench_mul64(const std::string &bits)
+{
+    report_modulus(bits, N);
+    const std::vector<uint64_t> a = random_below<uint64_t>(batch_total, N);
+    const std::vector<uint64_t> b = random_below<uint64_t>(batch_total, N);
+    std::vector<uint64_t> out(batch_total);
+    const uint64_t n = opaque(N);
+    const uint64_t w = N / 3;
+    const br::BarrettRed64 br64(N);
+    product_row("%", a, b, out, w, [n](const uint64_t x, const uint64_t y) { return x * y % n; });
+    product_row("% constant", a, b, out, w, [](const uint64_t x, const uint64_t y) { return x * y % N; });
+    product_row("BarrettRed64::mul", a, b, out, w,
+                [&br64](const uint64_t x, const uint64_t y) { return br64.mul(x, y); });
+    if constexpr (N % 2 == 1 && N < (1UL << 31U))
+    {
+        const br::Plantard32 pl(N);
+        const uint64_t w_prep = pl.prepare(w);
+        product_row("Plantard32::mul (x * w)", a, b, out, w, [&pl, w_prep](const uint64_t x, const uint64_t) {
+            return static_cast<uint64_t>(pl.mul(static_cast<uint32_t>(x), w_prep));
+        });
+    }
+    bench_shoup(N, a, b, out, w);
+    bench_montgomery(N, a, b, out, w);
+}
+
+// Products modulo n < 2^63, in 128-bit arithmetic.
+template <uint64_t N> void bench_mul128(const std::string &bits)
+{
+    using uint128_t = unsigned __int128;
+
+    report_modulus(bits, N);
+    const std::vector<uint64_t> a = random_below<uint64_t>(batch_total, N);
+    const std::vector<uint64_t> b = random_below<uint64_t>(batch_total, N);
+    std::vector<uint64_t> out(batch_total);
+    const uint64_t n = opaque(N);
+    const uint64_t w = N / 3;
+    const br::BarrettRed128 br128(N);
+    product_row("__int128 %", a, b, out, w, [n](const uint64_t x, const uint64_t y) {
+        return static_cast<uint64_t>(static_cast<uint128_t>(x) * y % n);
+    });
+    product_row("__int128 % constant", a, b, out, w, [](const uint64_t x, const uint64_t y) {
+        return static_cast<uint64_t>(static_cast<uint128_t>(x) * y % N);
+    });
+    product_row("BarrettRed128::mul", a, b, out, w,
+                [&br128](const uint64_t x, const uint64_t y) { return br128.mul(x, y); });
+    product_row("BarrettRed128::calc_full", a, b, out, w, [&br128](const uint64_t x, const uint64_t y) {
+        return br128.calc_full(static_cast<uint128_t>(x) * y);
+    });
+    if constexpr (N == br::MersenneRed61::n)
+    {
+        const br::MersenneRed61 m61;
+        product_row("MersenneRed61::mul", a, b, out, w,
+                    [&m61](const uint64_t x, const uint64_t y) { return m61.mul(x, y); });
+    }
+    bench_shoup(N, a, b, out, w);
+    bench_montgomery(N, a, b, out, w);
+}
+
+void bench_reducers()
+{
+    report_header("Reductions, x mod n:");
+    bench_reduce32<40961>("16-bit");
+    bench_reduce32<2147483647>("31-bit");
+    bench_reduce64<4294967291UL>("32-bit");
+    bench_reduce64<281474976710597UL>("48-bit");
+    bench_reduce64<9223372036854775783UL>("63-bit");
+
+    report_header("Products, a * b mod n:");
+    bench_mul32<40961>("16-bit");
+    bench_mul64<2147483647UL>("31-bit");
+    bench_mul128<281474976710597UL>("48-bit");
+    bench_mul128<(1UL << 61U) - 1>("61-bit");
+    bench_mul128<9223372036854775783UL>("63-bit");
+    result_prefix.clear();
+}
+
+void bench_rollhash()
+{
+    std::cout << "RollingHash:\n";
+
+    constexpr std::size_t len = 1U << 20U;
+    constexpr std::size_t window = 64;
+    const std::vector<uint8_t> data = random_bytes(len);
+    const uint64_t m61 = (1UL << 61U) - 1;
+    const uint64_t p64 = UINT64_MAX - 58;
+
+    std::vector<uint64_t> out(len * 2);
+    const br::RollingHash rh(m61, 1000003, window);
+    report("hash_windows (mod 2^61-1)", measure([&] {
+               rh.hash_windows(data.data(), len, out.data());
+               sink = out[len / 2];
+           }),
+           len);
+
+    const br::RollingHash rh64(p64, 1000003, window);
+    report("hash_windows (mod 2^64-59)", measure([&] {
+               rh64.hash_windows(data.data(), len, out.data());
+               sink = out[len / 2];
+           }),
+           len);
+
+    report("roll, single chain (mod 2^61-1)", measure([&] {
+               uint64_t h = rh.hash(data.data());
+               for (std::size_t i = window; i < len; ++i)
+               {
+                   h = rh.roll(h, data[i - window], data[i]);
+               }
+               sink = h;
+           }),
+           len);
+
+    const br::MultiRollingHash<2> mh({m61, p64}, {1000003, 1000033}, window);
+    report("hash_windows x2 (2^61-1, 2^64-59)", measure([&] {
+               mh.hash_windows(data.data(), len, out.data());
+               sink = out[len / 2];
+           }),
+           len);
+}
+
+template <typename Reducer> void bench_polyhash_reducer(const std::string &name, const Reducer &red)
+{
+    constexpr std::size_t len = 1U << 22U;
+    const std::vector<uint8_t> data = random_bytes(len);
+    br::PolyHash<Reducer> ph(red, red.get_n() / 3);
+    report(name, measure([&] {
+               ph.reset();
+               ph.update(data.data(), len);
+               sink = ph.finalize();
+           }),
+           len);
+}
+
+void bench_polyhash()
+{
+    std::cout << "PolyHash:\n";
+
+    bench_polyhash_reducer("MersenneRed61", br::MersenneRed61());
+    bench_polyhash_reducer("BarrettRed128 (2^61-1)", br::BarrettRed128((1UL << 61U) - 1));
+    bench_polyhash_reducer("BarrettRed128 (2^64-59)", br::BarrettRed128(UINT64_MAX - 58));
+}
+
+// zlib-style Adler-32: runs of NMAX bytes reduced with '%'.
+auto adler32_zlib(const uint8_t *data, std::size_t len) -> uint32_t
+{
+    constexpr uint32_t base = 65521;
+    constexpr std::size_t nmax = 5552;
+    uint32_t s1 = 1;
+    uint32_t s2 = 0;
+    while (len > 0)
+    {
+        const std::size_t k = std::min(len, nmax);
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 %= base;
+        s2 %= base;
+        data += k;
+        len -= k;
+    }
+    return (s2 << 16U) | s1;
+}
+
+void bench_checksum()
+{
+    std::cout << "Checksums:\n";
+
+    constexpr std::size_t len = 1U << 22U;
+    const std::vector<uint8_t> data = random_bytes(len);
+    report("adler32 zlib-style (%)", measure([&] { sink = adler32_zlib(data.data(), len); }), len);
+    report("adler32_scalar", measure([&] { sink = br::adler32_scalar(data.data(), len); }), len);
+    report("adler32", measure([&] { sink = br::adler32(data.data(), len); }), len);
+    report("fletcher16_scalar", measure([&] { sink = br::fletcher16_scalar(data.data(), len); }), len);
+    report("fletcher16", measure([&] { sink = br::fletcher16(data.data(), len); }), len);
+    std::vector<uint16_t> words(len / 2);
+    std::memcpy(words.data(), data.data(), len);
+    report("fletcher32", measure([&] { sink = br::fletcher32(words.data(), words.size()); }), len);
+}
+
+void bench_buffer()
+{
+    std::cout << "Buffers, random reads of a 256 MiB table, reduced mod n (M values/s):\n";
+
+    // Random reads miss the TLB on nearly every access with 4 KiB pages, much less with 2 MiB pages.
+    constexpr std::size_t table_len = 1U << 25U;
+    constexpr std::size_t reads = 1U << 22U;
+    std::mt19937_64 gen(12345);
+    std::vector<uint32_t> idx(reads);
+    for (auto &i : idx)
+    {
+        i = static_cast<uint32_t>(gen() % table_len);
+    }
+    const br::BarrettRed64 br(1000000007);
+    const auto run = [&](const std::string &name, const uint64_t *table) {
+        report_rate(name, measure([&] {
+                        uint64_t acc = 0;
+                        for (const uint32_t i : idx)
+                        {
+                            acc += br.calc_full(table[i]);
+                        }
+                        sink = acc;
+                    }),
+                    reads, "value");
+    };
+
+    std::vector<uint64_t> vec(table_len);
+    for (auto &v : vec)
+    {
+        v = gen();
+    }
+    run("std::vector", vec.data());
+    vec = {};
+
+    static constexpr std::array<const char *, 3> names = {"normal", "transparent", "huge"};
+    for (const br::Pages pages : {br::Pages::normal, br::Pages::transparent, br::Pages::huge})
+    {
+        const br::Buffer<uint64_t> buf(table_len, pages);
+        for (auto &v : buf)
+        {
+            v = gen();
+        }
+        run(std::string("Buffer, ") + names[static_cast<std::size_t>(pages)] + " pages (got " +
+                names[static_cast<std::size_t>(buf.get_pages())] + ")",
+            buf.data());
+    }
+}
+
+void bench_partition()
+{
+    std::cout << "Partitioning (GB/s of 64-bit hashes):\n";
+
+    constexpr std::size_t count = 1U << 20U;
+    std::mt19937_64 gen(12345);
+    std::vector<uint64_t> hashes(count);
+    for (auto &h : hashes)
+    {
+        h = gen();
+    }
+    std::vector<uint32_t> idx(count);
+    std::vector<uint64_t> out(count);
+    const std::size_t bytes = count * sizeof(uint64_t);
+
+    for (const uint32_t n : {1000U, 1000003U})
+    {
+        const std::string suffix = " (n=" + std::to_string(n) + ")";
+        report("index %" + suffix, measure([&] {
+                   for (std::size_t i = 0; i < count; ++i)
+                   {
+                       idx[i] = static_cast<uint32_t>(hashes[i] % n);
+                   }
+                   sink = idx[count / 2];
+               }),
+               bytes);
+        const br::Partitioner barrett(n);
+        report("index barrett" + suffix, measure([&] {
+                   barrett.index(hashes.data(), idx.data(), count);
+                   sink = idx[count / 2];
+               }),
+               bytes);
+        const br::Partitioner mulshift(n, br::Partitioner::Method::multiply_shift);
+        report("index multiply_shift" + suffix, measure([&] {
+                   mulshift.index(hashes.data(), idx.data(), count);
+                   sink = idx[count / 2];
+               }),
+               bytes);
+    }
+
+    const br::Partitioner part(1000);
+    report("scatter (n=1000)", measure([&] {
+               sink = part.scatter(hashes.data(), count, out.data())[500];
+           }),
+           bytes);
+}
+
+void bench_random()
+{
+    std::cout << "Bounded random numbers (GB/s of 64-bit output):\n";
+
+    constexpr std::size_t count = 1U << 20U;
+    std::vector<uint64_t> out(count);
+    const std::size_t bytes = count * sizeof(uint64_t);
+
+    for (const uint64_t n : {1000UL, (1UL << 40U) + 7})
+    {
+        const std::string suffix = " (n=" + std::to_string(n) + ")";
+        std::mt19937_64 mt(12345);
+        report("mt19937_64 + %" + suffix, measure([&] {
+                   for (auto &v : out)
+                   {
+                       v = mt() % n;
+                   }
+                   sink = out[count / 2];
+               }),
+               bytes);
+        std::uniform_int_distribution<uint64_t> distr(0, n - 1);
+        report("mt19937_64 + uniform_int_distribution" + suffix, measure([&] {
+                   for (auto &v : out)
+                   {
+                       v = distr(mt);
+                   }
+                   sink = out[count / 2];
+               }),
+               bytes);
+        br::Xoshiro256x4 rng(12345);
+        const br::UniformMod u(n);
+        report("Xoshiro256x4 + UniformMod" + suffix, measure([&] {
+                   u.generate(rng, out.data(), count);
+                   sink = out[count / 2];
+               }),
+               bytes);
+    }
+}
+
+void bench_erasure()
+{
+    std::cout << "ReedSolomon (GB/s of data shards, 8 bytes per symbol):\n";
+
+    using Mode = br::ReedSolomon::Mode;
+    struct Case
+    {
+        uint64_t p;
+        std::size_t k;
+        std::size_t m;
+        Mode mode;
+    };
+    constexpr std::size_t len = 1U << 14U;
+    for (const Case &c : {Case{2013265921, 10, 4, Mode::matrix}, Case{(1UL << 61U) - 1, 10, 4, Mode::matrix},
+                          Case{2013265921, 64, 16, Mode::matrix}, Case{2013265921, 64, 16, Mode::ntt},
+                          Case{1945555039024054273, 64, 16, Mode::matrix}, Case{1945555039024054273, 64, 16, Mode::ntt}})
+    {
+        const br::ReedSolomon rs(c.p, c.k, c.m, c.mode);
+        const std::size_t n = c.k + c.m;
+        std::mt19937_64 gen(12345);
+        std::vector<std::vector<uint64_t>> shards(n, std::vector<uint64_t>(len));
+        std::vector<uint64_t *> ptrs(n);
+        for (std::size_t s = 0; s < n; ++s)
+        {
+            ptrs[s] = shards[s].data();
+            for (auto &v : shards[s])
+            {
+                v = gen() % c.p;
+            }
+        }
+        const std::size_t bytes = c.k * len * sizeof(uint64_t);
+        const std::string name = "p=" + std::to_string(c.p) + " " + std::to_string(c.k) + "+" + std::to_string(c.m) +
+                                 (rs.uses_ntt() ? " ntt" : " matrix");
+        report("encode " + name, measure([&] {
+                   rs.encode(ptrs.data(), ptrs.data() + c.k, len);
+                   sink = shards[c.k][len / 2];
+               }),
+               bytes);
+        // Lose the first m data shards.
+        std::array<bool, 128> present{};
+        std::fill(present.begin() + static_cast<std::ptrdiff_t>(c.m), present.begin() + static_cast<std::ptrdiff_t>(n),
+                  true);
+        report("decode " + name, measure([&] {
+                   rs.decode(ptrs.data(), present.data(), len);
+                   sink = shards[0][len / 2];
+               }),
+               bytes);
+    }
+}
+
+void bench_shamir()
+{
+    std::cout << "Shamir (GB/s of secrets, 8 bytes per secret):\n";
+
+    struct Case
+    {
+        uint64_t p;
+        std::size_t threshold;
+        std::size_t shares;
+    };
+    constexpr std::size_t len = 1U << 16U;
+    for (const Case &c : {Case{2013265921, 3, 5}, Case{(1UL << 61U) - 1, 3, 5}, Case{2013265921, 10, 20},
+                          Case{(1UL << 61U) - 1, 10, 20}})
+    {
+        const br::Shamir shamir(c.p, c.threshold, c.shares);
+        std::mt19937_64 gen(12345);
+        std::vector<uint64_t> secrets(len);
+        for (auto &s : secrets)
+        {
+            s = gen() % c.p;
+        }
+        std::vector<std::vector<uint64_t>> shares(c.shares, std::vector<uint64_t>(len));
+        std::vector<uint64_t *> out(c.shares);
+        for (std::size_t j = 0; j < c.shares; ++j)
+        {
+            out[j] = shares[j].data();
+        }
+        br::Xoshiro256x4 rng(12345);
+        const std::size_t bytes = len * sizeof(uint64_t);
+        const std::string name = "p=" + std::to_string(c.p) + " " + std::to_string(c.threshold) + "-of-" +
+                                 std::to_string(c.shares);
+        report("split " + name, measure([&] {
+                   shamir.split(secrets.data(), out.data(), len, rng);
+                   sink = shares[0][len / 2];
+               }),
+               bytes);
+
+        // Reconstruct from the last 'threshold' shares.
+        std::vector<std::size_t> ids(c.threshold);
+        std::vector<const uint64_t *> in(c.threshold);
+        for (std::size_t i = 0; i < c.threshold; ++i)
+        {
+            ids[i] = c.shares - c.threshold + i;
+            in[i] = shares[ids[i]].data();
+        }
+        const br::Shamir::Combiner comb(shamir, ids.data());
+        report("combine " + name, measure([&] {
+                   comb.combine(in.data(), secrets.data(), len);
+                   sink = secrets[len / 2];
+               }),
+               bytes);
+    }
+}
+
+void bench_poly()
+{
+    std::cout << "Multipoint evaluation, degree d at d points:\n";
+
+    for (const uint64_t p : {998244353UL, 4179340454199820289UL})
+    {
+        for (const std::size_t d : {std::size_t{256}, std::size_t{4096}, std::size_t{16384}})
+        {
+            const br::PolyRing ring(p, 2 * d);
+            std::mt19937_64 gen(12345);
+            br::PolyRing::Poly a(d);
+            br::PolyRing::Poly xs(d);
+            for (std::size_t i = 0; i < d; ++i)
+            {
+                a[i] = gen() % p;
+                xs[i] = gen() % p;
+            }
+            std::vector<uint64_t> out(d);
+            const std::string suffix = " (p=" + std::to_string(p) + ", d=" + std::to_string(d) + ")";
+            report_rate("Horner" + suffix, measure([&] {
+                       ring.eval(a, xs.data(), out.data(), d);
+                       sink = out[d / 2];
+                   }),
+                   d, "points");
+            report_rate("subproduct tree" + suffix, measure([&] {
+                       ring.eval_tree(a, xs.data(), out.data(), d);
+                       sink = out[d / 2];
+                   }),
+                   d, "points");
+            report_rate("interpolate" + suffix, measure([&] {
+                       sink = ring.interpolate(xs.data(), out.data(), d)[d / 2];
+                   }),
+                   d, "points");
+        }
+    }
+}
+
+void bench_poly_division()
+{
+    std::cout << "Power series inversion to d terms, and division of 2d by d coefficients:\n";
+
+    constexpr uint64_t p = 4179340454199820289UL;
+    for (const std::size_t d : {std::size_t{256}, std::size_t{4096}, std::size_t{65536}})
+    {
+        const br::PolyRing ring(p, 4 * d);
+        std::mt19937_64 gen(12345);
+        br::PolyRing::Poly a(2 * d);
+        br::PolyRing::Poly b(d);
+        for (auto &v : a)
+        {
+            v = gen() % p;
+        }
+        for (auto &v : b)
+        {
+            v = gen() % p;
+        }
+        b[0] = std::max<uint64_t>(b[0], 1);
+        b.back() = std::max<uint64_t>(b.back(), 1);
+        const br::PolyRing::Divisor div(ring, b, a.size());
+        const std::string suffix = " (d=" + std::to_string(d) + ")";
+        report_latency("inv_series" + suffix, measure([&] { sink = ring.inv_series(b, d)[d / 2]; }));
+        report_latency("divmod" + suffix, measure([&] { sink = ring.divmod(a, b).second[d / 2]; }));
+        report_latency("Divisor::divmod" + suffix, measure([&] { sink = div.divmod(a).second[d / 2]; }));
+    }
+}
+
+void bench_nttcache()
+{
+    std::cout << "NTT setup, N = 2^20:\n";
+
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "br-bench-nttcache";
+    std::filesystem::create_directories(dir);
+    const br::NTTCache cache(dir.string());
+    constexpr std::size_t size = 1U << 20U;
+    for (const uint64_t p : {998244353UL, 4179340454199820289UL})
+    {
+        const std::string suffix = " (p=" + std::to_string(p) + ")";
+        report_latency("build tables" + suffix, measure([&] { sink = br::NTT(p, size).root(size); }, 3));
+        // The first load writes the file, the measured ones map it.
+        sink = cache.load(p, size).root(size);
+        report_latency("NTTCache::load" + suffix, measure([&] { sink = cache.load(p, size).root(size); }, 3));
+    }
+    std::filesystem::remove_all(dir);
+}
+
+void bench_decimal()
+{
+    using uint128_t = unsigned __int128;
+
+    std::cout << "Decimal text to residues (GB/s of digits):\n";
+
+    constexpr std::size_t len = 1U << 22U;
+    std::mt19937 gen(12345);
+    std::string text(len, '0');
+    for (auto &c : text)
+    {
+        c = static_cast<char>('0' + gen() % 10);
+    }
+    constexpr uint64_t n = UINT64_MAX - 58;
+    report("per digit, '%' (1 modulus)", measure([&] {
+               uint64_t r = 0;
+               for (const char c : text)
+               {
+                   r = static_cast<uint64_t>((static_cast<uint128_t>(r) * 10 + static_cast<uint64_t>(c - '0')) % n);
+               }
+               sink = r;
+           }),
+           len);
+    std::vector<uint64_t> moduli = {n};
+    for (const std::size_t count : {std::size_t{1}, std::size_t{8}})
+    {
+        while (moduli.size() < count)
+        {
+            moduli.push_back(moduli.back() - 2);
+        }
+        const br::DecimalParser parser(moduli);
+        std::vector<uint64_t> out(count);
+        report("DecimalParser (" + std::to_string(count) + " moduli)", measure([&] {
+                   parser.parse(text.data(), len, out.data());
+                   sink = out[0];
+               }),
+               len);
+    }
+
+    std::cout << "Big integer to decimal text:\n";
+    std::mt19937_64 gen64(12345);
+    for (const std::size_t limbs : {std::size_t{16}, std::size_t{256}, std::size_t{4096}})
+    {
+        std::vector<uint64_t> x(limbs);
+        for (auto &v : x)
+        {
+            v = gen64();
+        }
+        const std::string suffix = " (" + std::to_string(limbs) + " limbs)";
+        // Peeling base-10^19 digits with the compiler's 128-bit division.
+        report_latency("peel with '/'" + suffix, measure([&] {
+                           std::vector<uint64_t> y = x;
+                           std::vector<uint64_t> chunks;
+                           while (!y.empty())
+                           {
+                               uint64_t r = 0;
+                               for (std::size_t i = y.size(); i-- > 0;)
+                               {
+                                   const uint128_t cur = (static_cast<uint128_t>(r) << 64U) | y[i];
+                                   y[i] = static_cast<uint64_t>(cur / 10000000000000000000UL);
+                                   r = static_cast<uint64_t>(cur % 10000000000000000000UL);
+                               }
+                               chunks.push_back(r);
+                               while (!y.empty() && y.back() == 0)
+                               {
+                                   y.pop_back();
+                               }
+                           }
+                           sink = chunks.back();
+                       }));
+        const br::DecimalFormatter formatter(limbs);
+        report_latency("DecimalFormatter" + suffix, measure([&] { sink = formatter.format(x).size(); }));
+    }
+}
+
+void bench_recurrence()
+{
+    std::cout << "Polynomial products mod 2^64-59, and N-th terms of order-d recurrences (N ~ 10^18):\n";
+
+    constexpr uint64_t n = UINT64_MAX - 58;
+    std::mt19937_64 gen(12345);
+    for (const std::size_t d : {std::size_t{64}, std::size_t{256}, std::size_t{1024}, std::size_t{4096}})
+    {
+        br::PolyMulMod::Poly a(d);
+        br::PolyMulMod::Poly b(d);
+        for (std::size_t i = 0; i < d; ++i)
+        {
+            a[i] = gen() % n;
+            b[i] = gen() % n;
+        }
+        const br::PolyMulMod pm(n, 2 * d);
+        const std::string suffix = " (d=" + std::to_string(d) + ")";
+        report_latency("PolyMulMod schoolbook" + suffix,
+                       measure([&] { sink = pm.mul(a, b, br::PolyMulMod::Method::schoolbook)[d]; }));
+        report_latency("PolyMulMod karatsuba" + suffix,
+                       measure([&] { sink = pm.mul(a, b, br::PolyMulMod::Method::karatsuba)[d]; }));
+        report_latency("PolyMulMod ntt" + suffix,
+                       measure([&] { sink = pm.mul(a, b, br::PolyMulMod::Method::ntt)[d]; }));
+
+        const br::LinearRecurrence rec(n, a, b);
+        report_latency("LinearRecurrence::term" + suffix, measure([&] { sink = rec.term(1000000000000000003UL); }));
+    }
+}
+
+
+// JSON output and comparison. One result object per line, so the reader below can stay small.
+
+auto cpu_model() -> std::string
+{
+    std::ifstream in("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.rfind("model name", 0) == 0 && line.find(':') != std::string::npos)
+        {
+            return line.substr(line.find(':') + 2);
+        }
+    }
+    return "unknown";
+}
+
+auto json_escape(const std::string &v) -> std::string
+{
+    std::string res;
+    for (const char c : v)
+    {
+        if (c == '"' || c == '\\')
+        {
+            res += '\\';
+        }
+        res += c;
+    }
+    return res;
+}
+
+auto write_json(const std::string &path) -> bool
+{
+    std::ofstream out(path);
+    out << std::setprecision(6) << "{\n"
+        << "  \"cpu\": \"" << json_escape(cpu_model()) << "\",\n"
+        << "  \"compiler\": \"" << json_escape(__VERSION__) << "\",\n"
+        << "  \"hardware_counters\": " << (perf().available() ? "true" : "false") << ",\n"
+        << "  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        const Result &r = results[i];
+        out << "    {\"name\": \"" << json_escape(r.name) << "\", \"unit\": \"" << r.unit
+            << "\", \"ns_per_element\": " << r.ns << ", \"median_ns\": " << r.median_ns
+            << ", \"mean_ns\": " << r.mean_ns << ", \"stddev_ns\": " << r.stddev_ns << ", \"runs\": " << r.runs
+            << ", \"cycles_per_element\": ";
+        if (r.cycles < 0)
+        {
+            out << "null";
+        }
+        else
+        {
+            out << r.cycles;
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+// Value of "key" in one line of write_json(): a string (unescaped) or the text of a number.
+auto json_field(const std::string &line, const std::string &key) -> std::string
+{
+    const std::size_t at = line.find("\"" + key + "\": ");
+    if (at == std::string::npos)
+    {
+        return "";
+    }
+    std::size_t i = at + key.size() + 4;
+    std::string res;
+    if (line[i] == '"')
+    {
+        for (++i; i < line.size() && line[i] != '"'; ++i)
+        {
+            if (line[i] == '\\')
+            {
+                ++i;
+            }
+            res += line[i];
+        }
+        return res;
+    }
+    for (; i < line.size() && line[i] != ',' && line[i] != '}'; ++i)
+    {
+        res += line[i];
+    }
+    return res;
+}
+
+auto read_json(const std::string &path, std::map<std::string, Result> &out) -> bool
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.find("\"name\": ") == std::string::npos)
+        {
+            continue;
+        }
+        Result r;
+        r.name = json_field(line, "name");
+        r.unit = json_field(line, "unit");
+        r.ns = std::stod(json_field(line, "ns_per_element"));
+        r.mean_ns = std::stod(json_field(line, "mean_ns"));
+        // Files written before the median was recorded: the mean is the nearest statistic.
+        const std::string median = json_field(line, "median_ns");
+        r.median_ns = median.empty() ? r.mean_ns : std::stod(median);
+        r.stddev_ns = std::stod(json_field(line, "stddev_ns"));
+        r.runs = std::stoul(json_field(line, "runs"));
+        out[r.name] = r;
+    }
+    return true;
+}
+
+auto median(std::vector<double> v) -> double
+{
+    std::sort(v.begin(), v.end());
+    const std::size_t n = v.size();
+    return n % 2 == 1 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// The results of every file of a comma-separated list, one Result per file that has the name. False when a
+// file cannot be read.
+auto read_files(const std::string &list, std::map<std::string, std::vector<Result>> &out, std::size_t &files)
+    -> bool
+{
+    files = 0;
+    for (std::size_t begin = 0; begin <= list.size();)
+    {
+        const std::size_t end = std::min(list.find(',', begin), list.size());
+        std::map<std::string, Result> one;
+        if (!read_json(list.substr(begin, end - begin), one))
+        {
+            std::cout << "Cannot read " << list.substr(begin, end - begin) << "\n";
+            return false;
+        }
+        for (const auto &[name, r] : one)
+        {
+            out[name].push_back(r);
+        }
+        ++files;
+        begin = end + 1;
+    }
+    return true;
+}
+
+// Range of one result on one side: every invocation's median, widened by twice the standard deviation of its
+// runs.
+auto range(const std::vector<Result> &rs) -> std::pair<double, double>
+{
+    double lo = rs[0].median_ns;
+    double hi = lo;
+    for (const Result &r : rs)
+    {
+        lo = std::min(lo, r.median_ns - 2 * r.stddev_ns);
+        hi = std::max(hi, r.median_ns + 2 * r.stddev_ns);
+    }
+    return {lo, hi};
+}
+
+// Compares the results of the files of 'cur_list' with those of 'base_list' (comma-separated lists, each file
+// being one invocation of br-bench). A result is reported as changed when the ranges of both sides are apart
+// by more than 'min_percent' percent. The spread between invocations is much larger than the spread of the runs
+// of one invocation (frequency, placement in memory, neighbours on the host), so a side needs several files
+// for its range to cover it. Returns the number of slowdowns, or -1 when a file cannot be read.
+auto compare(const std::string &base_list, const std::string &cur_list, const double min_percent) -> int
+{
+    std::map<std::string, std::vector<Result>> base;
+    std::map<std::string, std::vector<Result>> cur;
+    std::size_t base_files = 0;
+    std::size_t cur_files = 0;
+    if (!read_files(base_list, base, base_files) || !read_files(cur_list, cur, cur_files))
+    {
+        return -1;
+    }
+    std::cout << base_files << " base and " << cur_files << " new invocations";
+    if (base_files < 3 || cur_files < 3)
+    {
+        std::cout << ": with fewer than 3 per side, noise between invocations is reported as changes";
+    }
+    std::cout << "\n";
+
+    int slower = 0;
+    int faster = 0;
+    for (const auto &[name, c] : cur)
+    {
+        const auto it = base.find(name);
+        if (it == base.end())
+        {
+            continue;
+        }
+        const std::vector<Result> &b = it->second;
+        std::vector<double> vb;
+        std::vector<double> vc;
+        for (const Result &r : b)
+        {
+            vb.push_back(r.median_ns);
+        }
+        for (const Result &r : c)
+        {
+            vc.push_back(r.median_ns);
+        }
+        const double mb = median(vb);
+        const double mc = median(vc);
+        const double change = (mc / mb - 1) * 100;
+        const auto [b_lo, b_hi] = range(b);
+        const auto [c_lo, c_hi] = range(c);
+        const double gap = change > 0 ? (c_lo / b_hi - 1) * 100 : (b_lo / c_hi - 1) * 100;
+        if (gap <= min_percent)
+        {
+            continue;
+        }
+        (change > 0 ? slower : faster) += 1;
+        std::cout << (change > 0 ? "SLOWER " : "faster ") << std::left << std::setw(60) << name << std::right
+                  << std::fixed << std::setprecision(3) << std::setw(12) << mb << " -> " << std::setw(12) << mc
+                  << " ns/" << c[0].unit << std::setprecision(1) << std::showpos << std::setw(9) << change
+                  << std::noshowpos << "% (gap " << gap << "%)\n";
+    }
+    for (const auto &[name, b] : base)
+    {
+        if (cur.count(name) == 0)
+        {
+            std::cout << "missing " << name << "\n";
+        }
+    }
+    std::cout << slower << " slowdowns, " << faster << " speedups (threshold " << std::fixed << std::setprecision(1)
+              << min_percent << "%)\n";
+    return slower;
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int
+{
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "--compare")
+    {
+        if (args.size() < 3 || args.size() > 4)
+        {
+            std::cout << "Usage: br-bench --compare BASE.json[,BASE2.json...] NEW.json[,NEW2.json...] [MIN_PERCENT]\n";
+            return 2;
+        }
+        const int slower = compare(args[1], args[2], args.size() == 4 ? std::stod(args[3]) : 5.0);
+        return slower < 0 ? 2 : (slower > 0 ? 1 : 0);
+    }
+    std::string json;
+    if (args.size() == 2 && args[0] == "--json")
+    {
+        json = args[1];
+    }
+    else if (!args.empty())
+    {
+        std::cout << "Usage: br-bench [--json FILE] | --compare BASE.json[,...] NEW.json[,...] [MIN_PERCENT]\n";
+        return 2;
+    }
+
+    bench_reducers();
+    bench_rollhash();
+    bench_polyhash();
+    bench_checksum();
+    bench_buffer();
+    bench_partition();
+    bench_random();
+    bench_erasure();
+    bench_shamir();
+    bench_poly();
+    bench_poly_division();
+    bench_recurrence();
+    bench_nttcache();
+    bench_decimal();
+    if (!json.empty() && !write_json(json))
+    {
+        std::cout << "Cannot write " << json << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,19 +1,75 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
 #include <random>
+#include <sstream>
 #include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "libbr/br.hpp"
+#include "libbr/buffer.hpp"
+#include "libbr/checksum.hpp"
+#include "libbr/counters.hpp"
+#include "libbr/decimal.hpp"
+#include "libbr/erasure.hpp"
+#include "libbr/field.hpp"
+#include "libbr/jit.hpp"
+#include "libbr/modint.hpp"
+#include "libbr/ntt.hpp"
+#include "libbr/nttcache.hpp"
+#include "libbr/partition.hpp"
+#include "libbr/poly.hpp"
+#include "libbr/polyhash.hpp"
+#include "libbr/polymul.hpp"
+#include "libbr/random.hpp"
+#include "libbr/recurrence.hpp"
+#include "libbr/rollhash.hpp"
+#include "libbr/shamir.hpp"
+#include "libbr/tune.hpp"
 #include "libbr/util.hpp"
 
+// The part of a suite that one task runs: shard 'index' of 'count'. Set by the runner in main().
+struct Shard
+{
+    std::size_t index{0};
+    std::size_t count{1};
+};
+
+thread_local Shard shard;
+thread_local std::mt19937_64 seeds;
+
+// Seed for a random generator of the running task. The sequence only depends on the seed of the run, the suite
+// and the shard, so a failure can be replayed with the same --seed.
+auto test_seed() -> uint64_t
+{
+    return seeds();
+}
+
+// This shard's part of 'total' loop iterations.
+auto shard_part(const std::size_t total) -> std::size_t
+{
+    return total / shard.count + (shard.index < total % shard.count ? 1 : 0);
+}
+
 void test_br32()
 {
     std::cout << "Testing BR32.\n";
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    for (uint32_t bitlen = 1; bitlen <= 31; ++bitlen)
+    std::mt19937 gen(test_seed());
+    for (auto bitlen = static_cast<uint32_t>(1 + shard.index); bitlen <= 31; bitlen += shard.count)
     {
         const uint32_t min_n = (1U << bitlen) + 1;
         const uint32_t max_n = UINT32_MAX >> (31 - bitlen);
@@ -40,13 +96,170 @@ void test_br32()
     }
 }
 
+void test_br32_batch()
+{
+    std::cout << "Testing BR32 batch.\n";
+
+    std::mt19937 gen(test_seed());
+    for (uint32_t bitlen = 1; bitlen <= 31; ++bitlen)
+    {
+        const uint32_t min_n = (1U << bitlen) + 1;
+        const uint32_t max_n = UINT32_MAX >> (31 - bitlen);
+        std::uniform_int_distribution<uint32_t> distr_n(min_n, max_n);
+        for (std::size_t i = 0; i < 100; ++i)
+        {
+            const uint32_t n = distr_n(gen);
+            const br::BarrettRed32 br(n);
+            uint32_t const n2 = n > UINT16_MAX ? UINT32_MAX : n * n - 1;
+            std::uniform_int_distribution<uint32_t> distr_x(0, n2);
+            const std::size_t count = 1000 + i;
+            std::vector<uint32_t> x(count);
+            for (auto &v : x)
+            {
+                v = distr_x(gen);
+            }
+            std::vector<uint32_t> res(count);
+            br.calc(x.data(), res.data(), count);
+            for (std::size_t j = 0; j < count; ++j)
+            {
+                if (res[j] != x[j] % n)
+                {
+                    std::cout << "res=" << res[j] << ", ref=" << x[j] % n << "\n";
+                    std::cout << "x=" << x[j] << ", n=" << n << ", r=" << br.get_r() << "\n";
+                    throw std::runtime_error("Barrett reduction batch test failed.");
+                }
+            }
+            // In place.
+            br.calc(x.data(), x.data(), count);
+            if (x != res)
+            {
+                throw std::runtime_error("Barrett reduction batch test failed. 2");
+            }
+        }
+    }
+
+    const br::BarrettRed32 br(1000);
+    std::vector<uint32_t> x(100, 999999);
+    x[37] = 1000000;
+    bool thrown = false;
+    try
+    {
+        br.calc(x.data(), x.data(), x.size());
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("Barrett reduction batch test failed. 3");
+    }
+}
+
+void test_plantard32()
+{
+    std::cout << "Testing Plantard32.\n";
+
+    std::mt19937 gen(test_seed());
+    std::uniform_int_distribution<uint32_t> distr_any(0, UINT32_MAX);
+    for (uint32_t bitlen = 1; bitlen <= 31; ++bitlen)
+    {
+        const uint32_t min_n = (1U << bitlen) + 1;
+        // The largest accepted modulus is about 2^32 / 1.618.
+        const uint32_t max_n = bitlen == 31 ? 2654435769U : UINT32_MAX >> (31 - bitlen);
+        std::uniform_int_distribution<uint32_t> distr_n(min_n, max_n);
+        for (std::size_t i = 0; i < 100; ++i)
+        {
+            const uint32_t n = distr_n(gen) | 1U;
+            const br::Plantard32 pl(n);
+            if (pl.accepts_any_input() != (n < (1U << 31U)))
+            {
+                throw std::runtime_error("Plantard test failed.");
+            }
+            std::uniform_int_distribution<uint32_t> distr_x(0, pl.accepts_any_input() ? UINT32_MAX : n - 1);
+            std::uniform_int_distribution<uint32_t> distr_b(0, n - 1);
+            const std::size_t count = 1000 + i;
+            std::vector<uint32_t> x(count);
+            for (auto &v : x)
+            {
+                v = distr_x(gen);
+            }
+            // Extreme inputs and constants, then random constants, including some >= n.
+            x[0] = 0;
+            x[1] = pl.accepts_any_input() ? UINT32_MAX : n - 1;
+            const std::array<uint32_t, 4> edge = {0, 1, n - 1, distr_any(gen)};
+            for (std::size_t k = 0; k < 8; ++k)
+            {
+                const uint32_t b = k < edge.size() ? edge[k] : distr_b(gen);
+                const uint64_t b_prep = pl.prepare(b);
+                std::vector<uint32_t> res(count);
+                pl.mul(x.data(), res.data(), count, b_prep);
+                for (std::size_t j = 0; j < count; ++j)
+                {
+                    const auto ref = static_cast<uint32_t>(static_cast<uint64_t>(x[j]) * (b % n) % n);
+                    if (pl.mul(x[j], b_prep) != ref || res[j] != ref)
+                    {
+                        std::cout << "res=" << pl.mul(x[j], b_prep) << ", batch=" << res[j] << ", ref=" << ref
+                                  << "\n";
+                        std::cout << "x=" << x[j] << ", b=" << b << ", n=" << n << "\n";
+                        throw std::runtime_error("Plantard test failed. 2");
+                    }
+                }
+            }
+            std::vector<uint32_t> res(count);
+            pl.calc(x.data(), res.data(), count);
+            for (std::size_t j = 0; j < count; ++j)
+            {
+                if (pl.calc(x[j]) != x[j] % n || res[j] != x[j] % n)
+                {
+                    std::cout << "x=" << x[j] << ", n=" << n << "\n";
+                    throw std::runtime_error("Plantard test failed. 3");
+                }
+            }
+        }
+    }
+
+    for (const uint32_t n : {0U, 1U, 2U, 1000U, 2654435771U, UINT32_MAX})
+    {
+        bool thrown = false;
+        try
+        {
+            const br::Plantard32 pl(n);
+        }
+        catch (const std::invalid_argument &)
+        {
+            thrown = true;
+        }
+        if (!thrown)
+        {
+            throw std::runtime_error("Plantard test failed. 4");
+        }
+    }
+
+    const br::Plantard32 pl(2654435761U);
+    std::vector<uint32_t> x(100, 2654435760U);
+    x[37] = 2654435761U;
+    bool thrown = false;
+    try
+    {
+        pl.mul(x.data(), x.data(), x.size(), pl.prepare(3));
+    }
+    catch (const std::invalid_argument &)
+    {
+        thrown = true;
+    }
+    if (!thrown)
+    {
+        throw std::runtime_error("Plantard test failed. 5");
+    }
+}
+
 void test_br64()
 {
     std::cout << "Testing BR64.\n";
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    for (uint64_t bitlen = 1; bitlen <= 63; ++bitlen)
+    std::mt19937 gen(test_seed());
+    for (auto bitlen = static_cast<uint64_t>(1 + shard.index); bitlen <= 63; bitlen += shard.count)
     {
         const uint64_t min_n = (1UL << bitlen) + 1;
         const uint64_t max_n = UINT64_MAX >> (63 - bitlen);
@@ -73,15 +286,82 @@ void test_br64()
     }
 }
 
+void test_jit()
+{
+    std::cout << "Testing BarrettJit64.\n";
+
+#ifdef BR_HAVE_JIT
+    if (!br::BarrettJit64(1000).jitted())
+    {
+        throw std::runtime_error("JIT test failed.");
+    }
+#endif
+
+    std::mt19937_64 gen(test_seed());
+    std::uniform_int_distribution<uint64_t> distr_x(0, UINT64_MAX);
+    for (uint64_t bitlen = 1; bitlen <= 63; ++bitlen)
+    {
+        const uint64_t min_n = (1UL << bitlen) + 1;
+        const uint64_t max_n = UINT64_MAX >> (63 - bitlen);
+        std::uniform_int_distribution<uint64_t> distr_n(min_n, max_n);
+        for (std::size_t i = 0; i < 20; ++i)
+        {
+            // Both sides of the immediate / register choice for n.
+            const uint64_t n = i == 0 ? min_n : i == 1 ? max_n : distr_n(gen);
+            const br::BarrettJit64 jit(n);
+            // Every tail length of the unrolled loop.
+            const std::size_t count = 1000 + i;
+            std::vector<uint64_t> x(count);
+            for (auto &v : x)
+            {
+                v = distr_x(gen);
+            }
+            x[0] = 0;
+            x[1] = UINT64_MAX;
+            x[2] = n;
+            x[3] = n - 1;
+            std::vector<uint64_t> res(count);
+            jit.calc(x.data(), res.data(), count);
+            for (std::size_t j = 0; j < count; ++j)
+            {
+                if (res[j] != x[j] % n)
+                {
+                    std::cout << "res=" << res[j] << ", ref=" << x[j] % n << "\n";
+                    std::cout << "x=" << x[j] << ", n=" << n << ", jitted=" << jit.jitted() << "\n";
+                    throw std::runtime_error("JIT test failed. 2");
+                }
+            }
+            // In place, and short counts.
+            jit.calc(x.data(), x.data(), count);
+            if (x != res)
+            {
+                throw std::runtime_error("JIT test failed. 3");
+            }
+            std::vector<uint64_t> y = {distr_x(gen), distr_x(gen), distr_x(gen), UINT64_MAX};
+            for (std::size_t c = 0; c <= y.size(); ++c)
+            {
+                std::vector<uint64_t> out(y.size(), 7);
+                jit.calc(y.data(), out.data(), c);
+                for (std::size_t j = 0; j < y.size(); ++j)
+                {
+                    if (out[j] != (j < c ? y[j] % n : 7))
+                    {
+                        throw std::runtime_error("JIT test failed. 4");
+                    }
+                }
+            }
+        }
+    }
+}
+
 void test_br128()
 {
     using uint128_t = unsigned __int128;
 
     std::cout << "Testing BR128.\n";
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    for (uint64_t bitlen = 1; bitlen <= 63; ++bitlen)
+    std::mt19937 gen(test_seed());
+    for (auto bitlen = static_cast<uint64_t>(1 + shard.index); bitlen <= 63; bitlen += shard.count)
     {
         const uint64_t min_n = (1UL << bitlen) + 1;
         const uint64_t max_n = UINT64_MAX >> (63 - bitlen);
@@ -92,6 +372,7 @@ void test_br128()
             const br::BarrettRed128 br(n);
             uint128_t const n2 = static_cast<uint128_t>(n) * static_cast<uint128_t>(n) - 1;
             std::uniform_int_distribution<uint128_t> distr_x(0, n2);
+            std::uniform_int_distribution<uint64_t> distr_hi(0, UINT64_MAX);
             for (std::size_t j = 0; j < 1000; ++j)
             {
                 const uint128_t x = distr_x(gen);
@@ -116,6 +397,15 @@ void test_br128()
                               << ", s=" << br.get_s() << ", t=" << br.get_t() << "\n";
                     throw std::runtime_error("Barrett reduction test failed.");
                 }
+#ifdef __SIZEOF_INT128__
+                const uint128_t x_full = (static_cast<uint128_t>(distr_hi(gen)) << 64U) | x_lo;
+                if (br.calc_full(x_full) != x_full % n)
+                {
+                    std::cout << "x_hi=" << static_cast<uint64_t>(x_full >> 64U) << ", x_lo=" << x_lo << ", n=" << n
+                              << "\n";
+                    throw std::runtime_error("Barrett reduction test failed. 2");
+                }
+#endif
             }
         }
     }
@@ -125,10 +415,9 @@ void test_longdiv64()
 {
     std::cout << "Testing longdiv64.\n";
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937 gen(test_seed());
     std::uniform_int_distribution<uint64_t> distr(1, UINT64_MAX);
-    for (int64_t i = 0; i < 10000000; ++i)
+    for (std::size_t i = 0, end = shard_part(10000000); i < end; ++i)
     {
         const uint64_t d = distr(gen);
         const uint64_t n = distr(gen);
@@ -156,11 +445,10 @@ void test_longdiv128()
 
     std::cout << "Testing longdiv128.\n";
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937 gen(test_seed());
     std::uniform_int_distribution<uint128_t> distr128(1, ~static_cast<uint128_t>(0));
     std::uniform_int_distribution<uint64_t> distr64(1, UINT64_MAX);
-    for (int64_t i = 0; i < 10000000; ++i)
+    for (std::size_t i = 0, end = shard_part(10000000); i < end; ++i)
     {
         const uint128_t d = distr128(gen);
         const uint64_t n = distr64(gen);
@@ -189,10 +477,9 @@ void test_longdiv128_1s()
 
     std::cout << "Testing longdiv128_1s.\n";
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937 gen(test_seed());
     std::uniform_int_distribution<uint64_t> distr(1, UINT64_MAX);
-    for (int64_t i = 0; i < 10000000; ++i)
+    for (std::size_t i = 0, end = shard_part(10000000); i < end; ++i)
     {
         const uint64_t d = distr(gen);
         const uint64_t res = br::util::longdiv128_1s(d);
@@ -206,15 +493,1865 @@ void test_longdiv128_1s()
 }
 #endif
 
-auto main() -> int
+template <typename Reducer> void test_modint_reducer(const uint64_t max_bitlen)
+{
+    using uint128_t = unsigned __int128;
+    using ModInt = br::DynModInt<Reducer>;
+
+    std::mt19937 gen(test_seed());
+    for (uint64_t bitlen = 2; bitlen <= max_bitlen; ++bitlen)
+    {
+        const uint64_t min_n = (1UL << (bitlen - 1)) + 1;
+        const uint64_t max_n = UINT64_MAX >> (64 - bitlen);
+        std::uniform_int_distribution<uint64_t> distr_n(min_n, max_n);
+        for (std::size_t i = 0; i < 100; ++i)
+        {
+            const uint64_t n = distr_n(gen);
+            const typename ModInt::Scope scope(n);
+            std::uniform_int_distribution<uint64_t> distr_x(0, UINT64_MAX);
+            for (std::size_t j = 0; j < 1000; ++j)
+            {
+                const uint64_t x = distr_x(gen);
+                const uint64_t y = distr_x(gen);
+                const ModInt a(x);
+                const ModInt b(y);
+                const uint64_t xr = x % n;
+                const uint64_t yr = y % n;
+                const uint64_t ref_add = (static_cast<uint128_t>(xr) + yr) % n;
+                const uint64_t ref_sub = (static_cast<uint128_t>(xr) + n - yr) % n;
+                const uint64_t ref_mul = (static_cast<uint128_t>(xr) * yr) % n;
+                if (a.value() != xr || (a + b).value() != ref_add || (a - b).value() != ref_sub ||
+                    (a * b).value() != ref_mul)
+                {
+                    std::cout << "x=" << x << ", y=" << y << ", n=" << n << "\n";
+                    throw std::runtime_error("DynModInt test failed.");
+                }
+                const uint64_t e = j;
+                uint64_t ref_pow = 1 % n;
+                for (uint64_t k = 0; k < e % 8; ++k)
+                {
+                    ref_pow = (static_cast<uint128_t>(ref_pow) * xr) % n;
+                }
+                if (a.pow(e % 8).value() != ref_pow)
+                {
+                    std::cout << "x=" << x << ", e=" << e % 8 << ", n=" << n << "\n";
+                    throw std::runtime_error("DynModInt pow test failed.");
+                }
+                uint64_t g = xr;
+                uint64_t h = n;
+                while (h != 0)
+                {
+                    g %= h;
+                    std::swap(g, h);
+                }
+                if (g == 1 && (a * a.inv()).value() != 1)
+                {
+                    std::cout << "x=" << x << ", n=" << n << "\n";
+                    throw std::runtime_error("DynModInt inv test failed.");
+                }
+            }
+        }
+    }
+}
+
+void test_tune()
+{
+    std::cout << "Testing TuningProfile and batch reducers.\n";
+
+    std::mt19937_64 gen(test_seed());
+
+    // Every kernel, usable or not (unusable ones fall back), against '%'.
+    for (unsigned bits = 2; bits <= 32; ++bits)
+    {
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            auto n = static_cast<uint32_t>(((1UL << (bits - 1)) | gen()) & ((1UL << bits) - 1));
+            if (n < 3 || (n & (n - 1)) == 0)
+            {
+                ++n;
+            }
+            const uint64_t n2 = static_cast<uint64_t>(n) * n;
+            std::vector<uint32_t> x(257 + i);
+            for (auto &v : x)
+            {
+                v = static_cast<uint32_t>(n2 > UINT32_MAX ? gen() : gen() % n2);
+            }
+            for (const br::Kernel k : {br::Kernel::scalar, br::Kernel::avx2, br::Kernel::plantard, br::Kernel::jit})
+            {
+                const br::BatchReducer32 red(n, k);
+                if (red.get_kernel() != k && br::BatchReducer32::usable(k, n))
+                {
+                    throw std::runtime_error("Tuning test failed.");
+                }
+                std::vector<uint32_t> out(x.size());
+                red.calc(x.data(), out.data(), x.size());
+                for (std::size_t j = 0; j < x.size(); ++j)
+                {
+                    if (out[j] != x[j] % n)
+                    {
+                        std::cout << "x=" << x[j] << ", n=" << n << ", kernel=" << br::kernel_name(k) << "\n";
+                        throw std::runtime_error("Tuning test failed. 2");
+                    }
+                }
+            }
+        }
+    }
+    for (unsigned bits = 2; bits <= 64; ++bits)
+    {
+        const uint64_t top = bits == 64 ? 0 : 1UL << bits;
+        uint64_t n = ((1UL << (bits - 1)) | gen()) & (top - 1);
+        if (n < 3 || (n & (n - 1)) == 0)
+        {
+            ++n;
+        }
+        std::vector<uint64_t> x(257);
+        for (auto &v : x)
+        {
+            v = gen();
+        }
+        for (const br::Kernel k : {br::Kernel::scalar, br::Kernel::avx2, br::Kernel::jit})
+        {
+            const br::BatchReducer64 red(n, k);
+            std::vector<uint64_t> out(x.size());
+            red.calc(x.data(), out.data(), x.size());
+            for (std::size_t j = 0; j < x.size(); ++j)
+            {
+                if (out[j] != x[j] % n)
+                {
+                    std::cout << "x=" << x[j] << ", n=" << n << ", kernel=" << br::kernel_name(k) << "\n";
+                    throw std::runtime_error("Tuning test failed. 3");
+                }
+            }
+        }
+    }
+
+    // A profile drives the choice by bit length, and survives a save and load.
+    br::TuningProfile profile = br::TuningProfile::tune();
+    profile.set_kernel32(10, br::Kernel::plantard);
+    profile.set_kernel32(11, br::Kernel::scalar);
+    profile.set_kernel64(40, br::Kernel::scalar);
+    if (br::BatchReducer32(1001, profile).get_kernel() != br::Kernel::plantard ||
+        br::BatchReducer32(1024 + 7, profile).get_kernel() != br::Kernel::scalar ||
+        br::BatchReducer32(1000, profile).get_kernel() != br::BatchReducer32::default_kernel() ||
+        br::BatchReducer64((1UL << 39U) + 1, profile).get_kernel() != br::Kernel::scalar)
+    {
+        throw std::runtime_error("Tuning test failed. 4");
+    }
+
+    const std::filesystem::path dir =
+        std::filesystem::temp_directory_path() / ("br-test-tune-" + std::to_string(std::random_device()()));
+    const std::string file = (dir / "sub" / "tune.txt").string();
+    br::TuningProfile loaded;
+    if (br::TuningProfile::load(file, loaded) || !profile.save(file) || !br::TuningProfile::load(file, loaded))
+    {
+        throw std::runtime_error("Tuning test failed. 5");
+    }
+    for (unsigned bits = 2; bits <= 64; ++bits)
+    {
+        const uint64_t n = (1UL << (bits - 1)) | 1U;
+        if (loaded.kernel64(n) != profile.kernel64(n) ||
+            (bits <= 32 && loaded.kernel32(static_cast<uint32_t>(n)) != profile.kernel32(static_cast<uint32_t>(n))))
+        {
+            throw std::runtime_error("Tuning test failed. 6");
+        }
+    }
+    if (br::TuningProfile::load_or_tune(file).kernel32(1001) != br::Kernel::plantard)
+    {
+        throw std::runtime_error("Tuning test failed. 7");
+    }
+
+    // Damaged, truncated or foreign profiles are rejected.
+    const auto rejected = [&](const std::string &text) {
+        std::ofstream(file) << text;
+        br::TuningProfile p;
+        return !br::TuningProfile::load(file, p);
+    };
+    std::ifstream in(file);
+    const std::string good((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string unknown = good;
+    unknown.replace(unknown.find("plantard"), 8, "fpu");
+    if (!rejected(good.substr(0, good.size() / 2)) || !rejected("libbr-tune 0 avx2=1 jit=1\n") ||
+        !rejected(unknown) || !rejected(good + "br32 33 scalar\n") || rejected(good))
+    {
+        throw std::runtime_error("Tuning test failed. 8");
+    }
+    std::filesystem::remove_all(dir);
+}
+
+void test_counters()
 {
-    test_longdiv64();
+    std::cout << "Testing counters.\n";
+
+    using br::counters::Event;
+    const auto delta = [](const br::counters::Snapshot &before, const Event e) -> uint64_t {
+        return br::counters::snapshot()[static_cast<std::size_t>(e)] - before[static_cast<std::size_t>(e)];
+    };
+    const auto expect = [](const uint64_t got, const uint64_t want, const char *what) {
+        if (got != want)
+        {
+            std::cout << what << ": got=" << got << ", want=" << want << "\n";
+            throw std::runtime_error("Counters test failed.");
+        }
+    };
+    // Without BR_ENABLE_COUNTERS nothing is counted.
+    const uint64_t on = br::counters::enabled ? 1 : 0;
+
+    // r = floor((2^32 - 1) / 10) is a little below 2^32 / 10: 7 is estimated as 0 * 10 + 7, but 90 as 8 * 10 + 10,
+    // which needs the correction.
+    br::counters::Snapshot s = br::counters::snapshot();
+    const br::BarrettRed32 br32(10);
+    (void)br32.calc(7);
+    (void)br32.calc(90);
+    try
+    {
+        (void)br32.calc(100);
+    }
+    catch (const std::invalid_argument &)
+    {
+    }
+    expect(delta(s, Event::br32_calls), 3 * on, "br32.calls");
+    expect(delta(s, Event::br32_corrections), on, "br32.corrections");
+    expect(delta(s, Event::br32_rejected), on, "br32.rejected");
+
+    s = br::counters::snapshot();
+    const br::BarrettRed64 br64(1000);
+    uint64_t calls = 0;
+    uint64_t corrections = 0;
+    for (uint64_t x = 0; x < 1000000; x += 7)
+    {
+        (void)br64.calc(x);
+        ++calls;
+        corrections += x - br::util::mulhi64(x, br64.get_r()) * 1000 >= 1000 ? 1 : 0;
+    }
+    (void)br64.calc_full(UINT64_MAX);
+    corrections += UINT64_MAX - br::util::mulhi64(UINT64_MAX, br64.get_r()) * 1000 >= 1000 ? 1 : 0;
+    expect(delta(s, Event::br64_calls), (calls + 1) * on, "br64.calls");
+    expect(delta(s, Event::br64_corrections), corrections * on, "br64.corrections");
+    expect(delta(s, Event::br64_rejected), 0, "br64.rejected");
+    expect(delta(s, Event::br64_wide), on, "br64.wide");
+
 #ifdef __SIZEOF_INT128__
-    test_longdiv128();
-    test_longdiv128_1s();
+    s = br::counters::snapshot();
+    const br::BarrettRed128 br128(1000003);
+    (void)br128.mul(999999, 999999);
+    (void)br128.calc_full(~static_cast<unsigned __int128>(0));
+    try
+    {
+        (void)br128.calc(static_cast<unsigned __int128>(1000003) * 1000003);
+    }
+    catch (const std::invalid_argument &)
+    {
+    }
+    // Rejected inputs count as calls at every width.
+    expect(delta(s, Event::br128_calls), 3 * on, "br128.calls");
+    expect(delta(s, Event::br128_rejected), on, "br128.rejected");
+    expect(delta(s, Event::br128_wide), on, "br128.wide");
+#endif
+
+    // The JIT kernel counts its calls, whether or not code was generated.
+    s = br::counters::snapshot();
+    const br::BarrettJit64 jit(1000);
+    std::vector<uint64_t> xs(37, UINT64_MAX);
+    jit.calc(xs.data(), xs.data(), xs.size());
+    expect(delta(s, Event::br64_calls), 37 * on, "br64.calls (jit)");
+
+    // Subsystems on GF(p).
+    const uint64_t p = 998244353;
+    s = br::counters::snapshot();
+    const br::NTT ntt(p, 16);
+    std::vector<uint64_t> a(16 * 3, 1);
+    ntt.forward(a.data(), 16, 3);
+    ntt.inverse(a.data(), 8);
+    expect(delta(s, Event::ntt_points), (16 * 3 + 8) * on, "ntt.points");
+
+    s = br::counters::snapshot();
+    const br::ReedSolomon rs(p, 3, 2, br::ReedSolomon::Mode::matrix);
+    std::vector<std::vector<uint64_t>> shards(5, std::vector<uint64_t>(10, 1));
+    std::vector<uint64_t *> ptrs;
+    for (auto &sh : shards)
+    {
+        ptrs.push_back(sh.data());
+    }
+    rs.encode(ptrs.data(), ptrs.data() + 3, 10);
+    const std::array<bool, 5> present = {false, true, true, true, true};
+    rs.decode(ptrs.data(), present.data(), 10);
+    expect(delta(s, Event::rs_encoded), 2 * 10 * on, "rs.encoded");
+    expect(delta(s, Event::rs_recovered), 10 * on, "rs.recovered");
+
+    s = br::counters::snapshot();
+    const br::Shamir shamir(p, 2, 3);
+    br::Xoshiro256x4 rng(1);
+    const std::vector<uint64_t> secrets(10, 5);
+    std::vector<uint64_t> recovered(10);
+    shamir.split(secrets.data(), ptrs.data(), 10, rng);
+    const std::array<std::size_t, 2> ids = {0, 2};
+    const std::array<const uint64_t *, 2> parts = {ptrs[0], ptrs[2]};
+    const br::Shamir::Combiner comb(shamir, ids.data());
+    comb.combine(parts.data(), recovered.data(), 10);
+    expect(delta(s, Event::shamir_shares), 3 * 10 * on, "shamir.shares");
+    expect(delta(s, Event::shamir_combined), 10 * on, "shamir.combined");
+
+    s = br::counters::snapshot();
+    const br::PolyMulMod pm(1000003);
+    (void)pm.mul(std::vector<uint64_t>(5, 1), std::vector<uint64_t>(7, 1));
+    expect(delta(s, Event::polymul_coefficients), 11 * on, "polymul.coefficients");
+
+    std::ostringstream os;
+    br::counters::write(os, br::counters::snapshot());
+    if (os.str().find("br64.corrections ") == std::string::npos)
+    {
+        throw std::runtime_error("Counters test failed. 2");
+    }
+
+#ifdef BR_ENABLE_COUNTERS
+    // Counts of other threads, live or exited.
+    s = br::counters::snapshot();
+    std::thread th([] {
+        const br::BarrettRed64 br(1000);
+        for (uint64_t x = 0; x < 1000; ++x)
+        {
+            (void)br.calc(x);
+        }
+    });
+    th.join();
+    expect(delta(s, Event::br64_calls), 1000, "br64.calls (thread)");
 #endif
-    test_br32();
-    test_br64();
-    test_br128();
-    return 0;
+}
+
+void test_modint()
+{
+    std::cout << "Testing DynModInt.\n";
+
+    test_modint_reducer<br::BarrettRed64>(32);
+    test_modint_reducer<br::BarrettRed128>(64);
+
+    // Nested scopes restore the outer modulus.
+    using ModInt = br::DynModInt<br::BarrettRed128>;
+    const ModInt::Scope outer(1000003);
+    {
+        const ModInt::Scope inner(17);
+        if (ModInt::modulus() != 17 || ModInt(20).value() != 3)
+        {
+            throw std::runtime_error("DynModInt scope test failed.");
+        }
+    }
+    if (ModInt::modulus() != 1000003 || ModInt(1000005).value() != 2)
+    {
+        throw std::runtime_error("DynModInt scope test failed. 2");
+    }
+}
+
+void test_rollhash()
+{
+    using uint128_t = unsigned __int128;
+
+    std::cout << "Testing RollingHash.\n";
+
+    std::mt19937 gen(test_seed());
+    std::uniform_int_distribution<uint32_t> distr_c(0, UINT8_MAX);
+    const std::array<uint64_t, 2> moduli = {(1UL << 61U) - 1, UINT64_MAX - 58};
+    for (const std::size_t window : {1, 3, 16, 64})
+    {
+        for (const std::size_t len : {window, window + 1, window + 7, window + 100, window + 1000})
+        {
+            std::vector<uint8_t> data(len);
+            for (auto &c : data)
+            {
+                c = distr_c(gen);
+            }
+            std::array<uint64_t, 2> bases{};
+            for (std::size_t k = 0; k < 2; ++k)
+            {
+                bases[k] = std::uniform_int_distribution<uint64_t>(2, moduli[k] - 1)(gen);
+            }
+            const br::MultiRollingHash<2> mh(moduli, bases, window);
+            const std::size_t count = len - window + 1;
+            std::vector<uint64_t> multi(count * 2);
+            mh.hash_windows(data.data(), len, multi.data());
+            for (std::size_t k = 0; k < 2; ++k)
+            {
+                std::vector<uint64_t> single(count);
+                mh.get(k).hash_windows(data.data(), len, single.data());
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    uint64_t ref = 0;
+                    for (std::size_t j = 0; j < window; ++j)
+                    {
+                        ref = (static_cast<uint128_t>(ref) * bases[k] + data[i + j]) % moduli[k];
+                    }
+                    if (single[i] != ref || multi[i * 2 + k] != ref)
+                    {
+                        std::cout << "window=" << window << ", len=" << len << ", i=" << i << ", n=" << moduli[k]
+                                  << ", res1=" << single[i] << ", res2=" << multi[i * 2 + k] << ", ref=" << ref
+                                  << "\n";
+                        throw std::runtime_error("RollingHash test failed.");
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename Reducer> void test_polyhash_reducer(const Reducer &red)
+{
+    using uint128_t = unsigned __int128;
+
+    std::mt19937 gen(test_seed());
+    std::uniform_int_distribution<uint32_t> distr_c(0, UINT8_MAX);
+    const uint64_t n = red.get_n();
+    for (std::size_t len = 0; len < 200; ++len)
+    {
+        std::vector<uint8_t> data(len);
+        for (auto &c : data)
+        {
+            c = distr_c(gen);
+        }
+        const uint64_t key = std::uniform_int_distribution<uint64_t>(0, n - 1)(gen);
+        br::PolyHash<Reducer> ph(red, key);
+        const std::size_t bb = ph.get_block_bytes();
+
+        uint64_t ref = 1;
+        std::size_t pos = 0;
+        for (;; pos += bb)
+        {
+            const std::size_t take = std::min(bb, len - pos);
+            uint64_t m = 0;
+            for (std::size_t i = 0; i < take; ++i)
+            {
+                m |= static_cast<uint64_t>(data[pos + i]) << (8 * i);
+            }
+            if (take < bb)
+            {
+                m |= 1UL << (8 * take);
+            }
+            ref = (static_cast<uint128_t>(ref) * key + m) % n;
+            if (take < bb)
+            {
+                break;
+            }
+        }
+
+        // Feed the message in random pieces.
+        std::size_t fed = 0;
+        while (fed < len)
+        {
+            const std::size_t piece = std::uniform_int_distribution<std::size_t>(0, len - fed)(gen);
+            ph.update(data.data() + fed, piece);
+            fed += piece;
+        }
+        // An empty update, with no buffer at all, changes nothing.
+        ph.update(nullptr, 0);
+        const uint64_t res1 = ph.finalize();
+        const uint64_t res2 = ph.hash(data.data(), len);
+        if (res1 != ref || res2 != ref)
+        {
+            std::cout << "len=" << len << ", n=" << n << ", key=" << key << ", res1=" << res1 << ", res2=" << res2
+                      << ", ref=" << ref << "\n";
+            throw std::runtime_error("PolyHash test failed.");
+        }
+    }
+}
+
+void test_polyhash()
+{
+    using uint128_t = unsigned __int128;
+
+    std::cout << "Testing PolyHash.\n";
+
+    test_polyhash_reducer(br::MersenneRed61());
+    test_polyhash_reducer(br::BarrettRed128((1UL << 61U) - 1));
+    test_polyhash_reducer(br::BarrettRed128(UINT64_MAX - 58));
+    test_polyhash_reducer(br::BarrettRed128(2147483647));
+    test_polyhash_reducer(br::BarrettRed128(257));
+
+    std::mt19937 gen(test_seed());
+    std::uniform_int_distribution<uint64_t> distr(0, UINT64_MAX);
+    const br::MersenneRed61 m61;
+    for (std::size_t i = 0; i < 1000000; ++i)
+    {
+        const uint64_t a = distr(gen) % m61.n;
+        const uint64_t b = distr(gen) % m61.n;
+        const uint128_t x = (static_cast<uint128_t>(distr(gen)) << 64U) | distr(gen);
+        if (m61.mul(a, b) != (static_cast<uint128_t>(a) * b) % m61.n || m61.calc_full(x) != x % m61.n)
+        {
+            std::cout << "a=" << a << ", b=" << b << "\n";
+            throw std::runtime_error("MersenneRed61 test failed.");
+        }
+    }
+}
+
+void test_checksum()
+{
+    std::cout << "Testing checksums.\n";
+
+    const char *const wiki = "Wikipedia";
+    if (br::adler32(reinterpret_cast<const uint8_t *>(wiki), std::strlen(wiki)) != 0x11E60398)
+    {
+        throw std::runtime_error("Adler-32 test failed.");
+    }
+    const char *const abcde = "abcdef";
+    if (br::fletcher16(reinterpret_cast<const uint8_t *>(abcde), 5) != 0xC8F0 ||
+        br::fletcher16(reinterpret_cast<const uint8_t *>(abcde), 6) != 0x2057)
+    {
+        throw std::runtime_error("Fletcher-16 test failed.");
+    }
+    const std::array<uint16_t, 3> words = {0x6261, 0x6463, 0x0065};
+    if (br::fletcher32(words.data(), 3) != 0xF04FC729)
+    {
+        throw std::runtime_error("Fletcher-32 test failed.");
+    }
+
+    std::mt19937 gen(test_seed());
+    std::uniform_int_distribution<uint32_t> distr_c(0, UINT8_MAX);
+    for (const std::size_t len : {0, 1, 31, 32, 33, 1000, 5535, 5536, 5537, 5600, 5888, 100000, 1000000})
+    {
+        for (const bool ones : {false, true})
+        {
+            std::vector<uint8_t> data(len);
+            for (auto &c : data)
+            {
+                c = ones ? UINT8_MAX : distr_c(gen);
+            }
+            uint32_t a1 = 1;
+            uint32_t a2 = 0;
+            uint32_t f1 = 0;
+            uint32_t f2 = 0;
+            for (const uint8_t c : data)
+            {
+                a1 = (a1 + c) % br::adler32_mod;
+                a2 = (a2 + a1) % br::adler32_mod;
+                f1 = (f1 + c) % 255;
+                f2 = (f2 + f1) % 255;
+            }
+            const uint32_t adler_ref = (a2 << 16U) | a1;
+            const uint32_t fletcher_ref = (f2 << 8U) | f1;
+            if (br::adler32(data.data(), len) != adler_ref || br::adler32_scalar(data.data(), len) != adler_ref)
+            {
+                std::cout << "len=" << len << ", ref=" << adler_ref << "\n";
+                throw std::runtime_error("Adler-32 test failed. 2");
+            }
+            // Continuing a stream.
+            const std::size_t half = len / 2;
+            if (br::adler32(data.data() + half, len - half, br::adler32(data.data(), half)) != adler_ref)
+            {
+                std::cout << "len=" << len << ", ref=" << adler_ref << "\n";
+                throw std::runtime_error("Adler-32 test failed. 3");
+            }
+            if (br::fletcher16(data.data(), len) != fletcher_ref ||
+                br::fletcher16_scalar(data.data(), len) != fletcher_ref)
+            {
+                std::cout << "len=" << len << ", ref=" << fletcher_ref << "\n";
+                throw std::runtime_error("Fletcher-16 test failed. 2");
+            }
+
+            std::vector<uint16_t> w(len / 2);
+            std::memcpy(w.data(), data.data(), w.size() * 2);
+            uint64_t g1 = 0;
+            uint64_t g2 = 0;
+            for (const uint16_t c : w)
+            {
+                g1 = (g1 + c) % 65535;
+                g2 = (g2 + g1) % 65535;
+            }
+            if (br::fletcher32(w.data(), w.size()) != ((g2 << 16U) | g1))
+            {
+                std::cout << "len=" << w.size() << ", ref=" << ((g2 << 16U) | g1) << "\n";
+                throw std::runtime_error("Fletcher-32 test failed. 2");
+            }
+        }
+    }
+}
+
+void test_partition()
+{
+    using uint128_t = unsigned __int128;
+    using Method = br::Partitioner::Method;
+
+    std::cout << "Testing Partitioner.\n";
+
+    std::mt19937 gen(test_seed());
+    std::uniform_int_distribution<uint64_t> distr_h(0, UINT64_MAX);
+    for (const uint32_t n : {1U, 2U, 3U, 7U, 64U, 100U, 1000U, 65537U, 1U << 31U, UINT32_MAX})
+    {
+        for (const Method method : {Method::barrett, Method::multiply_shift})
+        {
+            const std::size_t count = 10000 + n % 7;
+            std::vector<uint64_t> hashes(count);
+            for (auto &h : hashes)
+            {
+                h = distr_h(gen);
+            }
+            hashes[0] = 0;
+            hashes[1] = UINT64_MAX;
+
+            const br::Partitioner part(n, method);
+            std::vector<uint32_t> idx(count);
+            part.index(hashes.data(), idx.data(), count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const uint64_t ref = method == Method::barrett
+                                         ? hashes[i] % n
+                                         : static_cast<uint64_t>((static_cast<uint128_t>(hashes[i]) * n) >> 64U);
+                if (idx[i] != ref)
+                {
+                    std::cout << "h=" << hashes[i] << ", n=" << n << ", res=" << idx[i] << ", ref=" << ref << "\n";
+                    throw std::runtime_error("Partitioner index test failed.");
+                }
+            }
+
+            if (n > 100000)
+            {
+                continue;
+            }
+            std::vector<uint64_t> out(count);
+            const std::vector<std::size_t> offsets = part.scatter(hashes.data(), count, out.data());
+            std::vector<uint64_t> counts(n, 0);
+            part.histogram(hashes.data(), count, counts.data());
+            std::vector<std::size_t> pos(offsets.begin(), offsets.end() - 1);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (out[pos[idx[i]]++] != hashes[i])
+                {
+                    std::cout << "i=" << i << ", n=" << n << "\n";
+                    throw std::runtime_error("Partitioner scatter test failed.");
+                }
+            }
+            for (std::size_t p = 0; p < n; ++p)
+            {
+                if (pos[p] != offsets[p + 1] || counts[p] != offsets[p + 1] - offsets[p])
+                {
+                    std::cout << "p=" << p << ", n=" << n << "\n";
+                    throw std::runtime_error("Partitioner histogram test failed.");
+                }
+            }
+        }
+    }
+}
+
+void test_random()
+{
+    using uint128_t = unsigned __int128;
+
+    std::cout << "Testing UniformMod.\n";
+
+    // Reference: 4 scalar xoshiro256++ streams seeded like Xoshiro256x4.
+    const uint64_t seed = test_seed();
+    std::array<uint64_t, 16> sm{};
+    uint64_t z0 = seed;
+    for (auto &v : sm)
+    {
+        z0 += 0x9E3779B97F4A7C15UL;
+        uint64_t z = z0;
+        z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9UL;
+        z = (z ^ (z >> 27U)) * 0x94D049BB133111EBUL;
+        v = z ^ (z >> 31U);
+    }
+    const auto rotl = [](const uint64_t x, const uint32_t k) { return (x << k) | (x >> (64 - k)); };
+    std::vector<uint64_t> ref(4000);
+    for (std::size_t l = 0; l < 4; ++l)
+    {
+        std::array<uint64_t, 4> st = {sm[l], sm[4 + l], sm[8 + l], sm[12 + l]};
+        for (std::size_t g = 0; g < ref.size() / 4; ++g)
+        {
+            ref[g * 4 + l] = rotl(st[0] + st[3], 23) + st[0];
+            const uint64_t t = st[1] << 17U;
+            st[2] ^= st[0];
+            st[3] ^= st[1];
+            st[1] ^= st[2];
+            st[0] ^= st[3];
+            st[2] ^= t;
+            st[3] = rotl(st[3], 45);
+        }
+    }
+    br::Xoshiro256x4 rng(seed);
+    std::vector<uint64_t> words(ref.size());
+    words[0] = rng();
+    rng.fill(words.data() + 1, 1001);
+    rng.fill(words.data() + 1002, ref.size() - 1002);
+    if (words != ref)
+    {
+        throw std::runtime_error("Xoshiro256x4 test failed.");
+    }
+
+    for (const uint64_t n : {1UL, 2UL, 3UL, 6UL, 1000UL, 1UL << 20U, uint64_t{UINT32_MAX}, 1UL << 40U, (1UL << 40U) + 7,
+                             (1UL << 63U) + 1, UINT64_MAX})
+    {
+        const br::UniformMod u(n);
+        const uint64_t t = static_cast<uint64_t>((static_cast<uint128_t>(1) << 64U) % n);
+        if (u.get_threshold() != t)
+        {
+            std::cout << "n=" << n << ", threshold=" << u.get_threshold() << ", ref=" << t << "\n";
+            throw std::runtime_error("UniformMod threshold test failed.");
+        }
+
+        br::Xoshiro256x4 rng1(seed);
+        br::Xoshiro256x4 rng2(seed);
+        std::vector<uint64_t> out(10000);
+        u.generate(rng1, out.data(), out.size());
+        long double sum = 0;
+        for (std::size_t i = 0; i < out.size(); ++i)
+        {
+            if (out[i] >= n)
+            {
+                std::cout << "n=" << n << ", res=" << out[i] << "\n";
+                throw std::runtime_error("UniformMod range test failed.");
+            }
+            // Rejections are negligible below 2^40, so the output is the plain multiply-shift of the stream.
+            if (n <= (1UL << 40U) && out[i] != br::util::mulhi64(rng2(), n))
+            {
+                std::cout << "n=" << n << ", i=" << i << "\n";
+                throw std::runtime_error("UniformMod generate test failed.");
+            }
+            sum += static_cast<long double>(out[i]);
+        }
+        // The mean of 10000 uniform samples is within a few percent of (n - 1) / 2.
+        const long double mean = sum / out.size();
+        const long double expected = static_cast<long double>(n - 1) / 2;
+        if (n > 1 && (mean < expected * 0.9L || mean > expected * 1.1L))
+        {
+            std::cout << "n=" << n << ", mean=" << static_cast<double>(mean) << "\n";
+            throw std::runtime_error("UniformMod mean test failed.");
+        }
+        if (u(rng1) >= n)
+        {
+            throw std::runtime_error("UniformMod range test failed. 2");
+        }
+    }
+}
+
+void test_erasure()
+{
+    using uint128_t = unsigned __int128;
+    using Mode = br::ReedSolomon::Mode;
+
+    std::cout << "Testing PrimeField, NTT and ReedSolomon.\n";
+
+    std::mt19937 gen(test_seed());
+
+    for (const uint64_t p : {2013265921UL, 998244353UL, 1945555039024054273UL, 4179340454199820289UL})
+    {
+        const br::PrimeField f(p);
+        std::uniform_int_distribution<uint64_t> distr(0, p - 1);
+        const auto mulmod = [p](const uint64_t a, const uint64_t b) {
+            return static_cast<uint64_t>(static_cast<uint128_t>(a) * b % p);
+        };
+
+        const std::size_t count = 1001;
+        std::vector<uint64_t> x(count);
+        std::vector<uint64_t> acc(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            x[i] = distr(gen);
+            acc[i] = distr(gen);
+        }
+        x[0] = p - 1;
+        acc[0] = p - 1;
+        const uint64_t w = distr(gen);
+        std::vector<uint64_t> ref(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            ref[i] = (acc[i] + mulmod(x[i], w)) % p;
+        }
+        f.mul_add_const(x.data(), acc.data(), count, w);
+        if (acc != ref)
+        {
+            std::cout << "p=" << p << ", w=" << w << "\n";
+            throw std::runtime_error("PrimeField mul_add_const test failed.");
+        }
+        // Largest operands, at lengths that end in every tail of the 4-lane kernels: (p - 1) + (p - 1)^2 = 0.
+        for (std::size_t len = 0; len < 9; ++len)
+        {
+            std::vector<uint64_t> ones(len, p - 1);
+            std::vector<uint64_t> sums(len, p - 1);
+            f.mul_add_const(ones.data(), sums.data(), len, p - 1);
+            if (std::any_of(sums.begin(), sums.end(), [](const uint64_t v) { return v != 0; }))
+            {
+                std::cout << "p=" << p << ", len=" << len << "\n";
+                throw std::runtime_error("PrimeField mul_add_const test failed. 2");
+            }
+        }
+
+        std::vector<uint64_t> inv(x.begin(), x.begin() + 100);
+        f.batch_inv(inv.data(), inv.size());
+        for (std::size_t i = 0; i < inv.size(); ++i)
+        {
+            if (mulmod(inv[i], x[i]) != 1)
+            {
+                std::cout << "p=" << p << ", x=" << x[i] << ", res=" << inv[i] << "\n";
+                throw std::runtime_error("PrimeField batch_inv test failed.");
+            }
+        }
+
+        // NTT against the naive transform: out[i] = sum_t a[t] * w^(bitrev(i) * t).
+        const br::NTT ntt(p, 64);
+        for (const std::size_t size : {1UL, 2UL, 16UL, 64UL})
+        {
+            std::vector<uint64_t> a(x.begin(), x.begin() + static_cast<std::ptrdiff_t>(size));
+            ntt.forward(a.data(), size);
+            const uint64_t root = ntt.root(size);
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                const uint64_t wi = f.pow(root, br::NTT::bitrev(i, size));
+                uint64_t sum = 0;
+                uint64_t wt = 1;
+                for (std::size_t t = 0; t < size; ++t)
+                {
+                    sum = (sum + mulmod(x[t], wt)) % p;
+                    wt = mulmod(wt, wi);
+                }
+                if (a[i] != sum)
+                {
+                    std::cout << "p=" << p << ", size=" << size << ", i=" << i << "\n";
+                    throw std::runtime_error("NTT forward test failed.");
+                }
+            }
+            ntt.inverse(a.data(), size);
+            if (!std::equal(a.begin(), a.end(), x.begin()))
+            {
+                std::cout << "p=" << p << ", size=" << size << "\n";
+                throw std::runtime_error("NTT inverse test failed.");
+            }
+        }
+        const br::NTT ntt2(p, 2);
+        if (ntt2.root(2) != p - 1 || ntt2.root(1) != 1)
+        {
+            std::cout << "p=" << p << "\n";
+            throw std::runtime_error("NTT root test failed.");
+        }
+    }
+
+    struct Case
+    {
+        uint64_t p;
+        std::size_t k;
+        std::size_t m;
+        Mode mode;
+        bool ntt;
+    };
+    for (const Case &c : {Case{2013265921, 10, 4, Mode::matrix, false}, Case{2013265921, 40, 8, Mode::automatic, false},
+                          Case{1945555039024054273, 20, 12, Mode::ntt, true},
+                          Case{(1UL << 61U) - 1, 6, 3, Mode::automatic, false}, Case{998244353, 1, 1, Mode::matrix, false},
+                          Case{998244353, 5, 8, Mode::ntt, true}, Case{2013265921, 1, 1, Mode::ntt, true},
+                          Case{2013265921, 2, 1, Mode::ntt, true}, Case{1945555039024054273, 2, 2, Mode::ntt, true},
+                          Case{4179340454199820289, 64, 64, Mode::automatic, true}})
+    {
+        const br::ReedSolomon rs(c.p, c.k, c.m, c.mode);
+        if (rs.uses_ntt() != c.ntt)
+        {
+            std::cout << "p=" << c.p << ", k=" << c.k << ", m=" << c.m << "\n";
+            throw std::runtime_error("ReedSolomon mode test failed.");
+        }
+        std::uniform_int_distribution<uint64_t> distr(0, c.p - 1);
+        const std::size_t len = 1500;
+        const std::size_t n = c.k + c.m;
+        std::vector<std::vector<uint64_t>> shards(n, std::vector<uint64_t>(len));
+        std::vector<uint64_t *> ptrs(n);
+        for (std::size_t s = 0; s < n; ++s)
+        {
+            ptrs[s] = shards[s].data();
+            if (s < c.k)
+            {
+                for (auto &v : shards[s])
+                {
+                    v = distr(gen);
+                }
+            }
+        }
+        rs.encode(ptrs.data(), ptrs.data() + c.k, len);
+        const std::vector<std::vector<uint64_t>> orig = shards;
+
+        for (std::size_t trial = 0; trial < 10; ++trial)
+        {
+            // Erase m shards: the first m, then random ones.
+            std::vector<std::size_t> order(n);
+            for (std::size_t s = 0; s < n; ++s)
+            {
+                order[s] = s;
+            }
+            if (trial > 0)
+            {
+                std::shuffle(order.begin(), order.end(), gen);
+            }
+            std::array<bool, 128> present{};
+            std::fill(present.begin(), present.begin() + static_cast<std::ptrdiff_t>(n), true);
+            for (std::size_t e = 0; e < c.m; ++e)
+            {
+                present[order[e]] = false;
+                std::fill(shards[order[e]].begin(), shards[order[e]].end(), 0);
+            }
+            rs.decode(ptrs.data(), present.data(), len);
+            if (shards != orig)
+            {
+                std::cout << "p=" << c.p << ", k=" << c.k << ", m=" << c.m << ", trial=" << trial << "\n";
+                throw std::runtime_error("ReedSolomon decode test failed.");
+            }
+        }
+    }
+}
+
+void test_shamir()
+{
+    using uint128_t = unsigned __int128;
+
+    std::cout << "Testing Shamir.\n";
+
+    std::mt19937 gen(test_seed());
+    br::Xoshiro256x4 rng(test_seed());
+
+    struct Case
+    {
+        uint64_t p;
+        std::size_t threshold;
+        std::size_t shares;
+    };
+    for (const Case &c : {Case{2013265921, 3, 5}, Case{(1UL << 61U) - 1, 3, 5}, Case{4179340454199820289, 10, 20},
+                          Case{998244353, 1, 1}, Case{2013265921, 16, 16}})
+    {
+        const br::Shamir shamir(c.p, c.threshold, c.shares);
+        std::uniform_int_distribution<uint64_t> distr(0, c.p - 1);
+        const std::size_t len = 2500;
+        std::vector<uint64_t> secrets(len);
+        for (auto &s : secrets)
+        {
+            s = distr(gen);
+        }
+        secrets[0] = c.p - 1;
+        std::vector<std::vector<uint64_t>> shares(c.shares, std::vector<uint64_t>(len));
+        std::vector<uint64_t *> out(c.shares);
+        for (std::size_t j = 0; j < c.shares; ++j)
+        {
+            out[j] = shares[j].data();
+        }
+        shamir.split(secrets.data(), out.data(), len, rng);
+
+        // Any threshold shares recover the secrets.
+        std::vector<std::size_t> ids(c.shares);
+        for (std::size_t j = 0; j < c.shares; ++j)
+        {
+            ids[j] = j;
+        }
+        for (std::size_t trial = 0; trial < 5; ++trial)
+        {
+            std::shuffle(ids.begin(), ids.end(), gen);
+            const br::Shamir::Combiner comb(shamir, ids.data());
+            uint64_t sum = 0;
+            for (std::size_t i = 0; i < c.threshold; ++i)
+            {
+                sum = (sum + comb.coefficient(i)) % c.p;
+            }
+            if (sum != 1)
+            {
+                std::cout << "p=" << c.p << ", sum=" << sum << "\n";
+                throw std::runtime_error("Shamir Lagrange coefficient test failed.");
+            }
+
+            std::vector<const uint64_t *> in(c.threshold);
+            for (std::size_t i = 0; i < c.threshold; ++i)
+            {
+                in[i] = shares[ids[i]].data();
+            }
+            std::vector<uint64_t> res(len);
+            comb.combine(in.data(), res.data(), len);
+            if (res != secrets)
+            {
+                std::cout << "p=" << c.p << ", threshold=" << c.threshold << ", shares=" << c.shares << "\n";
+                throw std::runtime_error("Shamir combine test failed.");
+            }
+        }
+
+        // With fixed coefficients, share j is the plain polynomial evaluation.
+        std::vector<std::vector<uint64_t>> coeffs(c.threshold, std::vector<uint64_t>(len));
+        std::vector<const uint64_t *> cptr(c.threshold);
+        for (std::size_t i = 0; i < c.threshold; ++i)
+        {
+            for (auto &v : coeffs[i])
+            {
+                v = distr(gen);
+            }
+            cptr[i] = coeffs[i].data();
+        }
+        shamir.split(secrets.data(), cptr.data(), out.data(), len);
+        for (std::size_t j = 0; j < c.shares; ++j)
+        {
+            for (std::size_t k = 0; k < len; k += 97)
+            {
+                // Horner with f(x) = secret + coeffs[0] x + ... + coeffs[t - 2] x^(t - 1).
+                uint64_t ref = 0;
+                for (std::size_t i = c.threshold - 1; i > 0; --i)
+                {
+                    ref = static_cast<uint64_t>((static_cast<uint128_t>(ref) * (j + 1) + coeffs[i - 1][k]) % c.p);
+                }
+                ref = static_cast<uint64_t>((static_cast<uint128_t>(ref) * (j + 1) + secrets[k]) % c.p);
+                if (shares[j][k] != ref)
+                {
+                    std::cout << "p=" << c.p << ", j=" << j << ", k=" << k << ", res=" << shares[j][k]
+                              << ", ref=" << ref << "\n";
+                    throw std::runtime_error("Shamir split test failed.");
+                }
+            }
+        }
+    }
+}
+
+void test_poly()
+{
+    using uint128_t = unsigned __int128;
+    using Poly = br::PolyRing::Poly;
+
+    std::cout << "Testing PolyRing.\n";
+
+    std::mt19937 gen(test_seed());
+
+    for (const uint64_t p : {998244353UL, 2013265921UL, 4179340454199820289UL})
+    {
+        const br::PolyRing ring(p, 1U << 12U);
+        std::uniform_int_distribution<uint64_t> distr(0, p - 1);
+        const auto mulmod = [p](const uint64_t a, const uint64_t b) {
+            return static_cast<uint64_t>(static_cast<uint128_t>(a) * b % p);
+        };
+        const auto random_poly = [&](const std::size_t len) {
+            Poly a(len);
+            for (auto &v : a)
+            {
+                v = distr(gen);
+            }
+            if (len > 0)
+            {
+                a.back() = std::max<uint64_t>(a.back(), 1);
+            }
+            return a;
+        };
+        const auto naive_mul = [&](const Poly &a, const Poly &b) {
+            Poly c(a.size() + b.size() - 1, 0);
+            for (std::size_t i = 0; i < a.size(); ++i)
+            {
+                for (std::size_t j = 0; j < b.size(); ++j)
+                {
+                    c[i + j] = (c[i + j] + mulmod(a[i], b[j])) % p;
+                }
+            }
+            return c;
+        };
+
+        for (const auto &[la, lb] : {std::pair<std::size_t, std::size_t>{1, 1}, {5, 40}, {33, 33}, {100, 300},
+                                     {1000, 999}})
+        {
+            const Poly a = random_poly(la);
+            Poly b = random_poly(lb);
+            b[0] = std::max<uint64_t>(b[0], 1);
+            if (ring.mul(a, b) != naive_mul(a, b))
+            {
+                std::cout << "p=" << p << ", la=" << la << ", lb=" << lb << "\n";
+                throw std::runtime_error("PolyRing mul test failed.");
+            }
+
+            // b * b^-1 = 1 mod x^n.
+            const std::size_t n = la + 7;
+            Poly bi = ring.mul(b, ring.inv_series(b, n));
+            bi.resize(n);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                if (bi[i] != (i == 0 ? 1 : 0))
+                {
+                    std::cout << "p=" << p << ", lb=" << lb << ", n=" << n << ", i=" << i << "\n";
+                    throw std::runtime_error("PolyRing inv_series test failed.");
+                }
+            }
+
+            // a = q * b + r with deg r < deg b.
+            const Poly big = random_poly(la + lb + 13);
+            const auto [q, r] = ring.divmod(big, b);
+            Poly qb = naive_mul(q, b);
+            for (std::size_t i = 0; i < r.size(); ++i)
+            {
+                qb[i] = (qb[i] + r[i]) % p;
+            }
+            if (qb != big || r.size() != lb - 1)
+            {
+                std::cout << "p=" << p << ", la=" << la << ", lb=" << lb << "\n";
+                throw std::runtime_error("PolyRing divmod test failed.");
+            }
+
+            // One Divisor for dividends of any length up to its limit.
+            const br::PolyRing::Divisor div(ring, b, big.size());
+            for (const std::size_t len : {std::size_t{0}, lb - 1, lb, std::min(lb + 40, big.size()), big.size()})
+            {
+                const Poly part(big.begin(), big.begin() + static_cast<std::ptrdiff_t>(len));
+                if (div.divmod(part) != ring.divmod(part, b) || div.rem(part) != ring.rem(part, b))
+                {
+                    std::cout << "p=" << p << ", lb=" << lb << ", len=" << len << "\n";
+                    throw std::runtime_error("PolyRing Divisor test failed.");
+                }
+            }
+        }
+
+        for (const std::size_t count : {1UL, 3UL, 17UL, 64UL, 65UL, 300UL, 1000UL, 1500UL})
+        {
+            const Poly a = random_poly(count);
+            Poly xs(count);
+            for (std::size_t j = 0; j < count; ++j)
+            {
+                xs[j] = (j * 7919 + 3) % p;
+            }
+            Poly ys(count);
+            Poly ys_tree(count);
+            ring.eval(a, xs.data(), ys.data(), count);
+            ring.eval_tree(a, xs.data(), ys_tree.data(), count);
+            for (std::size_t j = 0; j < count; ++j)
+            {
+                uint64_t ref = 0;
+                for (std::size_t i = count; i-- > 0;)
+                {
+                    ref = (mulmod(ref, xs[j]) + a[i]) % p;
+                }
+                if (ys[j] != ref || ys_tree[j] != ref)
+                {
+                    std::cout << "p=" << p << ", count=" << count << ", j=" << j << ", res=" << ys[j]
+                              << ", res_tree=" << ys_tree[j] << ", ref=" << ref << "\n";
+                    throw std::runtime_error("PolyRing eval test failed.");
+                }
+            }
+            if (ring.interpolate(xs.data(), ys.data(), count) != a)
+            {
+                std::cout << "p=" << p << ", count=" << count << "\n";
+                throw std::runtime_error("PolyRing interpolate test failed.");
+            }
+        }
+    }
+}
+
+void test_recurrence()
+{
+    using uint128_t = unsigned __int128;
+    using Poly = br::PolyMulMod::Poly;
+    using Method = br::PolyMulMod::Method;
+
+    std::cout << "Testing PolyMulMod and LinearRecurrence.\n";
+
+    std::mt19937 gen(test_seed());
+
+    for (const uint64_t n : {3UL, 1000000UL, 1000000007UL, (1UL << 63U) + 1, UINT64_MAX - 58, UINT64_MAX})
+    {
+        std::uniform_int_distribution<uint64_t> distr(0, n - 1);
+        const auto random_poly = [&](const std::size_t len) {
+            Poly a(len);
+            for (auto &v : a)
+            {
+                v = distr(gen);
+            }
+            return a;
+        };
+
+        const br::PolyMulMod pm(n, 2048);
+        for (const auto &[la, lb] : {std::pair<std::size_t, std::size_t>{1, 1}, {7, 3}, {33, 32}, {300, 400},
+                                     {100, 700}, {1000, 1000}, {1001, 997}})
+        {
+            Poly a = random_poly(la);
+            Poly b = random_poly(lb);
+            a[0] = n - 1;
+            b[0] = n - 1;
+            Poly ref(la + lb - 1, 0);
+            for (std::size_t i = 0; i < la; ++i)
+            {
+                for (std::size_t j = 0; j < lb; ++j)
+                {
+                    const uint64_t prod = static_cast<uint64_t>(static_cast<uint128_t>(a[i]) * b[j] % n);
+                    ref[i + j] = static_cast<uint64_t>((static_cast<uint128_t>(ref[i + j]) + prod) % n);
+                }
+            }
+            for (const Method method : {Method::schoolbook, Method::karatsuba, Method::ntt, Method::automatic})
+            {
+                if (pm.mul(a, b, method) != ref)
+                {
+                    std::cout << "n=" << n << ", la=" << la << ", lb=" << lb << ", method=" << static_cast<int>(method)
+                              << "\n";
+                    throw std::runtime_error("PolyMulMod test failed.");
+                }
+            }
+        }
+
+        // d = 520 squares with Karatsuba / Toom-3, d = 2100 with the NTT (from PolyMulMod::ntt_threshold).
+        for (const std::size_t d : {1UL, 2UL, 5UL, 40UL, 520UL, 2100UL})
+        {
+            const Poly c = random_poly(d);
+            const Poly init = random_poly(d);
+            const br::LinearRecurrence rec(n, c, init);
+            // Iterate the recurrence directly.
+            Poly seq = init;
+            for (std::size_t i = d; i < d + 700; ++i)
+            {
+                uint128_t acc = 0;
+                for (std::size_t j = 1; j <= d; ++j)
+                {
+                    acc = (acc + static_cast<uint128_t>(c[j - 1]) * seq[i - j]) % n;
+                }
+                seq.push_back(static_cast<uint64_t>(acc));
+            }
+            const std::size_t step = d < br::PolyMulMod::ntt_threshold ? 37 : 233;
+            for (std::size_t N = 0; N < seq.size(); N += (N < d + 2 ? 1 : step))
+            {
+                if (rec.term(N) != seq[N])
+                {
+                    std::cout << "n=" << n << ", d=" << d << ", N=" << N << ", res=" << rec.term(N)
+                              << ", ref=" << seq[N] << "\n";
+                    throw std::runtime_error("LinearRecurrence test failed.");
+                }
+            }
+
+            // Huge N against the companion matrix power.
+            if (d <= 5)
+            {
+                const br::MatrixMod mm(n, d);
+                br::MatrixMod::Matrix m(d * d, 0);
+                for (std::size_t j = 0; j < d; ++j)
+                {
+                    m[j] = c[j];
+                }
+                for (std::size_t i = 1; i < d; ++i)
+                {
+                    m[i * d + i - 1] = 1;
+                }
+                // (a_(N+d-1), ..., a_N) = M^N (a_(d-1), ..., a_0).
+                const uint64_t N = 1000000000000000003UL;
+                const Poly v(init.rbegin(), init.rend());
+                const Poly res = mm.apply(mm.pow(m, N), v);
+                if (rec.term(N) != res[d - 1])
+                {
+                    std::cout << "n=" << n << ", d=" << d << ", res=" << rec.term(N) << ", ref=" << res[d - 1]
+                              << "\n";
+                    throw std::runtime_error("LinearRecurrence matrix test failed.");
+                }
+            }
+        }
+    }
+}
+
+void test_nttcache()
+{
+    std::cout << "Testing NTTCache.\n";
+
+    const std::filesystem::path dir =
+        std::filesystem::temp_directory_path() / ("br-test-nttcache-" + std::to_string(std::random_device()()));
+    std::filesystem::create_directories(dir);
+    const br::NTTCache cache(dir.string());
+
+    constexpr uint64_t p = 4179340454199820289UL;
+    constexpr std::size_t size = 1U << 12U;
+    const br::NTT ref(p, size);
+    std::mt19937_64 gen(12345);
+    std::vector<uint64_t> data(size);
+    for (auto &v : data)
+    {
+        v = gen() % p;
+    }
+    const auto check = [&](const br::NTT &ntt, const char *what) {
+        std::vector<uint64_t> a = data;
+        std::vector<uint64_t> b = data;
+        ntt.forward(a.data(), size);
+        ref.forward(b.data(), size);
+        if (a != b || ntt.root(size) != ref.root(size))
+        {
+            std::cout << "case=" << what << "\n";
+            throw std::runtime_error("NTTCache test failed.");
+        }
+    };
+
+    const std::string file = cache.path(p, size);
+    check(cache.load(p, size), "miss");
+    const auto bytes = std::filesystem::file_size(file);
+    check(cache.load(p, size), "hit");
+
+    // A damaged root and a truncated file are both rebuilt.
+    {
+        std::fstream f(file, std::ios::in | std::ios::out | std::ios::binary);
+        const uint64_t bad = 2;
+        f.seekp(9 * sizeof(uint64_t));
+        f.write(reinterpret_cast<const char *>(&bad), sizeof(bad));
+    }
+    check(cache.load(p, size), "damaged");
+    std::filesystem::resize_file(file, bytes / 2);
+    check(cache.load(p, size), "truncated");
+    if (std::filesystem::file_size(file) != bytes)
+    {
+        std::cout << "size=" << std::filesystem::file_size(file) << " expected=" << bytes << "\n";
+        throw std::runtime_error("NTTCache rewrite test failed.");
+    }
+
+    // The smallest sizes, whose root blocks are too short for the usual checks.
+    for (const std::size_t small : {2UL, 4UL})
+    {
+        const br::NTT built(p, small);
+        try
+        {
+            const br::NTT shared(p, small, std::shared_ptr<const uint64_t>(built.tables(), [](const uint64_t *) {}));
+        }
+        catch (const std::invalid_argument &)
+        {
+            std::cout << "size=" << small << "\n";
+            throw std::runtime_error("NTTCache small size test failed.");
+        }
+    }
+
+    // Threads that miss the same key at once each write a file of their own, and one complete file is left.
+    constexpr std::size_t size2 = 1U << 14U;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([&] { (void)cache.load(p, size2); });
+    }
+    for (std::thread &th : threads)
+    {
+        th.join();
+    }
+    const br::NTT ref2(p, size2);
+    const std::size_t words = br::NTT::table_words(size2);
+    std::vector<uint64_t> saved(8 + words);
+    std::ifstream in(cache.path(p, size2), std::ios::binary);
+    in.read(reinterpret_cast<char *>(saved.data()), static_cast<std::streamsize>(saved.size() * sizeof(uint64_t)));
+    if (!in || !std::equal(saved.begin() + 8, saved.end(), ref2.tables()))
+    {
+        throw std::runtime_error("NTTCache concurrent save test failed.");
+    }
+    for (const auto &entry : std::filesystem::directory_iterator(dir))
+    {
+        if (entry.path().string().find(".tmp") != std::string::npos)
+        {
+            std::cout << "file=" << entry.path() << "\n";
+            throw std::runtime_error("NTTCache concurrent save test failed. 2");
+        }
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+void test_buffer()
+{
+    std::cout << "Testing Buffer and Arena.\n";
+
+    const auto aligned = [](const void *p) { return reinterpret_cast<uintptr_t>(p) % 64 == 0; };
+    for (const br::Pages pages : {br::Pages::normal, br::Pages::transparent, br::Pages::huge})
+    {
+        for (const std::size_t count : {0UL, 1UL, 1000UL, 3000000UL})
+        {
+            br::Buffer<uint32_t> buf(count, pages);
+            // Huge pages may be refused, and transparent ones disabled: only smaller pages than asked for are allowed.
+            if (buf.size() != count || !aligned(buf.data()) || buf.get_pages() > pages)
+            {
+                std::cout << "count=" << count << ", pages=" << static_cast<int>(pages) << "\n";
+                throw std::runtime_error("Buffer test failed.");
+            }
+            if (std::any_of(buf.begin(), buf.end(), [](const uint32_t v) { return v != 0; }))
+            {
+                throw std::runtime_error("Buffer test failed. 2");
+            }
+            // The batch functions work on the buffer in place.
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                buf[i] = static_cast<uint32_t>(i * 2654435761U) % (1000U * 1000U);
+            }
+            const br::BarrettRed32 br(1000);
+            const br::Span<const uint32_t> in = buf.span();
+            br::Buffer<uint32_t> out(count, pages);
+            br.calc(in.data(), out.data(), in.size());
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (out[i] != buf[i] % 1000)
+                {
+                    throw std::runtime_error("Buffer test failed. 3");
+                }
+            }
+            const br::Buffer<uint32_t> moved = std::move(out);
+            if (moved.size() != count || !out.empty() || out.data() != nullptr)
+            {
+                throw std::runtime_error("Buffer test failed. 4");
+            }
+        }
+    }
+
+    // Nested scopes: live spans are aligned and disjoint, and a warm arena does not grow.
+    br::Arena arena;
+    std::size_t warm = 0;
+    for (int round = 0; round < 3; ++round)
+    {
+        const br::Arena::Scope outer(arena);
+        std::vector<br::Span<uint64_t>> spans;
+        for (std::size_t i = 0; i < 20; ++i)
+        {
+            spans.push_back(arena.allocate<uint64_t>(1000 * i * i + 1));
+            {
+                const br::Arena::Scope inner(arena);
+                const br::Span<uint8_t> t = arena.allocate<uint8_t>(100000 + i);
+                std::fill(t.begin(), t.end(), 0xFF);
+            }
+            std::fill(spans.back().begin(), spans.back().end(), i);
+        }
+        for (std::size_t i = 0; i < spans.size(); ++i)
+        {
+            if (!aligned(spans[i].data()) || spans[i].size() != 1000 * i * i + 1 ||
+                std::any_of(spans[i].begin(), spans[i].end(), [i](const uint64_t v) { return v != i; }))
+            {
+                std::cout << "round=" << round << ", i=" << i << "\n";
+                throw std::runtime_error("Arena test failed.");
+            }
+        }
+        if (round == 1)
+        {
+            warm = arena.capacity();
+        }
+        if (round == 2 && arena.capacity() != warm)
+        {
+            std::cout << "capacity=" << arena.capacity() << ", warm=" << warm << "\n";
+            throw std::runtime_error("Arena test failed. 2");
+        }
+    }
+    if (!arena.allocate<uint64_t>(0).empty())
+    {
+        throw std::runtime_error("Arena test failed. 3");
+    }
+}
+
+void test_divider64()
+{
+    using uint128_t = unsigned __int128;
+
+    std::cout << "Testing Divider64.\n";
+
+    std::mt19937_64 gen(test_seed());
+
+    for (const uint64_t d : {1UL, 3UL, 10UL, 1000000007UL, (1UL << 63U) - 1, 1UL << 63U, 10000000000000000000UL,
+                             UINT64_MAX - 58, UINT64_MAX, gen() | 1U, gen() >> 17U})
+    {
+        const br::Divider64 div(d);
+        for (std::size_t i = 0; i < 100000; ++i)
+        {
+            uint64_t hi = gen() % d;
+            uint64_t lo = gen();
+            if (i < 4)
+            {
+                hi = (i & 1U) != 0 ? d - 1 : 0;
+                lo = (i & 2U) != 0 ? UINT64_MAX : 0;
+            }
+            uint64_t rem = 0;
+            const uint64_t q = div.divrem(hi, lo, rem);
+            const uint128_t x = (static_cast<uint128_t>(hi) << 64U) | lo;
+            if (q != static_cast<uint64_t>(x / d) || rem != static_cast<uint64_t>(x % d))
+            {
+                std::cout << "d=" << d << ", hi=" << hi << ", lo=" << lo << ", q=" << q << ", rem=" << rem << "\n";
+                throw std::runtime_error("Divider64 test failed.");
+            }
+        }
+    }
+}
+
+void test_decimal()
+{
+    using uint128_t = unsigned __int128;
+
+    std::cout << "Testing DecimalParser and DecimalFormatter.\n";
+
+    std::mt19937 gen(test_seed());
+    std::uniform_int_distribution<int> digit(0, 9);
+
+    const std::vector<uint64_t> moduli = {3, 998244353, 1000000007, (1UL << 61U) - 1, 10000000000000000001UL,
+                                          UINT64_MAX - 58, UINT64_MAX};
+    const br::DecimalParser parser(moduli);
+    for (const std::size_t len : {0UL, 1UL, 3UL, 18UL, 19UL, 20UL, 37UL, 38UL, 39UL, 57UL, 58UL, 1000UL, 4321UL})
+    {
+        std::string s(len, '0');
+        for (auto &c : s)
+        {
+            c = static_cast<char>('0' + digit(gen));
+        }
+        if (len == 57)
+        {
+            s.assign(len, '9');
+        }
+        const std::vector<uint64_t> res = parser.parse(s);
+        for (std::size_t i = 0; i < moduli.size(); ++i)
+        {
+            uint64_t ref = 0;
+            for (const char c : s)
+            {
+                ref = static_cast<uint64_t>((static_cast<uint128_t>(ref) * 10 + static_cast<uint64_t>(c - '0')) %
+                                            moduli[i]);
+            }
+            if (res[i] != ref)
+            {
+                std::cout << "len=" << len << ", n=" << moduli[i] << ", res=" << res[i] << ", ref=" << ref << "\n";
+                throw std::runtime_error("DecimalParser test failed.");
+            }
+        }
+
+        // Any non-digit is rejected, wherever it is.
+        for (const char bad : {'/', ':', ' ', '\0', '\xb0'})
+        {
+            for (std::size_t pos = 0; pos < len; pos += 1 + pos / 3)
+            {
+                std::string t = s;
+                t[pos] = bad;
+                bool thrown = false;
+                try
+                {
+                    std::cout.setstate(std::ios::failbit);
+                    static_cast<void>(parser.parse(t));
+                }
+                catch (const std::invalid_argument &)
+                {
+                    thrown = true;
+                }
+                std::cout.clear();
+                if (!thrown)
+                {
+                    std::cout << "len=" << len << ", pos=" << pos << ", char=" << static_cast<int>(bad) << "\n";
+                    throw std::runtime_error("DecimalParser digit check test failed.");
+                }
+            }
+        }
+    }
+
+    // Base 10 by schoolbook division of the limbs by 10.
+    const auto naive_format = [](std::vector<uint64_t> x) {
+        std::string rev;
+        while (!x.empty())
+        {
+            uint64_t r = 0;
+            for (std::size_t i = x.size(); i-- > 0;)
+            {
+                const uint128_t cur = (static_cast<uint128_t>(r) << 64U) | x[i];
+                x[i] = static_cast<uint64_t>(cur / 10);
+                r = static_cast<uint64_t>(cur % 10);
+            }
+            rev.push_back(static_cast<char>('0' + r));
+            while (!x.empty() && x.back() == 0)
+            {
+                x.pop_back();
+            }
+        }
+        return rev.empty() ? std::string("0") : std::string(rev.rbegin(), rev.rend());
+    };
+
+    std::mt19937_64 gen64(test_seed());
+    const br::DecimalFormatter formatter(600);
+    for (const std::size_t limbs : {0UL, 1UL, 2UL, 3UL, 24UL, 25UL, 49UL, 50UL, 51UL, 257UL, 600UL})
+    {
+        for (const uint64_t fill : {0UL, 1UL, UINT64_MAX})
+        {
+            std::vector<uint64_t> x(limbs, fill);
+            if (fill == 1)
+            {
+                for (auto &v : x)
+                {
+                    v = gen64();
+                }
+            }
+            const std::string res = formatter.format(x);
+            const std::string ref = naive_format(x);
+            if (res != ref || parser.parse(res) != parser.parse(ref))
+            {
+                std::cout << "limbs=" << limbs << ", fill=" << fill << ", res=" << res.substr(0, 40)
+                          << "..., ref=" << ref.substr(0, 40) << "...\n";
+                throw std::runtime_error("DecimalFormatter test failed.");
+            }
+        }
+    }
+
+    // Numbers long enough for the Barrett division, whose powers start at 10^(19 * 512), about 505 limbs.
+    const br::DecimalFormatter big(2100);
+    for (const std::size_t limbs : {300UL, 1000UL, 2100UL})
+    {
+        std::vector<uint64_t> x(limbs);
+        for (auto &v : x)
+        {
+            v = gen64();
+        }
+        if (big.format(x) != naive_format(x))
+        {
+            std::cout << "limbs=" << limbs << "\n";
+            throw std::runtime_error("DecimalFormatter test failed. 2");
+        }
+    }
+
+    // 10^(19 m) - 1 and 10^(19 m), on both sides of the split powers.
+    std::vector<uint64_t> power = {1};
+    for (std::size_t m = 1; m <= 1025; ++m)
+    {
+        uint64_t carry = 0;
+        for (auto &v : power)
+        {
+            const uint128_t t = static_cast<uint128_t>(v) * 10000000000000000000UL + carry;
+            v = static_cast<uint64_t>(t);
+            carry = static_cast<uint64_t>(t >> 64U);
+        }
+        if (carry != 0)
+        {
+            power.push_back(carry);
+        }
+        std::vector<uint64_t> below = power;
+        for (auto &v : below)
+        {
+            if (v-- != 0)
+            {
+                break;
+            }
+        }
+        // Beyond 160, only next to the split powers 10^(19 * 256 j); those of about 1000 limbs are split by the
+        // first Barrett division.
+        if (m > 160 && (m + 1) % 256 > 2)
+        {
+            continue;
+        }
+        const std::string ones = "1" + std::string(19 * m, '0');
+        const std::string nines(19 * m, '9');
+        if (big.format(power) != ones || big.format(below) != nines ||
+            (power.size() <= 600 && (formatter.format(power) != ones || formatter.format(below) != nines)))
+        {
+            std::cout << "m=" << m << "\n";
+            throw std::runtime_error("DecimalFormatter power test failed.");
+        }
+    }
+}
+
+struct Suite
+{
+    const char *name;
+    void (*run)();
+    std::size_t shards; // tasks the suite is split into, independent of the number of threads
+    bool exclusive;     // runs alone, after the others: it checks process-wide state
+};
+
+const std::vector<Suite> suites = {
+    {"longdiv64", test_longdiv64, 8, false},
+#ifdef __SIZEOF_INT128__
+    {"longdiv128", test_longdiv128, 8, false},
+    {"longdiv128_1s", test_longdiv128_1s, 8, false},
+#endif
+    {"br32", test_br32, 8, false},
+    {"br32_batch", test_br32_batch, 1, false},
+    {"plantard32", test_plantard32, 1, false},
+    {"br64", test_br64, 8, false},
+    {"br128", test_br128, 8, false},
+    {"jit", test_jit, 1, false},
+    {"counters", test_counters, 1, true},
+    {"tune", test_tune, 1, false},
+    {"modint", test_modint, 1, false},
+    {"rollhash", test_rollhash, 1, false},
+    {"polyhash", test_polyhash, 1, false},
+    {"checksum", test_checksum, 1, false},
+    {"partition", test_partition, 1, false},
+    {"random", test_random, 1, false},
+    {"erasure", test_erasure, 1, false},
+    {"shamir", test_shamir, 1, false},
+    {"poly", test_poly, 1, false},
+    {"recurrence", test_recurrence, 1, false},
+    {"nttcache", test_nttcache, 1, false},
+    {"buffer", test_buffer, 1, false},
+    {"divider64", test_divider64, 1, false},
+    {"decimal", test_decimal, 1, false},
+};
+
+// Sends what each thread writes to std::cout to a buffer of its own, so the output of a task can be shown in
+// one piece, and only when it fails.
+class CaptureBuf : public std::streambuf
+{
+  public:
+    static auto text() -> std::string &
+    {
+        static thread_local std::string t;
+        return t;
+    }
+
+  protected:
+    auto overflow(const int_type c) -> int_type override
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            text() += traits_type::to_char_type(c);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    auto xsputn(const char *s, const std::streamsize count) -> std::streamsize override
+    {
+        text().append(s, static_cast<std::size_t>(count));
+        return count;
+    }
+};
+
+struct Task
+{
+    const Suite *suite;
+    std::size_t shard;
+};
+
+auto task_seed(const uint64_t seed, const Task &task) -> uint64_t
+{
+    // FNV-1a of the suite name, then SplitMix64 of the combination.
+    uint64_t z = 0xCBF29CE484222325UL;
+    for (const char *c = task.suite->name; *c != 0; ++c)
+    {
+        z = (z ^ static_cast<uint8_t>(*c)) * 0x100000001B3UL;
+    }
+    z ^= seed + 0x9E3779B97F4A7C15UL * (task.shard + 1);
+    z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27U)) * 0x94D049BB133111EBUL;
+    return z ^ (z >> 31U);
+}
+
+// Runs 'task' in the calling thread. Returns the error message, empty on success, and the output in 'output'.
+auto run_task(const uint64_t seed, const Task &task, std::string &output) -> std::string
+{
+    shard = Shard{task.shard, task.suite->shards};
+    seeds.seed(task_seed(seed, task));
+    CaptureBuf::text().clear();
+    std::string error;
+    try
+    {
+        task.suite->run();
+    }
+    catch (const std::exception &e)
+    {
+        error = e.what();
+        if (error.empty())
+        {
+            error = "exception";
+        }
+    }
+    output = std::move(CaptureBuf::text());
+    return error;
+}
+
+auto parse_u64(const std::string &s, uint64_t &v) -> bool
+{
+    try
+    {
+        std::size_t len = 0;
+        v = std::stoull(s, &len, 0);
+        return len == s.size();
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
+
+void usage()
+{
+    std::cout << "Usage: br-test [--seed S] [--threads T] [--list] [SUITE[/SHARD]...]\n"
+              << "Runs the given suites, or all; a suite's shards run in parallel. Without --seed, a random seed is\n"
+              << "used and printed. A failure is replayed with the printed command.\n";
+}
+
+auto main(int argc, char **argv) -> int
+{
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    uint64_t seed = (static_cast<uint64_t>(std::random_device()()) << 32U) | std::random_device()();
+    uint64_t threads = std::max(1U, std::thread::hardware_concurrency());
+    std::vector<Task> tasks;
+    for (std::size_t i = 0; i < args.size(); ++i)
+    {
+        if (args[i] == "--list")
+        {
+            for (const Suite &suite : suites)
+            {
+                std::cout << suite.name << " (" << suite.shards << (suite.shards == 1 ? " shard)\n" : " shards)\n");
+            }
+            return 0;
+        }
+        uint64_t v = 0;
+        if (args[i] == "--seed" || args[i] == "--threads")
+        {
+            if (i + 1 == args.size() || !parse_u64(args[i + 1], v))
+            {
+                usage();
+                return 2;
+            }
+            (args[i] == "--seed" ? seed : threads) = v;
+            ++i;
+            continue;
+        }
+        const std::size_t slash = args[i].find('/');
+        const std::string name = args[i].substr(0, slash);
+        const auto it = std::find_if(suites.begin(), suites.end(), [&](const Suite &s) { return s.name == name; });
+        if (it == suites.end() || (slash != std::string::npos && (!parse_u64(args[i].substr(slash + 1), v) ||
+                                                                  v >= it->shards)))
+        {
+            std::cout << "Unknown suite: " << args[i] << "\n";
+            usage();
+            return 2;
+        }
+        for (std::size_t k = 0; k < it->shards; ++k)
+        {
+            if (slash == std::string::npos || k == v)
+            {
+                tasks.push_back(Task{&*it, k});
+            }
+        }
+    }
+    if (tasks.empty())
+    {
+        for (const Suite &suite : suites)
+        {
+            for (std::size_t k = 0; k < suite.shards; ++k)
+            {
+                tasks.push_back(Task{&suite, k});
+            }
+        }
+    }
+    threads = std::max<uint64_t>(threads, 1);
+    std::cout << "Seed " << seed << ", " << tasks.size() << " tasks, " << threads << " threads.\n";
+
+    // Tasks write to the capture buffer; results are reported on the real stream.
+    CaptureBuf capture;
+    std::ostream console(std::cout.rdbuf(&capture));
+    std::mutex report_mutex;
+    std::size_t failed = 0;
+    const auto report = [&](const Task &task, const std::string &error, const std::string &output, double secs) {
+        const std::lock_guard<std::mutex> lock(report_mutex);
+        console << (error.empty() ? "ok     " : "FAILED ") << task.suite->name << "/" << task.shard << " ("
+                << std::fixed << std::setprecision(2) << secs << " s)\n";
+        if (!error.empty())
+        {
+            ++failed;
+            console << output << "Error: " << error << "\n"
+                    << "Replay: br-test --seed " << seed << " " << task.suite->name << "/" << task.shard << "\n";
+        }
+        console.flush();
+    };
+    const auto run = [&](const Task &task) {
+        const auto start = std::chrono::steady_clock::now();
+        std::string output;
+        const std::string error = run_task(seed, task, output);
+        const std::chrono::duration<double> secs = std::chrono::steady_clock::now() - start;
+        report(task, error, output, secs.count());
+    };
+
+    std::vector<Task> shared;
+    std::vector<Task> exclusive;
+    for (const Task &task : tasks)
+    {
+        (task.suite->exclusive ? exclusive : shared).push_back(task);
+    }
+    std::atomic<std::size_t> next{0};
+    std::vector<std::thread> pool;
+    for (uint64_t t = 0; t < std::min<uint64_t>(threads, shared.size()); ++t)
+    {
+        pool.emplace_back([&] {
+            for (std::size_t i = next++; i < shared.size(); i = next++)
+            {
+                run(shared[i]);
+            }
+        });
+    }
+    for (std::thread &th : pool)
+    {
+        th.join();
+    }
+    for (const Task &task : exclusive)
+    {
+        run(task);
+    }
+
+    std::cout.rdbuf(console.rdbuf());
+    std::cout << (failed == 0 ? "All " : "") << tasks.size() - failed << " of " << tasks.size() << " tasks passed.\n";
+    return failed == 0 ? 0 : 1;
 }
@@ -0,0 +1,36 @@
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "libbr/tune.hpp"
+
+// Tunes the batch reductions for this machine and writes the profile to the path given as the argument,
+// or to br::TuningProfile::default_path().
+auto main(int argc, char **argv) -> int
+{
+    const std::string path = argc > 1 ? argv[1] : br::TuningProfile::default_path();
+    const br::TuningProfile profile = br::TuningProfile::tune();
+
+    std::cout << "bits  br32      br64\n";
+    for (unsigned bits = 2; bits <= br::TuningProfile::max_bits64; ++bits)
+    {
+        const uint64_t n = (1UL << (bits - 1)) | 1U; // any modulus of this bit length
+        const char *k32 =
+            bits <= br::TuningProfile::max_bits32 ? br::kernel_name(profile.kernel32(static_cast<uint32_t>(n))) : "-";
+        std::cout << std::setw(4) << bits << "  " << std::left << std::setw(10) << k32
+                  << br::kernel_name(profile.kernel64(n)) << std::right << "\n";
+    }
+
+    if (path.empty())
+    {
+        std::cout << "No profile path: set BR_TUNE_PROFILE or HOME, or pass a path.\n";
+        return 1;
+    }
+    if (!profile.save(path))
+    {
+        std::cout << "Cannot write " << path << "\n";
+        return 1;
+    }
+    std::cout << "Profile written to " << path << "\n";
+    return 0;
+}
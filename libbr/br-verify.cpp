@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "libbr/br.hpp"
+
+// Exhaustive check of BarrettRed32 and Plantard32 against '%', in parallel.
+//
+// Every kernel reduces the inputs of a modulus in chunks whose length is not a multiple of 8, so both the
+// vector loop and the scalar tail of the AVX2 kernels run:
+// - BarrettRed32::calc(x) and the batch BarrettRed32::calc() (AVX2 when the CPU has it),
+// - for odd n < 2^31, Plantard32::calc(x) and the batch Plantard32::calc() (AVX2 when the CPU has it).
+// The inputs are consecutive, so the expected remainders are counted rather than divided.
+
+namespace
+{
+
+constexpr uint64_t block_size = 1UL << 20U; // inputs per work item
+constexpr std::size_t chunk_size = 4101;    // inputs per batch call: 512 vectors of 8 and a tail of 5
+
+// The inputs of one modulus that are checked: [lo, hi) ranges.
+struct Modulus
+{
+    uint32_t n{0};
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+};
+
+// All inputs BarrettRed32 accepts, x < n^2, or only the 'limit' lowest and 'limit' highest of them.
+auto make_modulus(const uint32_t n, const uint64_t limit) -> Modulus
+{
+    const uint64_t end = std::min(static_cast<uint64_t>(n) * n, 1UL << 32U);
+    Modulus m;
+    m.n = n;
+    if (end <= 2 * limit)
+    {
+        m.ranges.emplace_back(0, end);
+    }
+    else
+    {
+        m.ranges.emplace_back(0, limit);
+        m.ranges.emplace_back(end - limit, end);
+    }
+    return m;
+}
+
+// A range of inputs of one modulus.
+struct Job
+{
+    std::size_t modulus{0};
+    uint64_t begin{0};
+    uint64_t end{0};
+};
+
+// Hands out the inputs in blocks of block_size, modulus by modulus.
+class Cursor
+{
+  public:
+    explicit Cursor(const std::vector<Modulus> &_moduli) : moduli(_moduli)
+    {
+    }
+
+    auto next(Job &job) -> bool
+    {
+        const std::lock_guard<std::mutex> lock(m);
+        while (mi < moduli.size())
+        {
+            const auto &ranges = moduli[mi].ranges;
+            if (ri == ranges.size())
+            {
+                ++mi;
+                ri = 0;
+                x = 0;
+                continue;
+            }
+            x = std::max(x, ranges[ri].first);
+            if (x == ranges[ri].second)
+            {
+                ++ri;
+                continue;
+            }
+            job.modulus = mi;
+            job.begin = x;
+            job.end = std::min(x + block_size, ranges[ri].second);
+            x = job.end;
+            return true;
+        }
+        return false;
+    }
+
+  private:
+    const std::vector<Modulus> &moduli;
+    std::mutex m;
+    std::size_t mi{0};
+    std::size_t ri{0};
+    uint64_t x{0};
+};
+
+struct Shared
+{
+    std::atomic<uint64_t> checked{0};
+    std::atomic<bool> failed{false};
+    std::mutex out;
+};
+
+// Compares 'got' with the remainders of the consecutive inputs from 'x0', the first of which is 'r0'.
+auto check(Shared &shared, const char *kernel, const uint32_t n, const uint64_t x0, const uint32_t r0,
+           const uint32_t *got, const std::size_t count) -> bool
+{
+    uint32_t r = r0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (got[i] != r)
+        {
+            const std::lock_guard<std::mutex> lock(shared.out);
+            std::cout << "FAILED " << kernel << ": n=" << n << ", x=" << x0 + i << ", got " << got[i]
+                      << ", expected " << r << "\n";
+            shared.failed = true;
+            return false;
+        }
+        r = r + 1 == n ? 0 : r + 1;
+    }
+    return true;
+}
+
+void verify_job(Shared &shared, const Job &job, const uint32_t n)
+{
+    const br::BarrettRed32 br32(n);
+    std::unique_ptr<const br::Plantard32> pl;
+    if ((n & 1U) != 0 && n < (1U << 31U))
+    {
+        pl = std::make_unique<const br::Plantard32>(n);
+    }
+
+    std::vector<uint32_t> x(chunk_size);
+    std::vector<uint32_t> out(chunk_size);
+    for (uint64_t begin = job.begin; begin < job.end && !shared.failed; begin += chunk_size)
+    {
+        const std::size_t count = std::min<uint64_t>(chunk_size, job.end - begin);
+        const auto r0 = static_cast<uint32_t>(begin % n);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            x[i] = static_cast<uint32_t>(begin + i);
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[i] = br32.calc(x[i]);
+        }
+        bool ok = check(shared, "BarrettRed32::calc(x)", n, begin, r0, out.data(), count);
+        br32.calc(x.data(), out.data(), count);
+        ok = ok && check(shared, "BarrettRed32::calc batch", n, begin, r0, out.data(), count);
+        if (pl)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                out[i] = pl->calc(x[i]);
+            }
+            ok = ok && check(shared, "Plantard32::calc(x)", n, begin, r0, out.data(), count);
+            pl->calc(x.data(), out.data(), count);
+            ok = ok && check(shared, "Plantard32::calc batch", n, begin, r0, out.data(), count);
+        }
+        if (!ok)
+        {
+            return;
+        }
+    }
+    shared.checked += job.end - job.begin;
+}
+
+auto parse(const std::string &s, uint64_t &v) -> bool
+{
+    try
+    {
+        std::size_t len = 0;
+        v = std::stoull(s, &len, 0);
+        return len == s.size();
+    }
+    catch (const std::exception &)
+    {
+        return false;
+    }
+}
+
+void usage()
+{
+    std::cout << "Usage: br-verify [--threads T] [--inputs X] N...\n"
+              << "       br-verify [--threads T] [--inputs X] --bits B\n"
+              << "Checks every input x < min(n^2, 2^32) for the moduli N, or for every modulus of up to B bits\n"
+              << "(B <= 32). --inputs X only checks the X lowest and the X highest inputs of each modulus.\n";
+}
+
+} // namespace
+
+auto main(int argc, char **argv) -> int
+{
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    uint64_t threads = std::max(1U, std::thread::hardware_concurrency());
+    uint64_t limit = 1UL << 32U;
+    uint64_t bits = 0;
+    std::vector<uint32_t> ns;
+    for (std::size_t i = 0; i < args.size(); ++i)
+    {
+        uint64_t v = 0;
+        const bool option = args[i] == "--threads" || args[i] == "--inputs" || args[i] == "--bits";
+        if (option && (i + 1 == args.size() || !parse(args[i + 1], v)))
+        {
+            usage();
+            return 2;
+        }
+        if (args[i] == "--threads")
+        {
+            threads = std::max<uint64_t>(v, 1);
+        }
+        else if (args[i] == "--inputs")
+        {
+            limit = std::max<uint64_t>(v, 1);
+        }
+        else if (args[i] == "--bits")
+        {
+            bits = v;
+        }
+        else if (parse(args[i], v) && v >= 3 && v <= UINT32_MAX && (v & (v - 1)) != 0)
+        {
+            ns.push_back(static_cast<uint32_t>(v));
+        }
+        else
+        {
+            std::cout << "Invalid modulus: " << args[i] << "\n";
+            usage();
+            return 2;
+        }
+        i += option ? 1 : 0;
+    }
+    if (bits > 32 || (bits == 0) == ns.empty())
+    {
+        usage();
+        return 2;
+    }
+    for (uint64_t n = 3; n < (1UL << bits); ++n)
+    {
+        if ((n & (n - 1)) != 0)
+        {
+            ns.push_back(static_cast<uint32_t>(n));
+        }
+    }
+
+    std::vector<Modulus> moduli;
+    uint64_t total = 0;
+    for (const uint32_t n : ns)
+    {
+        moduli.push_back(make_modulus(n, limit));
+        for (const auto &[lo, hi] : moduli.back().ranges)
+        {
+            total += hi - lo;
+        }
+    }
+    std::cout << "Checking " << moduli.size() << " moduli, " << total << " inputs, " << threads << " threads, "
+              << (br::simd::has_avx2() ? "AVX2" : "no AVX2") << "\n";
+
+    Cursor cursor(moduli);
+    Shared shared;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (uint64_t t = 0; t < threads; ++t)
+    {
+        pool.emplace_back([&] {
+            Job job;
+            while (!shared.failed && cursor.next(job))
+            {
+                verify_job(shared, job, moduli[job.modulus].n);
+            }
+        });
+    }
+
+    // Progress every 10 seconds; the workers are joined once all inputs are checked or one failed.
+    auto last = start;
+    while (!shared.failed && shared.checked < total)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        const auto now = std::chrono::steady_clock::now();
+        if (now - last >= std::chrono::seconds(10))
+        {
+            const std::lock_guard<std::mutex> lock(shared.out);
+            std::cout << shared.checked * 100 / total << "%\n";
+            last = now;
+        }
+    }
+    for (std::thread &th : pool)
+    {
+        th.join();
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (shared.failed)
+    {
+        return 1;
+    }
+    std::cout << "OK: " << total << " inputs in " << elapsed.count() << " s\n";
+    return 0;
+}
@@ -1,19 +1,28 @@
 /*
 C++ implementation of the Barrett reduction.
 32, 64 and 128-bit versions.
+Also a reducer for the Mersenne prime 2^61 - 1 with the same interface,
+Plantard32 for products by constants modulo odd 32-bit moduli,
+and Divider64 for quotients and remainders of 128-bit values by a fixed 64-bit divisor.
+The Barrett reducers count calls and corrections when built with BR_ENABLE_COUNTERS (see counters.hpp).
 
 References:
 https://en.wikipedia.org/wiki/Barrett_reduction
 https://www.nayuki.io/page/barrett-reduction-algorithm
 https://math.stackexchange.com/a/3455956/988129
+https://gmplib.org/~tege/division-paper.pdf (Divider64)
+https://doi.org/10.1109/TETC.2021.3073475 (Plantard32)
 */
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
 #include <stdexcept>
 
+#include "libbr/counters.hpp"
+#include "libbr/simd.hpp"
 #include "libbr/util.hpp"
 
 namespace br
@@ -43,8 +52,10 @@ class BarrettRed32
 
     [[nodiscard]] auto calc(const uint32_t x) const -> uint32_t // x mod n
     {
+        counters::add(counters::Event::br32_calls);
         if (static_cast<uint64_t>(x) >= static_cast<uint64_t>(n) * static_cast<uint64_t>(n))
         {
+            counters::add(counters::Event::br32_rejected);
             std::cout << "x=" << x << ", n=" << n << ", n2=" << static_cast<uint64_t>(n) * static_cast<uint64_t>(n)
                       << "\n";
             throw std::invalid_argument("Input must be less than modulus^2.");
@@ -56,10 +67,40 @@ class BarrettRed32
         if (q >= n)
         {
             q -= n;
+            counters::add(counters::Event::br32_corrections);
         }
         return q;
     }
 
+    // out[i] = x[i] mod n for i < count. 'out' may be the same array as 'x'.
+    // Uses AVX2 when the CPU supports it.
+    void calc(const uint32_t *x, uint32_t *out, const std::size_t count) const
+    {
+#ifdef BR_X86_SIMD
+        if (simd::has_avx2())
+        {
+            counters::add(counters::Event::br32_calls, count);
+            const uint64_t n2 = static_cast<uint64_t>(n) * static_cast<uint64_t>(n);
+            if (!simd::barrett32_avx2(x, out, count, n, r, n2 > UINT32_MAX ? 0 : static_cast<uint32_t>(n2)))
+            {
+                counters::add(counters::Event::br32_rejected);
+                std::cout << "n=" << n << ", n2=" << n2 << "\n";
+                throw std::invalid_argument("Input must be less than modulus^2.");
+            }
+            return;
+        }
+#endif
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[i] = calc(x[i]);
+        }
+    }
+
+    [[nodiscard]] auto get_n() const -> uint32_t
+    {
+        return n;
+    }
+
     [[nodiscard]] auto get_r() const -> uint32_t
     {
         return r;
@@ -70,6 +111,123 @@ class BarrettRed32
     uint32_t r{0};
 };
 
+// Plantard's word-size modular multiplication, for products by constants modulo an odd 32-bit n.
+// A constant b is stored as b' = (b * -2^64 mod n) * n^-1 mod 2^64. Then with t = a * b' mod 2^64,
+// a * b mod n = (((t >> 32) + 1) * n) >> 32 exactly: two products and no correction step.
+// This holds when a * (b * -2^64 mod n) < 2^32 * (2^32 - n), that is for any 32-bit a when n < 2^31,
+// and for a < n when n^2 < 2^32 * (2^32 - n), about n < 2^32 / 1.618. Larger moduli are rejected.
+class Plantard32
+{
+  public:
+    explicit Plantard32(const uint32_t _n) : n(_n)
+    {
+        if (n < 3)
+        {
+            std::cout << "n=" << n << "\n";
+            throw std::invalid_argument("Modulus must be >= 3.");
+        }
+        if ((n & 1U) == 0)
+        {
+            std::cout << "n=" << n << "\n";
+            throw std::invalid_argument("Modulus must be odd.");
+        }
+        const uint64_t n64 = n;
+        if (n64 * n64 >= ((1UL << 32U) - n64) << 32U)
+        {
+            std::cout << "n=" << n << "\n";
+            throw std::invalid_argument("Modulus must be < 2^32 / phi.");
+        }
+        any_input = n < (1U << 31U);
+
+        // n^-1 mod 2^64 by Newton iteration: every step doubles the number of correct low bits, from 3.
+        n_inv = n64;
+        for (int i = 0; i < 5; ++i)
+        {
+            n_inv *= 2 - n64 * n_inv;
+        }
+
+        // -2^64 mod n
+        const uint64_t r = (UINT64_MAX % n64 + 1) % n64;
+        m = r == 0 ? 0 : n64 - r;
+
+        one = prepare(1);
+    }
+
+    // Stored form of the constant b, for mul().
+    [[nodiscard]] auto prepare(const uint32_t b) const -> uint64_t
+    {
+        return (static_cast<uint64_t>(b % n) * m % n) * n_inv;
+    }
+
+    // a * b mod n, with b_prep = prepare(b). a must be < n unless n < 2^31.
+    [[nodiscard]] auto mul(const uint32_t a, const uint64_t b_prep) const -> uint32_t
+    {
+        if (!any_input && a >= n)
+        {
+            std::cout << "a=" << a << ", n=" << n << "\n";
+            throw std::invalid_argument("Input must be less than modulus.");
+        }
+        return mul_unchecked(a, b_prep);
+    }
+
+    // mul() without the range check.
+    [[nodiscard]] auto mul_unchecked(const uint32_t a, const uint64_t b_prep) const -> uint32_t
+    {
+        const uint64_t t = static_cast<uint64_t>(a) * b_prep;
+        return static_cast<uint32_t>((((t >> 32U) + 1) * n) >> 32U);
+    }
+
+    [[nodiscard]] auto calc(const uint32_t x) const -> uint32_t // x mod n
+    {
+        return mul(x, one);
+    }
+
+    // out[i] = a[i] * b mod n for i < count, with b_prep = prepare(b). 'out' may be the same array as 'a'.
+    // Uses AVX2 when the CPU supports it.
+    void mul(const uint32_t *a, uint32_t *out, const std::size_t count, const uint64_t b_prep) const
+    {
+#ifdef BR_X86_SIMD
+        if (simd::has_avx2())
+        {
+            if (!simd::plantard32_avx2(a, out, count, n, b_prep, any_input))
+            {
+                std::cout << "n=" << n << "\n";
+                throw std::invalid_argument("Input must be less than modulus.");
+            }
+            return;
+        }
+#endif
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[i] = mul(a[i], b_prep);
+        }
+    }
+
+    // out[i] = x[i] mod n for i < count. 'out' may be the same array as 'x'.
+    void calc(const uint32_t *x, uint32_t *out, const std::size_t count) const
+    {
+        mul(x, out, count, one);
+    }
+
+    [[nodiscard]] auto get_n() const -> uint32_t
+    {
+        return n;
+    }
+
+    // True when mul() accepts any 32-bit a, false when a must be < n.
+    [[nodiscard]] auto accepts_any_input() const -> bool
+    {
+        return any_input;
+    }
+
+  private:
+    uint32_t n;
+    bool any_input{false};
+    uint64_t n_inv{0};
+    uint64_t m{0}; // -2^64 mod n
+    uint64_t one{0};
+};
+
 class BarrettRed64
 {
   public:
@@ -98,8 +256,10 @@ class BarrettRed64
 
     [[nodiscard]] auto calc(const uint64_t x) const -> uint64_t // x mod n
     {
+        counters::add(counters::Event::br64_calls);
         if (n2_hi == 0 && x >= n2_lo)
         {
+            counters::add(counters::Event::br64_rejected);
             std::cout << "x=" << x << ", n=" << n << ", n2_hi=" << n2_hi << ", n2_lo=" << n2_lo << "\n";
             throw std::invalid_argument("Input must be less than modulus^2.");
         }
@@ -112,10 +272,46 @@ class BarrettRed64
         if (q >= n)
         {
             q -= n;
+            counters::add(counters::Event::br64_corrections);
+        }
+        return q;
+    }
+
+    // x mod n, for any 64-bit x.
+    // With k = 64 the estimate 'q = (x * r) >> k' is at most 1 below 'x / n' for every x < 2^k,
+    // so a single correction is enough and the 'x < n^2' requirement of calc() can be dropped.
+    [[nodiscard]] auto calc_full(const uint64_t x) const -> uint64_t
+    {
+        counters::add(counters::Event::br64_calls);
+        if constexpr (counters::enabled)
+        {
+            counters::add(counters::Event::br64_wide, n2_hi == 0 && x >= n2_lo ? 1 : 0);
+        }
+        uint64_t q = util::mulhi64(x, r);
+        q = x - q * n;
+        if (q >= n)
+        {
+            q -= n;
+            counters::add(counters::Event::br64_corrections);
         }
         return q;
     }
 
+    [[nodiscard]] auto mul(const uint64_t a, const uint64_t b) const -> uint64_t // a * b mod n
+    {
+        if (n2_hi != 0)
+        {
+            std::cout << "n=" << n << "\n";
+            throw std::invalid_argument("Modulus must be < 2^32.");
+        }
+        return calc(a * b);
+    }
+
+    [[nodiscard]] auto get_n() const -> uint64_t
+    {
+        return n;
+    }
+
     [[nodiscard]] auto get_r() const -> uint64_t
     {
         return r;
@@ -183,6 +379,9 @@ class BarrettRed128
     {
         if (x >= n2)
         {
+            // Accepted inputs are counted as calls by calc_full().
+            counters::add(counters::Event::br128_calls);
+            counters::add(counters::Event::br128_rejected);
             const uint64_t x_lo = x;
             const uint64_t x_hi = x >> 64U;
             const uint64_t n2_lo = n2;
@@ -192,26 +391,43 @@ class BarrettRed128
             throw std::invalid_argument("Input must be less than modulus^2.");
         }
 
+        return calc_full(x);
+    }
+
+    // x mod n, for any 128-bit x.
+    // The estimates 'qa' and 'qb' are each at most 1 below the exact quotients for any 64-bit 'a' and 'b',
+    // so every partial result needs a single correction and the 'x < n^2' requirement of calc() can be dropped.
+    [[nodiscard]] auto calc_full(const uint128_t x) const -> uint64_t
+    {
+        counters::add(counters::Event::br128_calls);
         const uint128_t a = x >> 64U;
         const uint64_t b = x;
         const uint128_t qa = (a * s) >> 64U;
         const uint64_t qb = (static_cast<uint128_t>(b) * r) >> 64U;
-        uint128_t a1 = a * t - qa * n;
-        if (a1 >= n)
-        {
-            a1 -= n;
-        }
-        uint64_t b1 = b - qb * n;
-        if (b1 >= n)
-        {
-            b1 -= n;
-        }
-        uint128_t x1 = a1 + b1;
-        if (x1 >= n)
+        // a1, b1 < 2n and a1 + b1 < 2n after the first corrections, all below 2^65.
+        // The corrections select with masks: the inputs are usually random, so branches would mispredict.
+        const uint128_t a1 = a * t - qa * n;
+        const uint64_t a2 = static_cast<uint64_t>(a1 - (n & (0 - static_cast<uint64_t>(a1 >= n))));
+        const uint64_t b1 = b - qb * n;
+        const uint64_t b2 = b1 - (n & (0 - static_cast<uint64_t>(b1 >= n)));
+        const uint128_t x1 = static_cast<uint128_t>(a2) + b2;
+        if constexpr (counters::enabled)
         {
-            x1 -= n;
+            counters::add(counters::Event::br128_wide, x >= n2 ? 1 : 0);
+            const uint64_t corrections = static_cast<uint64_t>(a1 >= n) + (b1 >= n ? 1 : 0) + (x1 >= n ? 1 : 0);
+            counters::add(counters::Event::br128_corrections, corrections);
         }
-        return x1;
+        return static_cast<uint64_t>(x1 - (n & (0 - static_cast<uint64_t>(x1 >= n))));
+    }
+
+    [[nodiscard]] auto mul(const uint64_t a, const uint64_t b) const -> uint64_t // a * b mod n
+    {
+        return calc(static_cast<uint128_t>(a) * static_cast<uint128_t>(b));
+    }
+#else
+    [[nodiscard]] auto mul(const uint64_t a, const uint64_t b) const -> uint64_t // a * b mod n
+    {
+        return calc(util::mulhi64(a, b), a * b);
     }
 #endif
 
@@ -223,6 +439,7 @@ class BarrettRed128
             std::cout << "n=" << n << "\n";
             throw std::invalid_argument("Modulus must be < 2^63.");
         }
+        counters::add(counters::Event::br128_calls);
 #ifdef __SIZEOF_INT128__
         if (((static_cast<uint128_t>(x_hi) << 64U) | x_lo) >= n2)
         {
@@ -232,6 +449,7 @@ class BarrettRed128
         if (x_hi > n2_hi || (x_hi == n2_hi && x_lo >= n2_lo))
         {
 #endif
+            counters::add(counters::Event::br128_rejected);
             std::cout << "x_hi=" << x_hi << ", x_lo=" << x_lo << ", n=" << n << ", n2_hi=" << n2_hi
                       << ", n2_lo=" << n2_lo << "\n";
             throw std::invalid_argument("Input must be less than modulus^2.");
@@ -255,20 +473,28 @@ class BarrettRed128
         if (a1 >= n)
         {
             a1 -= n;
+            counters::add(counters::Event::br128_corrections);
         }
         uint64_t b1 = b - qb * n;
         if (b1 >= n)
         {
             b1 -= n;
+            counters::add(counters::Event::br128_corrections);
         }
         uint64_t x1 = a1 + b1;
         if (x1 >= n)
         {
             x1 -= n;
+            counters::add(counters::Event::br128_corrections);
         }
         return x1;
     }
 
+    [[nodiscard]] auto get_n() const -> uint64_t
+    {
+        return n;
+    }
+
     [[nodiscard]] auto get_r() const -> uint64_t
     {
         return r;
@@ -296,4 +522,138 @@ class BarrettRed128
 #endif
 };
 
+// Quotient and remainder by a fixed divisor d, for 128-bit dividends whose quotient fits in 64 bits.
+// Moller and Granlund's 2-by-1 division: with d shifted so its top bit is set and the reciprocal
+// v = (2^128 - 1) / d - 2^64, the quotient estimate from one product by v is off by at most 2.
+class Divider64
+{
+  public:
+    explicit Divider64(const uint64_t _d) : d(_d)
+    {
+        if (d == 0)
+        {
+            throw std::invalid_argument("Divisor must not be 0.");
+        }
+        while ((d << shift) < (1UL << 63U))
+        {
+            ++shift;
+        }
+        dn = d << shift;
+#ifdef __SIZEOF_INT128__
+        v = static_cast<uint64_t>(~static_cast<unsigned __int128>(0) / dn);
+#else
+        v = util::longdiv128_1s(dn);
+#endif
+    }
+
+    // (x_hi * 2^64 + x_lo) / d and the remainder, for x_hi < d.
+    [[nodiscard]] auto divrem(const uint64_t x_hi, const uint64_t x_lo, uint64_t &rem) const -> uint64_t
+    {
+        if (x_hi >= d)
+        {
+            std::cout << "x_hi=" << x_hi << ", d=" << d << "\n";
+            throw std::invalid_argument("Quotient must fit in 64 bits.");
+        }
+        return divrem_unchecked(x_hi, x_lo, rem);
+    }
+
+    // divrem() without the range check, for hot loops that keep x_hi < d by construction.
+    [[nodiscard]] auto divrem_unchecked(const uint64_t x_hi, const uint64_t x_lo, uint64_t &rem) const -> uint64_t
+    {
+        const uint64_t u1 = shift == 0 ? x_hi : (x_hi << shift) | (x_lo >> (64U - shift));
+        const uint64_t u0 = x_lo << shift;
+        // (q1, q0) = v * u1 + (u1 + 1, u0)
+        uint64_t q0 = v * u1;
+        uint64_t q1 = util::mulhi64(v, u1);
+        q0 += u0;
+        q1 += u1 + 1 + static_cast<uint64_t>(q0 < u0);
+        uint64_t r = u0 - q1 * dn;
+        // Taken about half the time, so selected with a mask. The second correction is rare.
+        const uint64_t mask = 0 - static_cast<uint64_t>(r > q0);
+        q1 += mask;
+        r += mask & dn;
+        if (r >= dn)
+        {
+            ++q1;
+            r -= dn;
+        }
+        rem = r >> shift;
+        return q1;
+    }
+
+    [[nodiscard]] auto get_d() const -> uint64_t
+    {
+        return d;
+    }
+
+  private:
+    uint64_t d;
+    uint64_t dn{0}; // d << shift
+    uint64_t v{0};
+    unsigned shift{0};
+};
+
+// Reduction modulo the Mersenne prime 2^61 - 1.
+// Since 2^61 = 1 mod n, x mod n is obtained by adding the 61-bit digits of x.
+class MersenneRed61
+{
+#ifdef __SIZEOF_INT128__
+    using uint128_t = unsigned __int128;
+
+  public:
+    static constexpr uint64_t n = (1UL << 61U) - 1;
+
+    [[nodiscard]] auto calc(const uint128_t x) const -> uint64_t // x mod n
+    {
+        if (x >= static_cast<uint128_t>(n) * static_cast<uint128_t>(n))
+        {
+            const uint64_t x_lo = x;
+            const uint64_t x_hi = x >> 64U;
+            std::cout << "x_hi=" << x_hi << ", x_lo=" << x_lo << ", n=" << n << "\n";
+            throw std::invalid_argument("Input must be less than modulus^2.");
+        }
+        return calc_full(x);
+    }
+
+    // x mod n, for any 128-bit x.
+    [[nodiscard]] auto calc_full(const uint128_t x) const -> uint64_t
+    {
+        // First fold: < 2^61 + 2^67.
+        const uint128_t y = (x & n) + (x >> 61U);
+        // Second fold: < 2^61 + 2^6.
+        uint64_t z = (static_cast<uint64_t>(y) & n) + static_cast<uint64_t>(y >> 61U);
+        if (z >= n)
+        {
+            z -= n;
+        }
+        return z;
+    }
+
+    [[nodiscard]] auto mul(const uint64_t a, const uint64_t b) const -> uint64_t // a * b mod n
+    {
+        return calc_full(static_cast<uint128_t>(a) * static_cast<uint128_t>(b));
+    }
+#else
+  public:
+    static constexpr uint64_t n = (1UL << 61U) - 1;
+
+    [[nodiscard]] auto mul(const uint64_t a, const uint64_t b) const -> uint64_t // a * b mod n
+    {
+        const uint64_t hi = util::mulhi64(a, b);
+        const uint64_t lo = a * b;
+        uint64_t z = (lo & n) + ((lo >> 61U) | (hi << 3U));
+        if (z >= n)
+        {
+            z -= n;
+        }
+        return z;
+    }
+#endif
+
+    [[nodiscard]] auto get_n() const -> uint64_t
+    {
+        return n;
+    }
+};
+
 } // namespace br
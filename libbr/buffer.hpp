@@ -0,0 +1,389 @@
+/*
+Aligned buffers and per-thread scratch arenas for batch workloads.
+
+Buffer<T> owns 'count' zero-initialized elements of a trivial type, aligned to 64 bytes (a cache line, and a
+multiple of every vector width the SIMD kernels use). Its memory comes from one of:
+- Pages::normal: the heap,
+- Pages::transparent: an anonymous mapping aligned to 2 MiB and advised with MADV_HUGEPAGE, so that the
+  kernel can back it with transparent huge pages: far fewer TLB misses on multi-GB arrays,
+- Pages::huge: a MAP_HUGETLB mapping of 2 MiB pages, which must have been reserved (vm.nr_hugepages).
+  When none are free, transparent pages are used instead.
+get_pages() tells what was obtained. Without mmap every buffer comes from the heap, and without the Linux
+advice a transparent mapping is reported as normal pages.
+
+Arena hands out aligned spans of uninitialized elements from a few large blocks, like a stack: an Arena::Scope
+frees everything allocated after it was opened. Blocks never move, so spans stay valid until their scope
+closes. When the arena is empty again and has more than one block, they are merged into one block that holds
+the peak, so a warm arena does not allocate. Blocks of 2 MiB or more use the pages the arena was made with.
+Arena::local() is the arena of the calling thread.
+
+Span<T> is a pointer and a length. The batch APIs do not take a Span or a Buffer: they keep their (pointer, count)
+parameters, and callers pass data() and size().
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BR_HAVE_MMAP 1
+#include <sys/mman.h>
+#endif
+
+namespace br
+{
+
+enum class Pages
+{
+    normal,
+    transparent,
+    huge
+};
+
+template <typename T> class Span
+{
+  public:
+    Span() = default;
+
+    Span(T *_ptr, const std::size_t _len) : ptr(_ptr), len(_len)
+    {
+    }
+
+    // Span<const T> from Span<T>.
+    template <typename U, typename = std::enable_if_t<std::is_same_v<const U, T>>>
+    Span(const Span<U> &s) : ptr(s.data()), len(s.size())
+    {
+    }
+
+    [[nodiscard]] auto data() const -> T *
+    {
+        return ptr;
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t
+    {
+        return len;
+    }
+
+    [[nodiscard]] auto empty() const -> bool
+    {
+        return len == 0;
+    }
+
+    [[nodiscard]] auto begin() const -> T *
+    {
+        return ptr;
+    }
+
+    [[nodiscard]] auto end() const -> T *
+    {
+        return ptr + len;
+    }
+
+    auto operator[](const std::size_t i) const -> T &
+    {
+        return ptr[i];
+    }
+
+    // Elements [offset, offset + count). Not checked.
+    [[nodiscard]] auto subspan(const std::size_t offset, const std::size_t count) const -> Span
+    {
+        return {ptr + offset, count};
+    }
+
+  private:
+    T *ptr{nullptr};
+    std::size_t len{0};
+};
+
+namespace detail
+{
+
+constexpr std::size_t buffer_alignment = 64;
+constexpr std::size_t huge_page_size = 2UL << 20U;
+
+struct Allocation
+{
+    void *ptr{nullptr};
+    std::size_t mapped{0}; // length of the mapping, 0 for the heap
+    Pages pages{Pages::normal};
+};
+
+inline auto round_up(const std::size_t v, const std::size_t m) -> std::size_t
+{
+    return (v + m - 1) / m * m;
+}
+
+// Zeroed memory of 'bytes' bytes, aligned to buffer_alignment. Throws std::bad_alloc.
+inline auto allocate(const std::size_t bytes, const Pages pages) -> Allocation
+{
+    Allocation res;
+    if (bytes == 0)
+    {
+        return res;
+    }
+#ifdef BR_HAVE_MMAP
+    const std::size_t len = round_up(bytes, huge_page_size);
+#ifdef MAP_HUGETLB
+    if (pages == Pages::huge)
+    {
+        void *addr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED)
+        {
+            return {addr, len, Pages::huge};
+        }
+    }
+#endif
+    if (pages != Pages::normal)
+    {
+        // Map one huge page more than needed and trim both ends to get a 2 MiB aligned range.
+        void *addr =
+            ::mmap(nullptr, len + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr != MAP_FAILED)
+        {
+            auto *base = static_cast<char *>(addr);
+            char *start = base + (round_up(reinterpret_cast<uintptr_t>(base), huge_page_size) -
+                                  reinterpret_cast<uintptr_t>(base));
+            if (start != base)
+            {
+                ::munmap(base, static_cast<std::size_t>(start - base));
+            }
+            ::munmap(start + len, static_cast<std::size_t>(base + huge_page_size - start));
+            res = {start, len, Pages::normal};
+#ifdef MADV_HUGEPAGE
+            if (::madvise(start, len, MADV_HUGEPAGE) == 0)
+            {
+                res.pages = Pages::transparent;
+            }
+#endif
+            return res;
+        }
+    }
+#endif
+    res.ptr = ::operator new(bytes, std::align_val_t(buffer_alignment));
+    std::memset(res.ptr, 0, bytes);
+    return res;
+}
+
+inline void release(const Allocation &a)
+{
+    if (a.ptr == nullptr)
+    {
+        return;
+    }
+#ifdef BR_HAVE_MMAP
+    if (a.mapped != 0)
+    {
+        ::munmap(a.ptr, a.mapped);
+        return;
+    }
+#endif
+    ::operator delete(a.ptr, std::align_val_t(buffer_alignment));
+}
+
+} // namespace detail
+
+template <typename T> class Buffer
+{
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_default_constructible_v<T>,
+                  "Buffer elements must be trivial.");
+    static_assert(alignof(T) <= detail::buffer_alignment, "Buffer elements must not be over-aligned.");
+
+  public:
+    static constexpr std::size_t alignment = detail::buffer_alignment;
+
+    Buffer() = default;
+
+    // 'count' zeroed elements. Throws std::bad_alloc.
+    explicit Buffer(const std::size_t _count, const Pages pages = Pages::normal) : count(_count)
+    {
+        if (count > SIZE_MAX / 2 / sizeof(T))
+        {
+            std::cout << "count=" << count << "\n";
+            throw std::invalid_argument("Buffer size overflows.");
+        }
+        mem = detail::allocate(count * sizeof(T), pages);
+    }
+
+    ~Buffer()
+    {
+        detail::release(mem);
+    }
+
+    Buffer(Buffer &&other) noexcept
+        : mem(std::exchange(other.mem, detail::Allocation{})), count(std::exchange(other.count, 0))
+    {
+    }
+
+    auto operator=(Buffer &&other) noexcept -> Buffer &
+    {
+        std::swap(mem, other.mem);
+        std::swap(count, other.count);
+        return *this;
+    }
+
+    Buffer(const Buffer &) = delete;
+    auto operator=(const Buffer &) -> Buffer & = delete;
+
+    [[nodiscard]] auto data() const -> T *
+    {
+        return static_cast<T *>(mem.ptr);
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t
+    {
+        return count;
+    }
+
+    [[nodiscard]] auto empty() const -> bool
+    {
+        return count == 0;
+    }
+
+    [[nodiscard]] auto begin() const -> T *
+    {
+        return data();
+    }
+
+    [[nodiscard]] auto end() const -> T *
+    {
+        return data() + count;
+    }
+
+    auto operator[](const std::size_t i) const -> T &
+    {
+        return data()[i];
+    }
+
+    [[nodiscard]] auto span() const -> Span<T>
+    {
+        return {data(), count};
+    }
+
+    // The pages actually obtained, which may be smaller than those asked for.
+    [[nodiscard]] auto get_pages() const -> Pages
+    {
+        return mem.pages;
+    }
+
+  private:
+    detail::Allocation mem;
+    std::size_t count{0};
+};
+
+class Arena
+{
+  public:
+    // Frees, when it goes out of scope, what the arena allocated since the scope was opened.
+    class Scope
+    {
+      public:
+        explicit Scope(Arena &_arena) : arena(_arena), mark(_arena.top)
+        {
+        }
+
+        ~Scope()
+        {
+            arena.release(mark);
+        }
+
+        Scope(const Scope &) = delete;
+        auto operator=(const Scope &) -> Scope & = delete;
+
+      private:
+        Arena &arena;
+        std::pair<std::size_t, std::size_t> mark;
+    };
+
+    explicit Arena(const Pages _pages = Pages::transparent) : pages(_pages)
+    {
+    }
+
+    // 'count' uninitialized elements, aligned to 64 bytes. Valid until the enclosing Scope closes.
+    template <typename T> auto allocate(const std::size_t count) -> Span<T>
+    {
+        static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_default_constructible_v<T>,
+                      "Arena elements must be trivial.");
+        static_assert(alignof(T) <= detail::buffer_alignment, "Arena elements must not be over-aligned.");
+        if (count > SIZE_MAX / 2 / sizeof(T))
+        {
+            std::cout << "count=" << count << "\n";
+            throw std::invalid_argument("Arena allocation size overflows.");
+        }
+        if (count == 0)
+        {
+            return {};
+        }
+        const std::size_t bytes = count * sizeof(T);
+        auto &[block, offset] = top;
+        if (blocks.empty() || detail::round_up(offset, detail::buffer_alignment) + bytes > blocks[block].size())
+        {
+            // The blocks after the current one are free: reuse the next if it fits, or replace them.
+            const std::size_t next = blocks.empty() ? 0 : block + 1;
+            if (next == blocks.size() || blocks[next].size() < bytes)
+            {
+                std::size_t capacity = 0;
+                for (std::size_t i = 0; i < next; ++i)
+                {
+                    capacity += blocks[i].size();
+                }
+                blocks.resize(next);
+                const std::size_t size = std::max({bytes, capacity, min_block});
+                blocks.emplace_back(size, size >= detail::huge_page_size ? pages : Pages::normal);
+            }
+            block = next;
+            offset = 0;
+        }
+        offset = detail::round_up(offset, detail::buffer_alignment);
+        T *res = reinterpret_cast<T *>(blocks[block].data() + offset);
+        offset += bytes;
+        return {res, count};
+    }
+
+    // Bytes held in blocks, free or not.
+    [[nodiscard]] auto capacity() const -> std::size_t
+    {
+        std::size_t res = 0;
+        for (const auto &b : blocks)
+        {
+            res += b.size();
+        }
+        return res;
+    }
+
+    // The arena of the calling thread.
+    static auto local() -> Arena &
+    {
+        static thread_local Arena arena;
+        return arena;
+    }
+
+  private:
+    static constexpr std::size_t min_block = 64UL << 10U;
+
+    void release(const std::pair<std::size_t, std::size_t> mark)
+    {
+        top = mark;
+        if (top == std::pair<std::size_t, std::size_t>{0, 0} && blocks.size() > 1)
+        {
+            const std::size_t size = capacity();
+            blocks.clear();
+            blocks.emplace_back(size, size >= detail::huge_page_size ? pages : Pages::normal);
+        }
+    }
+
+    Pages pages;
+    std::vector<Buffer<unsigned char>> blocks;
+    std::pair<std::size_t, std::size_t> top{0, 0}; // current block, and the first free byte in it
+};
+
+} // namespace br
@@ -0,0 +1,198 @@
+/*
+Adler-32 and Fletcher checksums.
+
+Both keep two running sums, s1 += d[i] and s2 += s1, modulo 65521 (Adler-32) or 2^k - 1 (Fletcher).
+The sums are accumulated without reduction for the longest run that cannot overflow, and then reduced once.
+Adler-32 runs are reduced with BarrettRed32, whose input must be < n^2, which sets the run length.
+Fletcher moduli 2^k - 1 are reduced by folding: 2^k = 1 mod 2^k - 1.
+
+The byte sums use AVX2 when the CPU supports it.
+
+References:
+https://en.wikipedia.org/wiki/Adler-32
+https://en.wikipedia.org/wiki/Fletcher%27s_checksum
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "libbr/br.hpp"
+#include "libbr/simd.hpp"
+
+namespace br
+{
+
+namespace detail
+{
+
+// Longest run of L bytes, rounded down to a multiple of 'align', such that s2 stays below 'limit' for
+// s1, s2 <= m - 1 at the start of the run: (m - 1) + L * (m - 1) + 255 * L * (L + 1) / 2 < limit.
+constexpr auto max_run(const uint64_t m, const uint64_t limit, const std::size_t align) -> std::size_t
+{
+    std::size_t len = 0;
+    while ((m - 1) + (len + 1) * (m - 1) + 255 * (len + 1) * (len + 2) / 2 < limit)
+    {
+        ++len;
+    }
+    return len / align * align;
+}
+
+// x mod 2^k - 1
+constexpr auto fold(uint64_t x, const uint32_t k) -> uint64_t
+{
+    const uint64_t m = (1UL << k) - 1;
+    while (x > m)
+    {
+        x = (x & m) + (x >> k);
+    }
+    return x == m ? 0 : x;
+}
+
+} // namespace detail
+
+constexpr uint32_t adler32_mod = 65521;
+
+// Adler-32 with plain loops, continuing from the checksum 'adler' (1 for a new stream).
+inline auto adler32_scalar(const uint8_t *data, std::size_t len, const uint32_t adler = 1) -> uint32_t
+{
+    static const BarrettRed32 red(adler32_mod);
+    constexpr std::size_t run = detail::max_run(adler32_mod, static_cast<uint64_t>(adler32_mod) * adler32_mod, 1);
+
+    uint32_t s1 = adler & 0xFFFFU;
+    uint32_t s2 = adler >> 16U;
+    while (len > 0)
+    {
+        const std::size_t k = std::min(len, run);
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 = red.calc(s1);
+        s2 = red.calc(s2);
+        data += k;
+        len -= k;
+    }
+    return (s2 << 16U) | s1;
+}
+
+// Adler-32, continuing from the checksum 'adler' (1 for a new stream).
+inline auto adler32(const uint8_t *data, std::size_t len, const uint32_t adler = 1) -> uint32_t
+{
+    uint32_t s1 = adler & 0xFFFFU;
+    uint32_t s2 = adler >> 16U;
+#ifdef BR_X86_SIMD
+    if (simd::has_avx2())
+    {
+        static const BarrettRed32 red(adler32_mod);
+        constexpr std::size_t run = detail::max_run(adler32_mod, static_cast<uint64_t>(adler32_mod) * adler32_mod, 32);
+
+        // Lanes of s1 followed by lanes of s2.
+        std::array<uint32_t, 16> lanes{};
+        while (len >= 32)
+        {
+            const std::size_t k = std::min(len / 32 * 32, run);
+            simd::byte_sums_avx2(data, k, s1, s2, lanes.data(), lanes.data() + 8);
+            // Every lane is at most the run's total, so all of them are < n^2.
+            red.calc(lanes.data(), lanes.data(), lanes.size());
+            s1 = 0;
+            s2 = 0;
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                s1 += lanes[i];
+                s2 += lanes[8 + i];
+            }
+            s1 = red.calc(s1);
+            s2 = red.calc(s2);
+            data += k;
+            len -= k;
+        }
+    }
+#endif
+    return adler32_scalar(data, len, (s2 << 16U) | s1);
+}
+
+// Fletcher-16 (sums of bytes modulo 255) with plain loops, continuing from the checksum 'fletcher' (0 for a new
+// stream).
+inline auto fletcher16_scalar(const uint8_t *data, std::size_t len, const uint16_t fletcher = 0) -> uint16_t
+{
+    constexpr std::size_t run = detail::max_run(255, 1UL << 32U, 1);
+
+    uint32_t s1 = fletcher & 0xFFU;
+    uint32_t s2 = fletcher >> 8U;
+    while (len > 0)
+    {
+        const std::size_t k = std::min(len, run);
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 = static_cast<uint32_t>(detail::fold(s1, 8));
+        s2 = static_cast<uint32_t>(detail::fold(s2, 8));
+        data += k;
+        len -= k;
+    }
+    return (s2 << 8U) | s1;
+}
+
+// Fletcher-16 (sums of bytes modulo 255).
+inline auto fletcher16(const uint8_t *data, std::size_t len) -> uint16_t
+{
+    uint32_t s1 = 0;
+    uint32_t s2 = 0;
+#ifdef BR_X86_SIMD
+    if (simd::has_avx2())
+    {
+        constexpr std::size_t run = detail::max_run(255, 1UL << 32U, 32);
+        std::array<uint32_t, 16> lanes{};
+        while (len >= 32)
+        {
+            const std::size_t k = std::min(len / 32 * 32, run);
+            simd::byte_sums_avx2(data, k, s1, s2, lanes.data(), lanes.data() + 8);
+            uint64_t t1 = 0;
+            uint64_t t2 = 0;
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                t1 += lanes[i];
+                t2 += lanes[8 + i];
+            }
+            s1 = static_cast<uint32_t>(detail::fold(t1, 8));
+            s2 = static_cast<uint32_t>(detail::fold(t2, 8));
+            data += k;
+            len -= k;
+        }
+    }
+#endif
+    return fletcher16_scalar(data, len, static_cast<uint16_t>((s2 << 8U) | s1));
+}
+
+// Fletcher-32 (sums of 16-bit words modulo 65535).
+// 64-bit accumulators allow runs of 2^20 words between reductions.
+inline auto fletcher32(const uint16_t *data, std::size_t len) -> uint32_t
+{
+    constexpr std::size_t run = 1U << 20U;
+
+    uint64_t s1 = 0;
+    uint64_t s2 = 0;
+    while (len > 0)
+    {
+        const std::size_t k = std::min(len, run);
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            s1 += data[i];
+            s2 += s1;
+        }
+        s1 = detail::fold(s1, 16);
+        s2 = detail::fold(s2, 16);
+        data += k;
+        len -= k;
+    }
+    return static_cast<uint32_t>((s2 << 16U) | s1);
+}
+
+} // namespace br
@@ -0,0 +1,191 @@
+/*
+Optional per-thread event counters for the Barrett reducers and the subsystems built on GF(p).
+
+Built only with BR_ENABLE_COUNTERS defined; otherwise add() is an empty inline function and the counting
+compiles away. Each thread counts into its own block with plain relaxed stores (no read-modify-write, no
+shared cache lines). snapshot() sums the blocks of the live threads and the totals left by threads that
+have exited, so it can be called at any time from any thread, e.g. by a metrics exporter.
+
+Events, per reducer width:
+- calls: values passed in, including the elements of batch calls and the inputs that are rejected,
+- corrections: final 'subtract n' steps taken (several per value in BarrettRed128; not counted inside
+  the AVX2 batch kernels),
+- rejected: calc() inputs >= n^2, which throw,
+- wide: calc_full() inputs >= n^2, which calc() would have rejected.
+The prime field code (NTT, ReedSolomon, Shamir, PolyRing) multiplies with Shoup products, and PolyMulMod reduces
+its own accumulators, so the reducer events do not see their work. They count it per subsystem instead:
+- ntt.points: elements transformed by NTT::forward() and inverse(), including the transforms run inside
+  ReedSolomon, PolyRing and PolyMulMod,
+- rs.encoded, rs.recovered: parity symbols computed by ReedSolomon::encode(), and shard symbols rebuilt by
+  decode(),
+- shamir.shares, shamir.combined: shares computed by Shamir::split(), and secrets recovered by combine(),
+- polymul.coefficients: output coefficients of PolyMulMod::mul().
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#ifdef BR_ENABLE_COUNTERS
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#endif
+
+namespace br::counters
+{
+
+enum class Event : std::size_t
+{
+    br32_calls,
+    br32_corrections,
+    br32_rejected,
+    br64_calls,
+    br64_corrections,
+    br64_rejected,
+    br64_wide,
+    br128_calls,
+    br128_corrections,
+    br128_rejected,
+    br128_wide,
+    ntt_points,
+    rs_encoded,
+    rs_recovered,
+    shamir_shares,
+    shamir_combined,
+    polymul_coefficients,
+    count
+};
+
+constexpr std::size_t num_events = static_cast<std::size_t>(Event::count);
+
+using Snapshot = std::array<uint64_t, num_events>;
+
+#ifdef BR_ENABLE_COUNTERS
+constexpr bool enabled = true;
+#else
+constexpr bool enabled = false;
+#endif
+
+// Metric name of an event, such as "br64.corrections".
+inline auto name(const Event e) -> const char *
+{
+    static constexpr std::array<const char *, num_events> names = {
+        "br32.calls",        "br32.corrections", "br32.rejected",   "br64.calls",
+        "br64.corrections",  "br64.rejected",    "br64.wide",       "br128.calls",
+        "br128.corrections", "br128.rejected",   "br128.wide",      "ntt.points",
+        "rs.encoded",        "rs.recovered",     "shamir.shares",   "shamir.combined",
+        "polymul.coefficients"};
+    return names[static_cast<std::size_t>(e)];
+}
+
+#ifdef BR_ENABLE_COUNTERS
+
+namespace detail
+{
+
+struct Block
+{
+    std::array<std::atomic<uint64_t>, num_events> v{};
+};
+
+struct Registry
+{
+    std::mutex m;
+    std::vector<const Block *> live;
+    Snapshot retired{};
+
+    // Never destroyed, so threads that exit during static destruction can still retire their counts.
+    static auto get() -> Registry &
+    {
+        static auto *reg = new Registry;
+        return *reg;
+    }
+};
+
+// The block of one thread, registered while the thread lives.
+struct Local
+{
+    Block block;
+
+    Local()
+    {
+        Registry &reg = Registry::get();
+        const std::lock_guard<std::mutex> lock(reg.m);
+        reg.live.push_back(&block);
+    }
+
+    ~Local()
+    {
+        Registry &reg = Registry::get();
+        const std::lock_guard<std::mutex> lock(reg.m);
+        for (std::size_t i = 0; i < num_events; ++i)
+        {
+            reg.retired[i] += block.v[i].load(std::memory_order_relaxed);
+        }
+        reg.live.erase(std::find(reg.live.begin(), reg.live.end(), &block));
+    }
+
+    Local(const Local &) = delete;
+    auto operator=(const Local &) -> Local & = delete;
+};
+
+inline auto local() -> Block &
+{
+    static thread_local Local l;
+    return l.block;
+}
+
+} // namespace detail
+
+// Count 'v' occurrences of 'e' in the calling thread.
+inline void add(const Event e, const uint64_t v = 1)
+{
+    // Only this thread writes its block: a relaxed load and store is enough, and cheaper than fetch_add.
+    std::atomic<uint64_t> &c = detail::local().v[static_cast<std::size_t>(e)];
+    c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+// Totals over all threads since the start of the process.
+inline auto snapshot() -> Snapshot
+{
+    detail::Registry &reg = detail::Registry::get();
+    const std::lock_guard<std::mutex> lock(reg.m);
+    Snapshot res = reg.retired;
+    for (const detail::Block *b : reg.live)
+    {
+        for (std::size_t i = 0; i < num_events; ++i)
+        {
+            res[i] += b->v[i].load(std::memory_order_relaxed);
+        }
+    }
+    return res;
+}
+
+#else
+
+inline void add(const Event /*e*/, const uint64_t /*v*/ = 1)
+{
+}
+
+inline auto snapshot() -> Snapshot
+{
+    return {};
+}
+
+#endif
+
+// One "name value" line per event, a format most metrics collectors can scrape.
+inline void write(std::ostream &os, const Snapshot &s)
+{
+    for (std::size_t i = 0; i < num_events; ++i)
+    {
+        os << name(static_cast<Event>(i)) << " " << s[i] << "\n";
+    }
+}
+
+} // namespace br::counters
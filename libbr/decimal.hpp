@@ -0,0 +1,602 @@
+/*
+Decimal text in and out.
+
+DecimalParser: residues of decimal numbers modulo several 64-bit moduli, straight from the text.
+
+The digits are read in chunks of 19, the most that fit in a 64-bit word (10^19 < 2^64), and each chunk c is
+folded into every residue as r = r * (10^19 mod n) + c mod n with one BarrettRed128::calc_full():
+r * (10^19 mod n) + c < (2^64 - 1)^2 + 2^64 < 2^128, so nothing else needs reducing. The moduli are updated
+in the inner loop, so their dependency chains overlap, and no big integer is ever built.
+
+Chunks are converted 16 digits at a time: with AVX2, two chunks per kernel call (one per 128-bit lane),
+otherwise 8 digits per step with SWAR multiplications on little-endian targets, or one digit at a time.
+The leading len mod 19 digits form a shorter first chunk.
+
+DecimalFormatter: decimal digits of a big integer given as 64-bit limbs, least significant first.
+- Numbers of up to split_threshold limbs are peeled: each pass divides every limb by 10^19 from the top with
+  Divider64, one multiplication-based 2-by-1 division per limb, and yields one base-10^19 digit.
+- Longer numbers are split as q * 10^(19 * 2^k) + r with a precomputed power of about half their size,
+  and both halves are converted recursively. Below barrett_threshold limbs in the power, the split is a
+  schoolbook long division, its quotient limbs estimated with Divider64: independent multiply-adds, unlike the
+  serial chain of the peeling. From there on, it is a Barrett division with the reciprocal of the power,
+  computed once: two products, which PolyMulMod::mul_exact() runs with the NTT. The conversion then costs
+  O(M(n) log n) instead of O(n^2). The constructor's NTT tables and reciprocals take about 50 words per limb
+  of max_limbs, and its reciprocals are computed by long division, in quadratic time.
+- Each base-10^19 digit is written as 3 + 4 * 4 characters. The groups of 4 go through an AVX2 kernel,
+  16 at a time, or a table of digit pairs.
+
+References:
+https://kholdstare.github.io/technical/2020/05/26/faster-integer-parsing.html
+https://gmplib.org/manual/Binary-to-Radix
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "libbr/br.hpp"
+#include "libbr/polymul.hpp"
+#include "libbr/simd.hpp"
+
+namespace br
+{
+
+class DecimalParser
+{
+#ifdef __SIZEOF_INT128__
+    using uint128_t = unsigned __int128;
+#endif
+
+  public:
+    // Digits per chunk, 10^chunk_digits < 2^64.
+    static constexpr std::size_t chunk_digits = 19;
+
+    explicit DecimalParser(std::vector<uint64_t> _moduli) : moduli(std::move(_moduli))
+    {
+        if (moduli.empty())
+        {
+            throw std::invalid_argument("At least one modulus is needed.");
+        }
+        constexpr uint64_t ten19 = 10000000000000000000UL;
+        reducers.reserve(moduli.size());
+        for (const uint64_t n : moduli)
+        {
+            reducers.emplace_back(n);
+            pow19.push_back(reducers.back().calc_full(static_cast<uint128_t>(ten19)));
+        }
+    }
+
+    // out[i] = the number written with the decimal digits s[0 .. len) mod moduli[i]. The value of an empty
+    // string is 0. Throws on anything other than '0' to '9'.
+    void parse(const char *s, const std::size_t len, uint64_t *out) const
+    {
+        const std::size_t count = moduli.size();
+        std::fill(out, out + count, 0);
+        const std::size_t head = len % chunk_digits;
+        if (head != 0)
+        {
+            fold(digits(s, head), out);
+        }
+        std::size_t pos = head;
+#ifdef BR_X86_SIMD
+        if (simd::has_avx2())
+        {
+            for (; pos + 2 * chunk_digits <= len; pos += 2 * chunk_digits)
+            {
+                // 3 + 16 digits per chunk.
+                std::array<uint64_t, 2> low{};
+                if (!simd::digits16x2_avx2(s + pos + 3, s + pos + chunk_digits + 3, low.data()))
+                {
+                    throw_bad_digit(s + pos, 2 * chunk_digits);
+                }
+                fold(digits(s + pos, 3) * 10000000000000000UL + low[0], out);
+                fold(digits(s + pos + chunk_digits, 3) * 10000000000000000UL + low[1], out);
+            }
+        }
+#endif
+        for (; pos < len; pos += chunk_digits)
+        {
+            fold(digits(s + pos, 3) * 10000000000000000UL + digits16(s + pos + 3), out);
+        }
+    }
+
+    [[nodiscard]] auto parse(const std::string_view s) const -> std::vector<uint64_t>
+    {
+        std::vector<uint64_t> out(moduli.size());
+        parse(s.data(), s.size(), out.data());
+        return out;
+    }
+
+    [[nodiscard]] auto get_moduli() const -> const std::vector<uint64_t> &
+    {
+        return moduli;
+    }
+
+  private:
+    // r = r * 10^19 + c mod n, for every modulus.
+    void fold(const uint64_t c, uint64_t *r) const
+    {
+        for (std::size_t i = 0; i < moduli.size(); ++i)
+        {
+            r[i] = reducers[i].calc_full(static_cast<uint128_t>(r[i]) * pow19[i] + c);
+        }
+    }
+
+    // Value of the len <= 19 digits at s.
+    static auto digits(const char *s, const std::size_t len) -> uint64_t
+    {
+        uint64_t v = 0;
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            const auto d = static_cast<uint64_t>(static_cast<unsigned char>(s[i]) - '0');
+            if (d > 9)
+            {
+                throw_bad_digit(s, len);
+            }
+            v = v * 10 + d;
+        }
+        return v;
+    }
+
+    static auto digits16(const char *s) -> uint64_t
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        return digits8(s) * 100000000 + digits8(s + 8);
+#else
+        return digits(s, 16);
+#endif
+    }
+
+    // Value of the 8 digits at s: the first digit is the lowest byte of the word, and pairs, then groups of
+    // 4 and 8 digits are combined with one multiplication each.
+    static auto digits8(const char *s) -> uint64_t
+    {
+        uint64_t v = 0;
+        std::memcpy(&v, s, sizeof(v));
+        // Every byte in 0x30 .. 0x39: high nibble 3, and still 3 after adding 6.
+        constexpr uint64_t high = 0xf0f0f0f0f0f0f0f0UL;
+        constexpr uint64_t zeros = 0x3030303030303030UL;
+        if ((v & high) != zeros || ((v + 0x0606060606060606UL) & high) != zeros)
+        {
+            throw_bad_digit(s, 8);
+        }
+        v -= zeros;
+        v = (v * 10 + (v >> 8U)) & 0x00ff00ff00ff00ffUL;
+        v = (v * 100 + (v >> 16U)) & 0x0000ffff0000ffffUL;
+        return (v * 10000 + (v >> 32U)) & 0x00000000ffffffffUL;
+    }
+
+    [[noreturn]] static void throw_bad_digit(const char *s, const std::size_t len)
+    {
+        std::cout << "text=" << std::string_view(s, len) << "\n";
+        throw std::invalid_argument("Decimal number must only have digits.");
+    }
+
+    std::vector<uint64_t> moduli;
+    std::vector<BarrettRed128> reducers;
+    std::vector<uint64_t> pow19; // 10^19 mod n
+};
+
+class DecimalFormatter
+{
+#ifdef __SIZEOF_INT128__
+    using uint128_t = unsigned __int128;
+#endif
+
+  public:
+    static constexpr std::size_t chunk_digits = 19;
+    static constexpr uint64_t ten19 = 10000000000000000000UL;
+    // Numbers above this many limbs are split by a power of 10^19 before being peeled.
+    static constexpr std::size_t split_threshold = 24;
+    // Powers of at least this many limbs divide by Barrett's method, with NTT products.
+    static constexpr std::size_t barrett_threshold = 256;
+
+    // Precomputes the powers of 10^19 used to split numbers of up to max_limbs limbs.
+    explicit DecimalFormatter(const std::size_t _max_limbs)
+        : max_limbs(_max_limbs), div19(ten19),
+          // The longest product, q1 * mu in divmod_barrett(), has at most 3 * max_limbs + 2 limbs.
+          product(ten19, max_limbs >= 2 * barrett_threshold ? 3 * max_limbs + 2 : 0)
+    {
+        std::vector<uint64_t> raw = {ten19};
+        for (std::size_t chunks = 1; 2 * raw.size() <= max_limbs; chunks *= 2)
+        {
+            Power p{raw, 0, Divider64(raw.back()), chunks, raw, {}};
+            while ((raw.back() << p.shift) < (1UL << 63U))
+            {
+                ++p.shift;
+            }
+            shift_left(p.norm, p.shift);
+            p.top = Divider64(p.norm.back());
+            if (raw.size() >= barrett_threshold && product.max_ntt_len() > 0)
+            {
+                std::vector<uint64_t> x(4 * raw.size() + 1, 0);
+                x.back() = 1;
+                p.inv = divmod(x, p);
+            }
+            powers.push_back(std::move(p));
+            raw = mul(raw.data(), raw.size(), raw.data(), raw.size());
+        }
+    }
+
+    // Decimal digits of limbs[0 .. count), least significant limb first, without leading zeros.
+    [[nodiscard]] auto format(const uint64_t *limbs, const std::size_t count) const -> std::string
+    {
+        std::vector<uint64_t> chunks;
+        to_chunks(limbs, count, chunks);
+        if (chunks.empty())
+        {
+            return "0";
+        }
+        std::string out = std::to_string(chunks.back());
+        const std::size_t head = out.size();
+        out.resize(head + (chunks.size() - 1) * chunk_digits);
+        write_chunks(chunks.data(), chunks.size() - 1, out.data() + head);
+        return out;
+    }
+
+    [[nodiscard]] auto format(const std::vector<uint64_t> &limbs) const -> std::string
+    {
+        return format(limbs.data(), limbs.size());
+    }
+
+    // Base-10^19 digits of limbs[0 .. count), least significant first, without leading zeros.
+    void to_chunks(const uint64_t *limbs, const std::size_t count, std::vector<uint64_t> &chunks) const
+    {
+        if (count > max_limbs && count > split_threshold)
+        {
+            std::cout << "count=" << count << " max_limbs=" << max_limbs << "\n";
+            throw std::invalid_argument("Number is longer than the formatter was set up for.");
+        }
+        chunks.clear();
+        convert(std::vector<uint64_t>(limbs, limbs + count), chunks, 0);
+        while (!chunks.empty() && chunks.back() == 0)
+        {
+            chunks.pop_back();
+        }
+    }
+
+  private:
+    // 10^(19 * chunks), shifted left so that its top limb has the high bit set, and as is.
+    struct Power
+    {
+        std::vector<uint64_t> norm;
+        unsigned shift;
+        Divider64 top; // by norm.back()
+        std::size_t chunks;
+        std::vector<uint64_t> value;
+        std::vector<uint64_t> inv; // floor(2^(64 * 4n) / value) for n >= barrett_threshold limbs, else empty
+    };
+
+    static void trim(std::vector<uint64_t> &x)
+    {
+        while (!x.empty() && x.back() == 0)
+        {
+            x.pop_back();
+        }
+    }
+
+    // x <<= shift < 64, without growing x.
+    static void shift_left(std::vector<uint64_t> &x, const unsigned shift)
+    {
+        if (shift == 0)
+        {
+            return;
+        }
+        for (std::size_t i = x.size(); i-- > 1;)
+        {
+            x[i] = (x[i] << shift) | (x[i - 1] >> (64U - shift));
+        }
+        x[0] <<= shift;
+    }
+
+    // a * b: schoolbook below barrett_threshold limbs in the shorter operand, else the NTT product, whose exact
+    // coefficients of 3 limbs each are added up with carries.
+    auto mul(const uint64_t *a, const std::size_t na, const uint64_t *b, const std::size_t nb) const
+        -> std::vector<uint64_t>
+    {
+        if (na == 0 || nb == 0)
+        {
+            return {};
+        }
+        std::vector<uint64_t> c(na + nb + 1, 0);
+        if (std::min(na, nb) < barrett_threshold || na + nb - 1 > product.max_ntt_len())
+        {
+            for (std::size_t i = 0; i < na; ++i)
+            {
+                uint64_t carry = 0;
+                for (std::size_t j = 0; j < nb; ++j)
+                {
+                    const uint128_t t = static_cast<uint128_t>(a[i]) * b[j] + c[i + j] + carry;
+                    c[i + j] = static_cast<uint64_t>(t);
+                    carry = static_cast<uint64_t>(t >> 64U);
+                }
+                c[i + nb] = carry;
+            }
+        }
+        else
+        {
+            const std::size_t len = na + nb - 1;
+            std::vector<uint64_t> e(3 * len);
+            product.mul_exact(a, na, b, nb, e.data());
+            // The coefficients are below 2^186, so the carry into the next one stays below 2^123.
+            uint128_t carry = 0;
+            for (std::size_t k = 0; k < len; ++k)
+            {
+                const uint128_t t = carry + e[3 * k];
+                c[k] = static_cast<uint64_t>(t);
+                carry = (t >> 64U) + e[3 * k + 1] + (static_cast<uint128_t>(e[3 * k + 2]) << 64U);
+            }
+            c[len] = static_cast<uint64_t>(carry);
+            c[len + 1] = static_cast<uint64_t>(carry >> 64U);
+        }
+        trim(c);
+        return c;
+    }
+
+    // Appends the base-10^19 digits of x, padded with zeros to at least 'width' digits.
+    void convert(std::vector<uint64_t> x, std::vector<uint64_t> &chunks, const std::size_t width) const
+    {
+        trim(x);
+        const std::size_t start = chunks.size();
+        std::size_t k = powers.size();
+        while (k > 0 && 2 * powers[k - 1].norm.size() > x.size())
+        {
+            --k;
+        }
+        // powers[0] has a single limb, too short for the quotient estimate.
+        if (x.size() <= split_threshold || k < 2)
+        {
+            peel(x, chunks);
+        }
+        else
+        {
+            const Power &p = powers[k - 1];
+            const bool barrett = !p.inv.empty() && x.size() <= 4 * p.value.size();
+            std::vector<uint64_t> q = barrett ? divmod_barrett(x, p) : divmod(x, p);
+            convert(std::move(x), chunks, p.chunks);
+            convert(std::move(q), chunks, 0);
+        }
+        chunks.resize(std::max(chunks.size(), start + width), 0);
+    }
+
+    // One base-10^19 digit per pass over the limbs.
+    void peel(std::vector<uint64_t> &x, std::vector<uint64_t> &chunks) const
+    {
+        while (!x.empty())
+        {
+            uint64_t r = 0;
+            for (std::size_t i = x.size(); i-- > 0;)
+            {
+                x[i] = div19.divrem_unchecked(r, x[i], r);
+            }
+            chunks.push_back(r);
+            trim(x);
+        }
+    }
+
+    // Barrett division: returns x / p and leaves x mod p in x, for x of len <= 4n limbs, p of n limbs. With
+    // q1 = floor(x / B^(n-1)) and mu = floor(B^len / p) (the top limbs of p.inv), B = 2^64, the estimate
+    // floor(q1 * mu / B^(len-n+1)) is at most 2 below the quotient.
+    auto divmod_barrett(std::vector<uint64_t> &x, const Power &p) const -> std::vector<uint64_t>
+    {
+        const std::vector<uint64_t> &v = p.value;
+        const std::size_t n = v.size();
+        const std::size_t len = x.size();
+        const std::size_t drop = 4 * n - len;
+        std::vector<uint64_t> q = mul(x.data() + n - 1, len - n + 1, p.inv.data() + drop, p.inv.size() - drop);
+        q.erase(q.begin(), q.begin() + static_cast<std::ptrdiff_t>(std::min(q.size(), len - n + 1)));
+        sub(x, mul(q.data(), q.size(), v.data(), n));
+        while (!less(x, v))
+        {
+            sub(x, v);
+            std::size_t i = 0;
+            while (i < q.size() && ++q[i] == 0)
+            {
+                ++i;
+            }
+            if (i == q.size())
+            {
+                q.push_back(1);
+            }
+        }
+        return q;
+    }
+
+    // a < b, both trimmed.
+    static auto less(const std::vector<uint64_t> &a, const std::vector<uint64_t> &b) -> bool
+    {
+        if (a.size() != b.size())
+        {
+            return a.size() < b.size();
+        }
+        return std::lexicographical_compare(a.rbegin(), a.rend(), b.rbegin(), b.rend());
+    }
+
+    // a -= b for a >= b, leaving a trimmed.
+    static void sub(std::vector<uint64_t> &a, const std::vector<uint64_t> &b)
+    {
+        uint64_t borrow = 0;
+        for (std::size_t i = 0; i < a.size() && (i < b.size() || borrow != 0); ++i)
+        {
+            const uint64_t d = i < b.size() ? b[i] : 0;
+            const uint64_t t = a[i] - d;
+            const uint64_t next = static_cast<uint64_t>(a[i] < d) + static_cast<uint64_t>(t < borrow);
+            a[i] = t - borrow;
+            borrow = next;
+        }
+        trim(a);
+    }
+
+    // Knuth's algorithm D: returns x / p and leaves x mod p in x.
+    auto divmod(std::vector<uint64_t> &x, const Power &p) const -> std::vector<uint64_t>
+    {
+        const std::vector<uint64_t> &v = p.norm;
+        const std::size_t n = v.size();
+        const std::size_t m = x.size() - n;
+        // u = x << shift, one limb longer.
+        std::vector<uint64_t> u(x);
+        u.push_back(0);
+        shift_left(u, p.shift);
+
+        std::vector<uint64_t> q(m + 1);
+        for (std::size_t j = m + 1; j-- > 0;)
+        {
+            // Estimate from the top two limbs, then refine with the next one: at most 2 too large.
+            uint64_t qhat = UINT64_MAX;
+            uint64_t rhat = 0;
+            bool rhat_big = false;
+            if (u[j + n] >= v[n - 1])
+            {
+                rhat = u[j + n - 1] + v[n - 1];
+                rhat_big = rhat < v[n - 1];
+            }
+            else
+            {
+                qhat = p.top.divrem_unchecked(u[j + n], u[j + n - 1], rhat);
+            }
+            while (!rhat_big &&
+                   static_cast<uint128_t>(qhat) * v[n - 2] > ((static_cast<uint128_t>(rhat) << 64U) | u[j + n - 2]))
+            {
+                --qhat;
+                rhat += v[n - 1];
+                rhat_big = rhat < v[n - 1];
+            }
+
+            // u[j .. j + n] -= qhat * v.
+            uint64_t carry = 0;
+            uint64_t borrow = 0;
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                const uint128_t prod = static_cast<uint128_t>(qhat) * v[i] + carry;
+                carry = static_cast<uint64_t>(prod >> 64U);
+                const auto lo = static_cast<uint64_t>(prod);
+                const uint64_t t = u[i + j] - lo;
+                const uint64_t t2 = t - borrow;
+                borrow = static_cast<uint64_t>(u[i + j] < lo) + static_cast<uint64_t>(t < borrow);
+                u[i + j] = t2;
+            }
+            const uint64_t top = u[j + n];
+            u[j + n] = top - carry - borrow;
+            // carry <= 2^64 - 2, so carry + borrow does not wrap.
+            if (top < carry + borrow)
+            {
+                // qhat was 1 too large: add v back.
+                --qhat;
+                uint64_t c = 0;
+                for (std::size_t i = 0; i < n; ++i)
+                {
+                    const uint128_t s = static_cast<uint128_t>(u[i + j]) + v[i] + c;
+                    u[i + j] = static_cast<uint64_t>(s);
+                    c = static_cast<uint64_t>(s >> 64U);
+                }
+                u[j + n] += c;
+            }
+            q[j] = qhat;
+        }
+
+        // x mod p = u[0 .. n) >> shift.
+        x.assign(u.begin(), u.begin() + static_cast<std::ptrdiff_t>(n));
+        if (p.shift != 0)
+        {
+            for (std::size_t i = 0; i + 1 < n; ++i)
+            {
+                x[i] = (x[i] >> p.shift) | (x[i + 1] << (64U - p.shift));
+            }
+            x[n - 1] >>= p.shift;
+        }
+        trim(q);
+        return q;
+    }
+
+    // count base-10^19 digits, least significant first, written most significant first as 19 characters each.
+    static void write_chunks(const uint64_t *chunks, const std::size_t count, char *out)
+    {
+        std::size_t c = count;
+#ifdef BR_X86_SIMD
+        if (simd::has_avx2())
+        {
+            std::array<uint16_t, 16> groups{};
+            std::array<char, 64> text{};
+            for (; c >= 4; c -= 4)
+            {
+                std::array<uint16_t, 4> heads{};
+                for (std::size_t i = 0; i < 4; ++i)
+                {
+                    const uint64_t x = chunks[c - 1 - i];
+                    heads[i] = static_cast<uint16_t>(x / 10000000000000000UL);
+                    split16(x % 10000000000000000UL, groups.data() + 4 * i);
+                }
+                simd::format4x16_avx2(groups.data(), text.data());
+                for (std::size_t i = 0; i < 4; ++i)
+                {
+                    write3(heads[i], out);
+                    std::memcpy(out + 3, text.data() + 16 * i, 16);
+                    out += chunk_digits;
+                }
+            }
+        }
+#endif
+        for (; c > 0; --c)
+        {
+            const uint64_t x = chunks[c - 1];
+            write3(static_cast<uint16_t>(x / 10000000000000000UL), out);
+            std::array<uint16_t, 4> groups{};
+            split16(x % 10000000000000000UL, groups.data());
+            for (std::size_t i = 0; i < 4; ++i)
+            {
+                std::memcpy(out + 3 + 4 * i, pairs() + 2 * (groups[i] / 100), 2);
+                std::memcpy(out + 5 + 4 * i, pairs() + 2 * (groups[i] % 100), 2);
+            }
+            out += chunk_digits;
+        }
+    }
+
+    // The 4 groups of 4 digits of x < 10^16, most significant first.
+    static void split16(const uint64_t x, uint16_t *groups)
+    {
+        const auto hi = static_cast<uint32_t>(x / 100000000);
+        const auto lo = static_cast<uint32_t>(x % 100000000);
+        groups[0] = static_cast<uint16_t>(hi / 10000);
+        groups[1] = static_cast<uint16_t>(hi % 10000);
+        groups[2] = static_cast<uint16_t>(lo / 10000);
+        groups[3] = static_cast<uint16_t>(lo % 10000);
+    }
+
+    static void write3(const uint16_t x, char *out)
+    {
+        out[0] = static_cast<char>('0' + x / 100);
+        std::memcpy(out + 1, pairs() + 2 * (x % 100), 2);
+    }
+
+    // "00", "01", ..., "99".
+    static auto pairs() -> const char *
+    {
+        static const std::array<char, 200> table = [] {
+            std::array<char, 200> t{};
+            for (std::size_t i = 0; i < 100; ++i)
+            {
+                t[2 * i] = static_cast<char>('0' + i / 10);
+                t[2 * i + 1] = static_cast<char>('0' + i % 10);
+            }
+            return t;
+        }();
+        return table.data();
+    }
+
+    std::size_t max_limbs;
+    Divider64 div19;
+    PolyMulMod product; // for mul_exact() only: its modulus plays no part
+    std::vector<Power> powers; // powers[k] = 10^(19 * 2^k)
+};
+
+} // namespace br
@@ -0,0 +1,293 @@
+/*
+Systematic Reed-Solomon erasure coding over a prime field GF(p), p < 2^63.
+
+A stripe has k data shards and m parity shards of 'len' symbols each, every symbol a field element < p
+(callers pack their bytes into symbols, e.g. 30 bits per symbol for p = 2013265921).
+Symbol c of every shard is the value of one polynomial of degree < k at the shard's evaluation point,
+so any k shards recover the whole stripe.
+
+Two encoders:
+- matrix: points 0, 1, ..., k + m - 1. The m x k Lagrange matrix is precomputed with its Shoup quotients
+  and applied with PrimeField::mul_add_const(), which runs 4 symbols at a time with AVX2 (much faster for
+  p < 2^31, where the products are 32-bit).
+- ntt: for K = 2^i >= max(k, 2) dividing p - 1, and m <= K. Data shard i sits at w^bitrev(i) (w of order K),
+  parity j at g * w^bitrev(j) for a g outside the subgroup of w. The K - k unused subgroup points carry zeros,
+  so the polynomial has degree < K but is still fixed by any k shards. Each column costs an inverse NTT,
+  a scaling by powers of g and a forward NTT: O(K log K) instead of O(k * m).
+
+Missing shards are rebuilt from the first k shards present with a Lagrange matrix, whose divisions share
+a single batch inversion.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "libbr/counters.hpp"
+#include "libbr/field.hpp"
+#include "libbr/ntt.hpp"
+
+namespace br
+{
+
+class ReedSolomon
+{
+  public:
+    enum class Mode
+    {
+        automatic, // the cheaper of the two, by multiplication count
+        matrix,
+        ntt
+    };
+
+    ReedSolomon(const uint64_t p, const std::size_t _k, const std::size_t _m, const Mode mode = Mode::automatic)
+        : field(p), k(_k), m(_m)
+    {
+        if (k == 0 || m == 0)
+        {
+            throw std::invalid_argument("Data and parity shard counts must be > 0.");
+        }
+
+        // The smallest transform is of size 2, even for a single data shard.
+        std::size_t size = 2;
+        while (size < k)
+        {
+            size <<= 1U;
+        }
+        const bool ntt_ok = (p - 1) % size == 0 && m <= size;
+        if (mode == Mode::ntt && !ntt_ok)
+        {
+            std::cout << "p=" << p << " k=" << k << " m=" << m << "\n";
+            throw std::invalid_argument("NTT encoding needs 2^i >= max(k, 2) dividing p - 1, and m <= 2^i.");
+        }
+
+        // matrix: k * m products per column, 4 at a time with AVX2 for p < 2^31 (the 64-bit kernel gains too
+        // little to count). ntt: about 2 * K * log2(K).
+        std::size_t log = 0;
+        while ((std::size_t{1} << log) < size)
+        {
+            ++log;
+        }
+        const std::size_t matrix_cost = p < (1UL << 31U) ? k * m / 4 : k * m;
+        if (mode == Mode::ntt || (mode == Mode::automatic && ntt_ok && 2 * size * log < matrix_cost))
+        {
+            ntt = std::make_unique<NTT>(p, size);
+            // g^size != 1 puts the parity coset outside the subgroup.
+            for (g = 2; field.pow(g, size) == 1; ++g)
+            {
+            }
+            const uint64_t w = ntt->root(size);
+            points.resize(size + m);
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                points[i] = field.pow(w, NTT::bitrev(i, size));
+            }
+            for (std::size_t j = 0; j < m; ++j)
+            {
+                points[size + j] = field.mul(g, points[j]);
+            }
+            // Data first, then parity, then the zero padding points.
+            std::rotate(points.begin() + static_cast<std::ptrdiff_t>(k), points.begin() + static_cast<std::ptrdiff_t>(size),
+                        points.end());
+            g_pow.resize(size);
+            g_pow_shoup.resize(size);
+            uint64_t x = 1;
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                g_pow[i] = x;
+                g_pow_shoup[i] = field.shoup(x);
+                x = field.mul(x, g);
+            }
+        }
+        else
+        {
+            if (k + m > p)
+            {
+                std::cout << "p=" << p << " k=" << k << " m=" << m << "\n";
+                throw std::invalid_argument("Stripe is wider than the field.");
+            }
+            points.resize(k + m);
+            for (std::size_t i = 0; i < k + m; ++i)
+            {
+                points[i] = i;
+            }
+            enc.resize(m * k);
+            enc_shoup.resize(m * k);
+            field.lagrange(points.data(), k, points.data() + k, m, enc.data());
+            for (std::size_t i = 0; i < enc.size(); ++i)
+            {
+                enc_shoup[i] = field.shoup(enc[i]);
+            }
+        }
+    }
+
+    // Compute parity[0 .. m) from data[0 .. k), each shard holding 'len' symbols < p.
+    void encode(const uint64_t *const *data, uint64_t *const *parity, const std::size_t len) const
+    {
+        counters::add(counters::Event::rs_encoded, m * len);
+        if (ntt)
+        {
+            encode_ntt(data, parity, len);
+            return;
+        }
+        for (std::size_t off = 0; off < len; off += block)
+        {
+            const std::size_t n = std::min(block, len - off);
+            for (std::size_t j = 0; j < m; ++j)
+            {
+                std::fill(parity[j] + off, parity[j] + off + n, 0);
+                for (std::size_t i = 0; i < k; ++i)
+                {
+                    field.mul_add_const(data[i] + off, parity[j] + off, n, enc[j * k + i], enc_shoup[j * k + i]);
+                }
+            }
+        }
+    }
+
+    // Rebuild the missing shards in place. 'shards' holds the k data shards followed by the m parity shards,
+    // and present[s] tells whether shards[s] is intact. At least k shards must be present.
+    void decode(uint64_t *const *shards, const bool *present, const std::size_t len) const
+    {
+        std::vector<std::size_t> src;
+        std::vector<std::size_t> dst;
+        for (std::size_t s = 0; s < k + m; ++s)
+        {
+            if (!present[s])
+            {
+                dst.push_back(s);
+            }
+            else if (src.size() < k)
+            {
+                src.push_back(s);
+            }
+        }
+        if (src.size() < k)
+        {
+            std::cout << "present=" << src.size() << " k=" << k << "\n";
+            throw std::invalid_argument("Not enough shards to decode.");
+        }
+        if (dst.empty())
+        {
+            return;
+        }
+        counters::add(counters::Event::rs_recovered, dst.size() * len);
+
+        // Nodes: the k sources, then the zero padding points, whose columns are not needed.
+        std::vector<uint64_t> xs;
+        for (const std::size_t s : src)
+        {
+            xs.push_back(points[s]);
+        }
+        xs.insert(xs.end(), points.begin() + static_cast<std::ptrdiff_t>(k + m), points.end());
+        std::vector<uint64_t> ys;
+        for (const std::size_t s : dst)
+        {
+            ys.push_back(points[s]);
+        }
+        const std::size_t nx = xs.size();
+        std::vector<uint64_t> coef(ys.size() * nx);
+        field.lagrange(xs.data(), nx, ys.data(), ys.size(), coef.data());
+        std::vector<uint64_t> coef_shoup(coef.size());
+        for (std::size_t i = 0; i < coef.size(); ++i)
+        {
+            coef_shoup[i] = field.shoup(coef[i]);
+        }
+
+        for (std::size_t off = 0; off < len; off += block)
+        {
+            const std::size_t n = std::min(block, len - off);
+            for (std::size_t j = 0; j < dst.size(); ++j)
+            {
+                uint64_t *out = shards[dst[j]] + off;
+                std::fill(out, out + n, 0);
+                for (std::size_t i = 0; i < k; ++i)
+                {
+                    field.mul_add_const(shards[src[i]] + off, out, n, coef[j * nx + i], coef_shoup[j * nx + i]);
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] auto uses_ntt() const -> bool
+    {
+        return ntt != nullptr;
+    }
+
+    // Evaluation point of shard s (data shards first).
+    [[nodiscard]] auto point(const std::size_t s) const -> uint64_t
+    {
+        return points[s];
+    }
+
+    [[nodiscard]] auto get_k() const -> std::size_t
+    {
+        return k;
+    }
+
+    [[nodiscard]] auto get_m() const -> std::size_t
+    {
+        return m;
+    }
+
+    [[nodiscard]] auto get_field() const -> const PrimeField &
+    {
+        return field;
+    }
+
+  private:
+    // Symbols per shard processed together, so the rows being combined stay in L1.
+    static constexpr std::size_t block = 1024;
+    // Columns per batch of NTTs: a batch has K rows of ntt_block symbols.
+    static constexpr std::size_t ntt_block = 64;
+
+    void encode_ntt(const uint64_t *const *data, uint64_t *const *parity, const std::size_t len) const
+    {
+        // ntt_block columns are transformed together, one row per evaluation point.
+        const std::size_t size = g_pow.size();
+        std::vector<uint64_t> a(size * ntt_block);
+        for (std::size_t off = 0; off < len; off += ntt_block)
+        {
+            const std::size_t n = std::min(ntt_block, len - off);
+            for (std::size_t i = 0; i < k; ++i)
+            {
+                std::copy(data[i] + off, data[i] + off + n, a.begin() + static_cast<std::ptrdiff_t>(i * n));
+            }
+            std::fill(a.begin() + static_cast<std::ptrdiff_t>(k * n), a.begin() + static_cast<std::ptrdiff_t>(size * n),
+                      0);
+            ntt->inverse(a.data(), size, n);
+            // f(g * x) has the coefficients f_i * g^i.
+            for (std::size_t i = 1; i < size; ++i)
+            {
+                field.mul_const(a.data() + i * n, a.data() + i * n, n, g_pow[i], g_pow_shoup[i]);
+            }
+            ntt->forward(a.data(), size, n);
+            for (std::size_t j = 0; j < m; ++j)
+            {
+                std::copy(a.begin() + static_cast<std::ptrdiff_t>(j * n),
+                          a.begin() + static_cast<std::ptrdiff_t>((j + 1) * n), parity[j] + off);
+            }
+        }
+    }
+
+    PrimeField field;
+    std::size_t k;
+    std::size_t m;
+    // Evaluation points: k data shards, m parity shards, then (ntt only) the zero padding points.
+    std::vector<uint64_t> points;
+    // matrix encoding: enc[j * k + i] = L_i(points[k + j]).
+    std::vector<uint64_t> enc;
+    std::vector<uint64_t> enc_shoup;
+    // ntt encoding.
+    std::unique_ptr<NTT> ntt;
+    uint64_t g{0};
+    std::vector<uint64_t> g_pow;
+    std::vector<uint64_t> g_pow_shoup;
+};
+
+} // namespace br
@@ -0,0 +1,243 @@
+/*
+Arithmetic in the prime field GF(p) for p < 2^63.
+
+General products go through BarrettRed128. Products by a value that is reused many times
+use Shoup's precomputed quotient (see util::shoup_mul), which needs 2p <= 2^64.
+The vector kernels take the AVX2 path for p < 2^31. mul_add_const() also has one for larger p, which builds
+the 64-bit products from 32-bit ones: about 1.2 times the scalar speed instead of 4 times or more.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "libbr/br.hpp"
+#include "libbr/simd.hpp"
+#include "libbr/util.hpp"
+
+namespace br
+{
+
+class PrimeField
+{
+  public:
+    explicit PrimeField(const uint64_t _p) : br(_p), p(_p)
+    {
+        if (p >= (1UL << 63U))
+        {
+            std::cout << "p=" << p << "\n";
+            throw std::invalid_argument("Modulus must be < 2^63.");
+        }
+    }
+
+    // add() and sub() are branch-free: with p < 2^63, the sign bit of the uncorrected result tells
+    // whether p must be added back, and field data is too random for the branch predictor.
+    [[nodiscard]] auto add(const uint64_t a, const uint64_t b) const -> uint64_t // a + b mod p
+    {
+        const uint64_t c = a + b - p;
+        return c + (p & (0 - (c >> 63U)));
+    }
+
+    [[nodiscard]] auto sub(const uint64_t a, const uint64_t b) const -> uint64_t // a - b mod p
+    {
+        const uint64_t c = a - b;
+        return c + (p & (0 - (c >> 63U)));
+    }
+
+    [[nodiscard]] auto neg(const uint64_t a) const -> uint64_t // -a mod p
+    {
+        return a == 0 ? 0 : p - a;
+    }
+
+    [[nodiscard]] auto mul(const uint64_t a, const uint64_t b) const -> uint64_t // a * b mod p
+    {
+        return br.mul(a, b);
+    }
+
+    [[nodiscard]] auto pow(uint64_t a, uint64_t e) const -> uint64_t // a^e mod p
+    {
+        uint64_t res = 1;
+        while (e != 0)
+        {
+            if ((e & 1U) != 0)
+            {
+                res = br.mul(res, a);
+            }
+            a = br.mul(a, a);
+            e >>= 1U;
+        }
+        return res;
+    }
+
+    // a^-1 mod p, by Fermat's little theorem.
+    [[nodiscard]] auto inv(const uint64_t a) const -> uint64_t
+    {
+        if (a == 0)
+        {
+            throw std::invalid_argument("Zero is not invertible.");
+        }
+        return pow(a, p - 2);
+    }
+
+    // Replace every a[i] by a[i]^-1 with a single inversion (Montgomery's trick).
+    void batch_inv(uint64_t *a, const std::size_t count) const
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        // prefix[i] = a[0] * ... * a[i]
+        std::vector<uint64_t> prefix(count);
+        prefix[0] = a[0];
+        for (std::size_t i = 1; i < count; ++i)
+        {
+            prefix[i] = br.mul(prefix[i - 1], a[i]);
+        }
+        uint64_t acc = inv(prefix[count - 1]);
+        for (std::size_t i = count - 1; i > 0; --i)
+        {
+            const uint64_t ai = br.mul(acc, prefix[i - 1]);
+            acc = br.mul(acc, a[i]);
+            a[i] = ai;
+        }
+        a[0] = acc;
+    }
+
+    // Lagrange basis of the distinct nodes xs[0 .. nx) evaluated at ys[0 .. ny):
+    // out[j * nx + i] = L_i(ys[j]), so the interpolant f satisfies f(ys[j]) = sum_i out[j * nx + i] * f(xs[i]).
+    // Barycentric form L_i(y) = l(y) * c_i / (y - xs[i]), with l(y) = prod_t (y - xs[t]) and
+    // c_i = 1 / prod_{t != i} (xs[i] - xs[t]). All the divisions share a single inversion.
+    void lagrange(const uint64_t *xs, const std::size_t nx, const uint64_t *ys, const std::size_t ny,
+                  uint64_t *out) const
+    {
+        // d[0 .. nx) holds the c_i denominators, d[nx + j * nx + i] holds y_j - x_i.
+        std::vector<uint64_t> d(nx + ny * nx);
+        for (std::size_t i = 0; i < nx; ++i)
+        {
+            uint64_t c = 1;
+            for (std::size_t t = 0; t < nx; ++t)
+            {
+                if (t != i)
+                {
+                    c = br.mul(c, sub(xs[i], xs[t]));
+                }
+            }
+            if (c == 0)
+            {
+                throw std::invalid_argument("Interpolation nodes must be distinct.");
+            }
+            d[i] = c;
+        }
+        std::vector<std::size_t> hit(ny, nx); // Index of the node equal to y_j, nx if none.
+        for (std::size_t j = 0; j < ny; ++j)
+        {
+            for (std::size_t i = 0; i < nx; ++i)
+            {
+                uint64_t &e = d[nx + j * nx + i];
+                e = sub(ys[j], xs[i]);
+                if (e == 0)
+                {
+                    hit[j] = i;
+                    e = 1;
+                }
+            }
+        }
+        batch_inv(d.data(), d.size());
+
+        for (std::size_t j = 0; j < ny; ++j)
+        {
+            uint64_t *row = out + j * nx;
+            if (hit[j] != nx)
+            {
+                for (std::size_t i = 0; i < nx; ++i)
+                {
+                    row[i] = i == hit[j] ? 1 : 0;
+                }
+                continue;
+            }
+            uint64_t l = 1;
+            for (std::size_t i = 0; i < nx; ++i)
+            {
+                l = br.mul(l, sub(ys[j], xs[i]));
+            }
+            for (std::size_t i = 0; i < nx; ++i)
+            {
+                row[i] = br.mul(l, br.mul(d[i], d[nx + j * nx + i]));
+            }
+        }
+    }
+
+    [[nodiscard]] auto shoup(const uint64_t w) const -> uint64_t
+    {
+        return util::shoup_precomp(w, p);
+    }
+
+    [[nodiscard]] auto mul_shoup(const uint64_t x, const uint64_t w, const uint64_t w_shoup) const -> uint64_t
+    {
+        return util::shoup_mul(x, w, w_shoup, p);
+    }
+
+    // out[i] = x[i] * w mod p, with w_shoup = shoup(w). 'out' may be the same array as 'x'.
+    void mul_const(const uint64_t *x, uint64_t *out, const std::size_t count, const uint64_t w,
+                   const uint64_t w_shoup) const
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[i] = util::shoup_mul(x[i], w, w_shoup, p);
+        }
+    }
+
+    void mul_const(const uint64_t *x, uint64_t *out, const std::size_t count, const uint64_t w) const
+    {
+        mul_const(x, out, count, w, shoup(w));
+    }
+
+    // acc[i] = acc[i] + x[i] * w mod p, with w_shoup = shoup(w). x[i] and acc[i] must be < p.
+    void mul_add_const(const uint64_t *x, uint64_t *acc, const std::size_t count, const uint64_t w,
+                       const uint64_t w_shoup) const
+    {
+#ifdef BR_X86_SIMD
+        if (p < (1UL << 31U) && simd::has_avx2())
+        {
+            // The 32-bit quotient is the top half of the 64-bit one.
+            simd::shoup31_mul_add_avx2(x, acc, count, static_cast<uint32_t>(w), static_cast<uint32_t>(w_shoup >> 32U),
+                                       static_cast<uint32_t>(p));
+            return;
+        }
+        if (simd::has_avx2())
+        {
+            simd::shoup63_mul_add_avx2(x, acc, count, w, w_shoup, p);
+            return;
+        }
+#endif
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            acc[i] = add(acc[i], util::shoup_mul(x[i], w, w_shoup, p));
+        }
+    }
+
+    void mul_add_const(const uint64_t *x, uint64_t *acc, const std::size_t count, const uint64_t w) const
+    {
+        mul_add_const(x, acc, count, w, shoup(w));
+    }
+
+    [[nodiscard]] auto get_p() const -> uint64_t
+    {
+        return p;
+    }
+
+    [[nodiscard]] auto reducer() const -> const BarrettRed128 &
+    {
+        return br;
+    }
+
+  private:
+    BarrettRed128 br;
+    uint64_t p;
+};
+
+} // namespace br
@@ -0,0 +1,373 @@
+/*
+Modulus-specialized batch reduction kernels, generated at run time for x86-64.
+
+BarrettJit64 emits a loop for out[i] = x[i] mod n (BarrettRed64::calc_full()) with the constants of one
+modulus baked into the instructions:
+- r is loaded once with a 64-bit immediate and stays in a register,
+- n is an immediate operand of the multiply and the correction when it fits in 31 bits, and is held in a
+  register otherwise,
+- the loop is unrolled 4 times, and the correction is a conditional move.
+
+The encoder only knows the handful of instructions the kernel needs. The code is written into an anonymous
+mapping that is made executable and read-only before use (never writable and executable at once).
+When code generation is not available (not x86-64 System V, no mmap, or the mapping is refused) or
+BR_NO_JIT is defined, calc() runs the generic loop over BarrettRed64::calc_full().
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "libbr/br.hpp"
+#include "libbr/counters.hpp"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__)) && !defined(BR_NO_JIT)
+#define BR_HAVE_JIT 1
+#include <sys/mman.h>
+#endif
+
+namespace br
+{
+
+namespace detail
+{
+
+// Minimal x86-64 encoder: 64-bit general purpose registers only.
+class X64Asm
+{
+  public:
+    enum Reg : uint8_t
+    {
+        rax = 0,
+        rcx = 1,
+        rdx = 2,
+        rsi = 6,
+        rdi = 7,
+        r8 = 8,
+        r9 = 9,
+        r10 = 10,
+        r11 = 11
+    };
+
+    // Condition codes of jcc and cmovcc.
+    enum Cond : uint8_t
+    {
+        below = 0x2,     // CF = 1
+        not_below = 0x3, // CF = 0
+        zero = 0x4,
+        not_zero = 0x5
+    };
+
+    // dst = src
+    void mov(const Reg dst, const Reg src)
+    {
+        rr(0x89, src, dst);
+    }
+
+    // dst = [base + disp]
+    void load(const Reg dst, const Reg base, const int8_t disp)
+    {
+        rex(dst, base);
+        emit(0x8B);
+        mem(dst, base, disp);
+    }
+
+    // [base + disp] = src
+    void store(const Reg base, const int8_t disp, const Reg src)
+    {
+        rex(src, base);
+        emit(0x89);
+        mem(src, base, disp);
+    }
+
+    // dst = imm
+    void mov_imm64(const Reg dst, const uint64_t imm)
+    {
+        rex(rax, dst);
+        emit(0xB8 + (dst & 7U));
+        emit_le(imm, 8);
+    }
+
+    // rdx:rax = rax * src
+    void mul(const Reg src)
+    {
+        rr(0xF7, static_cast<Reg>(4), src);
+    }
+
+    // dst = dst * src
+    void imul(const Reg dst, const Reg src)
+    {
+        rex(dst, src);
+        emit(0x0F);
+        emit(0xAF);
+        modrm(3, dst, src);
+    }
+
+    // dst = src * imm, imm sign-extended.
+    void imul_imm32(const Reg dst, const Reg src, const int32_t imm)
+    {
+        rr(0x69, dst, src);
+        emit_le(static_cast<uint32_t>(imm), 4);
+    }
+
+    // dst -= src
+    void sub(const Reg dst, const Reg src)
+    {
+        rr(0x29, src, dst);
+    }
+
+    // dst -= imm, imm sign-extended.
+    void sub_imm32(const Reg dst, const int32_t imm)
+    {
+        rr(0x81, static_cast<Reg>(5), dst);
+        emit_le(static_cast<uint32_t>(imm), 4);
+    }
+
+    void add_imm8(const Reg dst, const int8_t imm)
+    {
+        rr(0x83, static_cast<Reg>(0), dst);
+        emit(static_cast<uint8_t>(imm));
+    }
+
+    void sub_imm8(const Reg dst, const int8_t imm)
+    {
+        rr(0x83, static_cast<Reg>(5), dst);
+        emit(static_cast<uint8_t>(imm));
+    }
+
+    void cmp_imm8(const Reg dst, const int8_t imm)
+    {
+        rr(0x83, static_cast<Reg>(7), dst);
+        emit(static_cast<uint8_t>(imm));
+    }
+
+    void test(const Reg a, const Reg b)
+    {
+        rr(0x85, b, a);
+    }
+
+    // if (cond) dst = src
+    void cmov(const Cond cond, const Reg dst, const Reg src)
+    {
+        rex(dst, src);
+        emit(0x0F);
+        emit(0x40 + cond);
+        modrm(3, dst, src);
+    }
+
+    // Conditional jump with a 32-bit displacement. Returns the position of the displacement, for bind().
+    auto jcc(const Cond cond) -> std::size_t
+    {
+        emit(0x0F);
+        emit(0x80 + cond);
+        emit_le(0, 4);
+        return code.size() - 4;
+    }
+
+    // Conditional jump back to 'target', a position returned by here().
+    void jcc_back(const Cond cond, const std::size_t target)
+    {
+        bind(jcc(cond), target);
+    }
+
+    void ret()
+    {
+        emit(0xC3);
+    }
+
+    [[nodiscard]] auto here() const -> std::size_t
+    {
+        return code.size();
+    }
+
+    // Point the jump whose displacement is at 'at' to 'target'.
+    void bind(const std::size_t at, const std::size_t target)
+    {
+        const auto rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(code.data() + at, &rel, 4);
+    }
+
+    [[nodiscard]] auto bytes() const -> const std::vector<uint8_t> &
+    {
+        return code;
+    }
+
+  private:
+    void emit(const unsigned b)
+    {
+        code.push_back(static_cast<uint8_t>(b));
+    }
+
+    void emit_le(uint64_t v, const int len)
+    {
+        for (int i = 0; i < len; ++i)
+        {
+            emit(v & 0xFFU);
+            v >>= 8U;
+        }
+    }
+
+    // REX.W with the high bits of the ModRM reg and rm fields.
+    void rex(const Reg reg, const Reg rm)
+    {
+        emit(0x48U | ((reg >> 3U) << 2U) | (rm >> 3U));
+    }
+
+    void modrm(const unsigned mod, const Reg reg, const Reg rm)
+    {
+        emit((mod << 6U) | ((reg & 7U) << 3U) | (rm & 7U));
+    }
+
+    // [base + disp8]. Bases with low bits 100 (rsp, r12) would need a SIB byte and are not used.
+    void mem(const Reg reg, const Reg base, const int8_t disp)
+    {
+        modrm(1, reg, base);
+        emit(static_cast<uint8_t>(disp));
+    }
+
+    // Register-register form 'op /reg rm'.
+    void rr(const unsigned op, const Reg reg, const Reg rm)
+    {
+        rex(reg, rm);
+        emit(op);
+        modrm(3, reg, rm);
+    }
+
+    std::vector<uint8_t> code;
+};
+
+} // namespace detail
+
+class BarrettJit64
+{
+  public:
+    using Kernel = void (*)(const uint64_t *x, uint64_t *out, std::size_t count);
+
+    // Throws as BarrettRed64 does for an invalid n. Falls back to the generic loop if no kernel can be made.
+    explicit BarrettJit64(const uint64_t n) : br(n)
+    {
+#ifdef BR_HAVE_JIT
+        const std::vector<uint8_t> code = generate();
+        const std::size_t len = code.size();
+        void *addr = ::mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED)
+        {
+            return;
+        }
+        std::memcpy(addr, code.data(), len);
+        if (::mprotect(addr, len, PROT_READ | PROT_EXEC) != 0)
+        {
+            ::munmap(addr, len);
+            return;
+        }
+        mapping = std::shared_ptr<void>(addr, [len](void *p) { ::munmap(p, len); });
+        kernel = reinterpret_cast<Kernel>(addr);
+#endif
+    }
+
+    // out[i] = x[i] mod n for i < count, any 64-bit x[i]. 'out' may be the same array as 'x'.
+    void calc(const uint64_t *x, uint64_t *out, const std::size_t count) const
+    {
+        if (kernel != nullptr)
+        {
+            // The generated code does not count: only the calls are known.
+            counters::add(counters::Event::br64_calls, count);
+            kernel(x, out, count);
+            return;
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[i] = br.calc_full(x[i]);
+        }
+    }
+
+    // True when calc() runs generated code.
+    [[nodiscard]] auto jitted() const -> bool
+    {
+        return kernel != nullptr;
+    }
+
+    [[nodiscard]] auto reducer() const -> const BarrettRed64 &
+    {
+        return br;
+    }
+
+  private:
+    static constexpr int unroll = 4;
+
+    // System V arguments: rdi = x, rsi = out, rdx = count. Only caller-saved registers are used.
+    [[nodiscard]] auto generate() const -> std::vector<uint8_t>
+    {
+        using A = detail::X64Asm;
+        A a;
+        const uint64_t n = br.get_n();
+        const bool n_imm = n < (1UL << 31U);
+
+        a.mov(A::rcx, A::rdx);
+        a.mov_imm64(A::r9, br.get_r());
+        if (!n_imm)
+        {
+            a.mov_imm64(A::r10, n);
+        }
+
+        // One value: r8 = x, rdx = (x * r) >> 64, r8 = x - q * n < 2n, then subtract n if that does not borrow.
+        const auto body = [&](const int8_t disp) {
+            a.load(A::r8, A::rdi, disp);
+            a.mov(A::rax, A::r8);
+            a.mul(A::r9);
+            if (n_imm)
+            {
+                a.imul_imm32(A::rdx, A::rdx, static_cast<int32_t>(n));
+                a.sub(A::r8, A::rdx);
+                a.mov(A::r11, A::r8);
+                a.sub_imm32(A::r11, static_cast<int32_t>(n));
+            }
+            else
+            {
+                a.imul(A::rdx, A::r10);
+                a.sub(A::r8, A::rdx);
+                a.mov(A::r11, A::r8);
+                a.sub(A::r11, A::r10);
+            }
+            a.cmov(A::not_below, A::r8, A::r11);
+            a.store(A::rsi, disp, A::r8);
+        };
+
+        constexpr auto step = static_cast<int8_t>(8 * unroll);
+        a.cmp_imm8(A::rcx, unroll);
+        const std::size_t to_tail = a.jcc(A::below);
+        const std::size_t main_loop = a.here();
+        for (int i = 0; i < unroll; ++i)
+        {
+            body(static_cast<int8_t>(8 * i));
+        }
+        a.add_imm8(A::rdi, step);
+        a.add_imm8(A::rsi, step);
+        a.sub_imm8(A::rcx, unroll);
+        a.cmp_imm8(A::rcx, unroll);
+        a.jcc_back(A::not_below, main_loop);
+
+        a.bind(to_tail, a.here());
+        a.test(A::rcx, A::rcx);
+        const std::size_t to_done = a.jcc(A::zero);
+        const std::size_t tail_loop = a.here();
+        body(0);
+        a.add_imm8(A::rdi, 8);
+        a.add_imm8(A::rsi, 8);
+        a.sub_imm8(A::rcx, 1);
+        a.jcc_back(A::not_zero, tail_loop);
+        a.bind(to_done, a.here());
+        a.ret();
+        return a.bytes();
+    }
+
+    BarrettRed64 br;
+    std::shared_ptr<void> mapping;
+    Kernel kernel{nullptr};
+};
+
+} // namespace br
@@ -0,0 +1,206 @@
+/*
+Modular integer with a runtime modulus.
+
+The reducer lives in a thread-local context instead of in each value, so a DynModInt is just
+its 64-bit residue. A context is opened with DynModInt::Scope and stays active until the scope ends.
+Scopes nest: the previous reducer is restored when the inner scope is destroyed.
+
+Reducer can be BarrettRed64 (modulus < 2^32) or BarrettRed128 (any modulus).
+Use a distinct Tag to keep several moduli active at the same time.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+#include "libbr/br.hpp"
+
+namespace br
+{
+
+template <typename Reducer, typename Tag = void> class DynModInt
+{
+  public:
+    class Scope
+    {
+      public:
+        explicit Scope(const uint64_t n) : reducer(n), prev(current)
+        {
+            current = &reducer;
+        }
+
+        ~Scope()
+        {
+            current = prev;
+        }
+
+        Scope(const Scope &) = delete;
+        Scope(Scope &&) = delete;
+        auto operator=(const Scope &) -> Scope & = delete;
+        auto operator=(Scope &&) -> Scope & = delete;
+
+      private:
+        const Reducer reducer;
+        const Reducer *prev;
+    };
+
+    DynModInt() = default;
+
+    explicit DynModInt(const uint64_t x) : v(get_reducer().calc_full(x))
+    {
+    }
+
+    // Wrap a value that is already known to be < n, skipping the reduction.
+    [[nodiscard]] static auto raw(const uint64_t x) -> DynModInt
+    {
+        DynModInt res;
+        res.v = x;
+        return res;
+    }
+
+    [[nodiscard]] static auto get_reducer() -> const Reducer &
+    {
+        if (current == nullptr)
+        {
+            throw std::logic_error("No DynModInt::Scope is active in this thread.");
+        }
+        return *current;
+    }
+
+    [[nodiscard]] static auto modulus() -> uint64_t
+    {
+        return get_reducer().get_n();
+    }
+
+    [[nodiscard]] auto value() const -> uint64_t
+    {
+        return v;
+    }
+
+    auto operator+=(const DynModInt &rhs) -> DynModInt &
+    {
+        const uint64_t n = modulus();
+        v += rhs.v;
+        if (v < rhs.v || v >= n)
+        {
+            v -= n;
+        }
+        return *this;
+    }
+
+    auto operator-=(const DynModInt &rhs) -> DynModInt &
+    {
+        const uint64_t n = modulus();
+        if (v < rhs.v)
+        {
+            v += n;
+        }
+        v -= rhs.v;
+        return *this;
+    }
+
+    auto operator*=(const DynModInt &rhs) -> DynModInt &
+    {
+        v = get_reducer().mul(v, rhs.v);
+        return *this;
+    }
+
+    auto operator/=(const DynModInt &rhs) -> DynModInt &
+    {
+        return *this *= rhs.inv();
+    }
+
+    [[nodiscard]] auto operator-() const -> DynModInt
+    {
+        return raw(v == 0 ? 0 : modulus() - v);
+    }
+
+    [[nodiscard]] friend auto operator+(DynModInt lhs, const DynModInt &rhs) -> DynModInt
+    {
+        return lhs += rhs;
+    }
+
+    [[nodiscard]] friend auto operator-(DynModInt lhs, const DynModInt &rhs) -> DynModInt
+    {
+        return lhs -= rhs;
+    }
+
+    [[nodiscard]] friend auto operator*(DynModInt lhs, const DynModInt &rhs) -> DynModInt
+    {
+        return lhs *= rhs;
+    }
+
+    [[nodiscard]] friend auto operator/(DynModInt lhs, const DynModInt &rhs) -> DynModInt
+    {
+        return lhs /= rhs;
+    }
+
+    [[nodiscard]] friend auto operator==(const DynModInt &lhs, const DynModInt &rhs) -> bool
+    {
+        return lhs.v == rhs.v;
+    }
+
+    [[nodiscard]] friend auto operator!=(const DynModInt &lhs, const DynModInt &rhs) -> bool
+    {
+        return lhs.v != rhs.v;
+    }
+
+    friend auto operator<<(std::ostream &os, const DynModInt &x) -> std::ostream &
+    {
+        return os << x.v;
+    }
+
+    [[nodiscard]] auto pow(uint64_t e) const -> DynModInt
+    {
+        const Reducer &br = get_reducer();
+        uint64_t base = v;
+        uint64_t res = 1;
+        while (e != 0)
+        {
+            if ((e & 1U) != 0)
+            {
+                res = br.mul(res, base);
+            }
+            base = br.mul(base, base);
+            e >>= 1U;
+        }
+        return raw(res);
+    }
+
+    // Extended Euclid on unsigned magnitudes; the sign of the Bezout coefficient alternates every step.
+    [[nodiscard]] auto inv() const -> DynModInt
+    {
+        const uint64_t n = modulus();
+        uint64_t a = v;
+        uint64_t b = n;
+        uint64_t x = 1;
+        uint64_t y = 0;
+        bool odd = false;
+        while (b != 0)
+        {
+            const uint64_t q = a / b;
+            uint64_t t = a - q * b;
+            a = b;
+            b = t;
+            t = x + q * y;
+            x = y;
+            y = t;
+            odd = !odd;
+        }
+        if (a != 1)
+        {
+            std::cout << "x=" << v << ", n=" << n << "\n";
+            throw std::invalid_argument("Value is not invertible modulo n.");
+        }
+        return raw(odd ? n - x : x);
+    }
+
+  private:
+    static inline thread_local const Reducer *current = nullptr;
+
+    uint64_t v{0};
+};
+
+} // namespace br
@@ -0,0 +1,307 @@
+/*
+Number-theoretic transform over GF(p) for power-of-2 sizes dividing p - 1.
+
+The twiddle factors of the largest size are computed once, together with their Shoup quotients,
+so every butterfly multiplication is a Shoup product (see util::shoup_mul) instead of a full reduction.
+Smaller sizes use every (max_size / size)-th twiddle.
+
+forward() is a decimation-in-frequency transform: natural order in, bit-reversed order out.
+inverse() is a decimation-in-time transform: bit-reversed order in, natural order out.
+So a forward() followed by an inverse() needs no bit-reversal permutation.
+
+All tables live in one read-only block of table_words(max_size) words, in the order given by 'layout':
+roots, roots_shoup, inv_roots, inv_roots_shoup (max_size / 2 each), then size_inv, size_inv_shoup
+(log2(max_size) + 1 each). The block is shared between copies, and may come from outside (see NTTCache),
+in which case only a few entries are checked.
+
+References:
+https://en.wikipedia.org/wiki/Discrete_Fourier_transform_over_a_ring
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "libbr/counters.hpp"
+#include "libbr/field.hpp"
+
+namespace br
+{
+
+class NTT
+{
+  public:
+    // Version of the table layout, part of the NTTCache key.
+    static constexpr uint64_t layout = 1;
+
+    NTT(const uint64_t _p, const std::size_t _max_size) : field(_p), max_size(_max_size)
+    {
+        const uint64_t w = find_root();
+        auto buf = std::make_shared<std::vector<uint64_t>>(table_words(max_size));
+        uint64_t *t = buf->data();
+        const std::size_t half = max_size / 2;
+        const uint64_t w_inv = field.inv(w);
+        uint64_t x = 1;
+        uint64_t y = 1;
+        for (std::size_t i = 0; i < half; ++i)
+        {
+            t[i] = x;
+            t[half + i] = field.shoup(x);
+            t[2 * half + i] = y;
+            t[3 * half + i] = field.shoup(y);
+            x = field.mul(x, w);
+            y = field.mul(y, w_inv);
+        }
+        const std::size_t logs = log2(max_size) + 1;
+        for (std::size_t i = 0; i < logs; ++i)
+        {
+            const uint64_t s = field.inv(std::size_t{1} << i);
+            t[4 * half + i] = s;
+            t[4 * half + logs + i] = field.shoup(s);
+        }
+        set_tables(std::shared_ptr<const uint64_t>(buf, buf->data()));
+    }
+
+    // Uses tables[0 .. table_words(max_size)) built by another NTT of the same p and max_size, kept alive by
+    // 'tables'. Checks the root and a sample of entries, not the whole block.
+    NTT(const uint64_t _p, const std::size_t _max_size, std::shared_ptr<const uint64_t> tables)
+        : field(_p), max_size(_max_size)
+    {
+        const uint64_t w = find_root();
+        set_tables(std::move(tables));
+        const std::size_t half = max_size / 2;
+        // With max_size 2 the root blocks hold one entry each: roots[1] is already roots_shoup[0].
+        bool ok = roots[0] == 1;
+        if (half > 1)
+        {
+            ok = ok && roots[1] == w && inv_roots[1] == field.inv(w);
+        }
+        for (std::size_t i = 1; ok && i < half; i = 2 * i + 1)
+        {
+            const uint64_t x = field.pow(w, i);
+            ok = roots[i] == x && roots_shoup[i] == field.shoup(x) && inv_roots_shoup[i] == field.shoup(inv_roots[i]);
+        }
+        const std::size_t log = log2(max_size);
+        ok = ok && size_inv[log] == field.inv(max_size) && size_inv_shoup[log] == field.shoup(size_inv[log]);
+        if (!ok)
+        {
+            std::cout << "p=" << _p << " max_size=" << max_size << "\n";
+            throw std::invalid_argument("NTT tables do not match the modulus and size.");
+        }
+    }
+
+    // Words in the table block of an NTT of max_size.
+    [[nodiscard]] static auto table_words(const std::size_t max_size) -> std::size_t
+    {
+        return 2 * max_size + 2 * (log2(max_size) + 1);
+    }
+
+    // In-place transform of a[0 .. size), a[i] < p. The output is in bit-reversed order.
+    // With width > 1, 'a' holds 'width' interleaved transforms: element i of transform c is a[i * width + c].
+    void forward(uint64_t *a, const std::size_t size, const std::size_t width = 1) const
+    {
+        check_size(size);
+        counters::add(counters::Event::ntt_points, size * width);
+        for (std::size_t len = size, stride = max_size / size; len >= 2; len >>= 1U, stride <<= 1U)
+        {
+            const std::size_t half = len / 2;
+            for (std::size_t start = 0; start < size; start += len)
+            {
+                if (width == 1)
+                {
+                    uint64_t *lo = a + start;
+                    uint64_t *hi = lo + half;
+                    for (std::size_t j = 0; j < half; ++j)
+                    {
+                        const uint64_t u = lo[j];
+                        const uint64_t v = hi[j];
+                        lo[j] = field.add(u, v);
+                        hi[j] = field.mul_shoup(field.sub(u, v), roots[j * stride], roots_shoup[j * stride]);
+                    }
+                    continue;
+                }
+                for (std::size_t j = 0; j < half; ++j)
+                {
+                    uint64_t *lo = a + (start + j) * width;
+                    uint64_t *hi = lo + half * width;
+                    const uint64_t w = roots[j * stride];
+                    const uint64_t w_shoup = roots_shoup[j * stride];
+                    for (std::size_t c = 0; c < width; ++c)
+                    {
+                        const uint64_t u = lo[c];
+                        const uint64_t v = hi[c];
+                        lo[c] = field.add(u, v);
+                        hi[c] = field.mul_shoup(field.sub(u, v), w, w_shoup);
+                    }
+                }
+            }
+        }
+    }
+
+    // In-place inverse transform of a[0 .. size) given in bit-reversed order. The output is in natural order.
+    // 'width' interleaved transforms as in forward().
+    void inverse(uint64_t *a, const std::size_t size, const std::size_t width = 1) const
+    {
+        check_size(size);
+        counters::add(counters::Event::ntt_points, size * width);
+        for (std::size_t len = 2, stride = max_size / 2; len <= size; len <<= 1U, stride >>= 1U)
+        {
+            const std::size_t half = len / 2;
+            for (std::size_t start = 0; start < size; start += len)
+            {
+                if (width == 1)
+                {
+                    uint64_t *lo = a + start;
+                    uint64_t *hi = lo + half;
+                    for (std::size_t j = 0; j < half; ++j)
+                    {
+                        const uint64_t u = lo[j];
+                        const uint64_t v = field.mul_shoup(hi[j], inv_roots[j * stride], inv_roots_shoup[j * stride]);
+                        lo[j] = field.add(u, v);
+                        hi[j] = field.sub(u, v);
+                    }
+                    continue;
+                }
+                for (std::size_t j = 0; j < half; ++j)
+                {
+                    uint64_t *lo = a + (start + j) * width;
+                    uint64_t *hi = lo + half * width;
+                    const uint64_t w = inv_roots[j * stride];
+                    const uint64_t w_shoup = inv_roots_shoup[j * stride];
+                    for (std::size_t c = 0; c < width; ++c)
+                    {
+                        const uint64_t u = lo[c];
+                        const uint64_t v = field.mul_shoup(hi[c], w, w_shoup);
+                        lo[c] = field.add(u, v);
+                        hi[c] = field.sub(u, v);
+                    }
+                }
+            }
+        }
+        const std::size_t log = log2(size);
+        for (std::size_t i = 0; i < size * width; ++i)
+        {
+            a[i] = field.mul_shoup(a[i], size_inv[log], size_inv_shoup[log]);
+        }
+    }
+
+    // Primitive root of unity of order 'size'.
+    [[nodiscard]] auto root(const std::size_t size) const -> uint64_t
+    {
+        check_size(size);
+        if (max_size == 2)
+        {
+            // roots holds only w^0: the root of order 2 is -1.
+            return size == 2 ? field.get_p() - 1 : 1;
+        }
+        return field.pow(roots[1], max_size / size);
+    }
+
+    // Bit reversal of the low log2(size) bits of i.
+    [[nodiscard]] static auto bitrev(std::size_t i, const std::size_t size) -> std::size_t
+    {
+        std::size_t r = 0;
+        for (std::size_t s = 1; s < size; s <<= 1U)
+        {
+            r = (r << 1U) | (i & 1U);
+            i >>= 1U;
+        }
+        return r;
+    }
+
+    [[nodiscard]] auto get_max_size() const -> std::size_t
+    {
+        return max_size;
+    }
+
+    [[nodiscard]] auto get_field() const -> const PrimeField &
+    {
+        return field;
+    }
+
+    // The table block, table_words(max_size) words.
+    [[nodiscard]] auto tables() const -> const uint64_t *
+    {
+        return storage.get();
+    }
+
+  private:
+    static auto log2(const std::size_t size) -> std::size_t
+    {
+        std::size_t log = 0;
+        while ((std::size_t{1} << log) < size)
+        {
+            ++log;
+        }
+        return log;
+    }
+
+    // Checks p and max_size, and returns a root of unity of order max_size.
+    auto find_root() const -> uint64_t
+    {
+        const uint64_t p = field.get_p();
+        if (max_size < 2 || (max_size & (max_size - 1)) != 0)
+        {
+            std::cout << "max_size=" << max_size << "\n";
+            throw std::invalid_argument("Transform size must be a power of 2 >= 2.");
+        }
+        if ((p - 1) % max_size != 0)
+        {
+            std::cout << "p=" << p << " max_size=" << max_size << "\n";
+            throw std::invalid_argument("Transform size must divide p - 1.");
+        }
+
+        // w = g^((p - 1) / N) has order N exactly when w^(N / 2) = -1.
+        uint64_t w = 0;
+        for (uint64_t g = 2; g < p; ++g)
+        {
+            w = field.pow(g, (p - 1) / max_size);
+            if (field.pow(w, max_size / 2) == p - 1)
+            {
+                break;
+            }
+        }
+        return w;
+    }
+
+    void set_tables(std::shared_ptr<const uint64_t> tables)
+    {
+        storage = std::move(tables);
+        const std::size_t half = max_size / 2;
+        roots = storage.get();
+        roots_shoup = roots + half;
+        inv_roots = roots_shoup + half;
+        inv_roots_shoup = inv_roots + half;
+        size_inv = inv_roots_shoup + half;
+        size_inv_shoup = size_inv + log2(max_size) + 1;
+    }
+
+    void check_size(const std::size_t size) const
+    {
+        if (size == 0 || (size & (size - 1)) != 0 || size > max_size)
+        {
+            std::cout << "size=" << size << " max_size=" << max_size << "\n";
+            throw std::invalid_argument("Transform size must be a power of 2 <= max_size.");
+        }
+    }
+
+    PrimeField field;
+    std::size_t max_size;
+    std::shared_ptr<const uint64_t> storage;
+    // w^i and w^-i for i < max_size / 2, w of order max_size.
+    const uint64_t *roots{nullptr};
+    const uint64_t *roots_shoup{nullptr};
+    const uint64_t *inv_roots{nullptr};
+    const uint64_t *inv_roots_shoup{nullptr};
+    // size^-1 for size = 2^i <= max_size.
+    const uint64_t *size_inv{nullptr};
+    const uint64_t *size_inv_shoup{nullptr};
+};
+
+} // namespace br
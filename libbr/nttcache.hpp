@@ -0,0 +1,176 @@
+/*
+On-disk cache of NTT tables, loaded with mmap.
+
+Building the tables of a large NTT (two products and two Shoup quotients per root) takes a noticeable time at
+startup, for every prime. NTTCache::load() keeps them in one file per key (p, max_size, NTT::layout) under a
+directory, and maps that file read-only: the pages come straight from the page cache, shared by every process
+that loads the same tables.
+
+File format, all words in native byte order:
+  magic, format version, p, max_size, NTT::layout, table words, 2 reserved words (64-byte header)
+  the NTT table block, NTT::table_words(max_size) words
+A file that is missing, too short, has another header or fails the NTT sample check is rebuilt and replaced.
+Files are written to a temporary name and renamed, so readers never see a partial file.
+
+Without POSIX mmap, load() builds the tables in memory.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "libbr/ntt.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BR_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace br
+{
+
+class NTTCache
+{
+  public:
+    static constexpr uint64_t magic = 0x43414354544e5242UL; // "BRNTTCAC" in little-endian bytes
+    static constexpr uint64_t version = 1;
+
+    explicit NTTCache(std::string _dir) : dir(std::move(_dir))
+    {
+    }
+
+    // An NTT for (p, max_size), with the tables mapped from the cache, or built and then saved.
+    [[nodiscard]] auto load(const uint64_t p, const std::size_t max_size) const -> NTT
+    {
+#ifdef BR_HAVE_MMAP
+        const std::string file = path(p, max_size);
+        std::shared_ptr<const uint64_t> tables = map(file, p, max_size);
+        if (tables)
+        {
+            try
+            {
+                return NTT(p, max_size, std::move(tables));
+            }
+            catch (const std::invalid_argument &)
+            {
+                // Stale or damaged: rebuilt below.
+            }
+        }
+        NTT ntt(p, max_size);
+        save(file, ntt);
+        return ntt;
+#else
+        return NTT(p, max_size);
+#endif
+    }
+
+    // Cache file of (p, max_size).
+    [[nodiscard]] auto path(const uint64_t p, const std::size_t max_size) const -> std::string
+    {
+        return dir + "/ntt-v" + std::to_string(version) + "-" + std::to_string(p) + "-" + std::to_string(max_size) +
+               "-l" + std::to_string(NTT::layout) + ".bin";
+    }
+
+    [[nodiscard]] auto get_dir() const -> const std::string &
+    {
+        return dir;
+    }
+
+  private:
+    static constexpr std::size_t header_words = 8;
+
+    static auto header(const uint64_t p, const std::size_t max_size) -> std::array<uint64_t, header_words>
+    {
+        return {magic, version, p, max_size, NTT::layout, NTT::table_words(max_size), 0, 0};
+    }
+
+#ifdef BR_HAVE_MMAP
+    // The table block of 'file', or null if it cannot be mapped or its header does not match.
+    static auto map(const std::string &file, const uint64_t p, const std::size_t max_size)
+        -> std::shared_ptr<const uint64_t>
+    {
+        const int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+        const std::size_t len = (header_words + NTT::table_words(max_size)) * sizeof(uint64_t);
+        struct stat st
+        {
+        };
+        void *addr = MAP_FAILED;
+        if (::fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) == len)
+        {
+            addr = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        // The mapping stays valid after close().
+        ::close(fd);
+        if (addr == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        const auto *words = static_cast<const uint64_t *>(addr);
+        const std::array<uint64_t, header_words> head = header(p, max_size);
+        if (!std::equal(head.begin(), head.end(), words))
+        {
+            ::munmap(addr, len);
+            return nullptr;
+        }
+        return {words + header_words, [addr, len](const uint64_t *) { ::munmap(addr, len); }};
+    }
+
+    // Best effort: a cache that cannot be written only costs the rebuild next time.
+    static void save(const std::string &file, const NTT &ntt)
+    {
+        // A new file per call: threads of one process can miss the same key at once, and must not write one file.
+        std::string tmp = file + ".tmpXXXXXX";
+        const int fd = ::mkstemp(tmp.data());
+        if (fd < 0)
+        {
+            return;
+        }
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+        const std::array<uint64_t, header_words> head = header(ntt.get_field().get_p(), ntt.get_max_size());
+        // mkstemp() makes the file private to its owner; the cache is shared like the page cache.
+        bool ok = ::fchmod(fd, 0644) == 0;
+        ok = ok && write_all(fd, head.data(), sizeof(head));
+        ok = ok && write_all(fd, ntt.tables(), NTT::table_words(ntt.get_max_size()) * sizeof(uint64_t));
+        ok = ::close(fd) == 0 && ok;
+        if (!ok || ::rename(tmp.c_str(), file.c_str()) != 0)
+        {
+            ::unlink(tmp.c_str());
+        }
+    }
+
+    static auto write_all(const int fd, const void *data, std::size_t len) -> bool
+    {
+        const auto *bytes = static_cast<const char *>(data);
+        while (len > 0)
+        {
+            const ssize_t n = ::write(fd, bytes, len);
+            if (n <= 0)
+            {
+                return false;
+            }
+            bytes += n;
+            len -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+#endif
+
+    std::string dir;
+};
+
+} // namespace br
@@ -0,0 +1,189 @@
+/*
+Hash-to-range partitioning for arbitrary table sizes.
+
+Maps 64-bit hashes to [0, n) with one of two methods:
+- barrett: hash mod n, with the BarrettRed64 reciprocal.
+- multiply_shift: (hash * n) >> 64 (Lemire's fast range), which uses the high bits of the hash.
+Power-of-2 sizes use a mask with the barrett method.
+
+Both methods have AVX2 kernels. On top of the index computation there is a histogram of partition sizes
+and a radix-style scatter that stages each partition's output in a cache-line sized buffer
+before writing it out, so the destination sees full-line writes instead of scattered single stores.
+
+References:
+https://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "libbr/br.hpp"
+#include "libbr/simd.hpp"
+#include "libbr/util.hpp"
+
+namespace br
+{
+
+class Partitioner
+{
+  public:
+    enum class Method
+    {
+        barrett,
+        multiply_shift
+    };
+
+    explicit Partitioner(const uint32_t _n, const Method _method = Method::barrett) : n(_n), method(_method)
+    {
+        if (n == 0)
+        {
+            throw std::invalid_argument("Partition count must be > 0.");
+        }
+        pow2 = (n & (n - 1)) == 0;
+        if (!pow2 && method == Method::barrett)
+        {
+            r = BarrettRed64(n).get_r();
+        }
+    }
+
+    // out[i] = partition of hashes[i], in [0, n).
+    void index(const uint64_t *hashes, uint32_t *out, const std::size_t count) const
+    {
+        if (pow2 && method == Method::barrett)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                out[i] = static_cast<uint32_t>(hashes[i] & (n - 1));
+            }
+            return;
+        }
+
+#ifdef BR_X86_SIMD
+        if (simd::has_avx2())
+        {
+            if (method == Method::barrett)
+            {
+                simd::barrett64_mod32_avx2(hashes, out, count, n, r);
+            }
+            else
+            {
+                simd::mulshift32_avx2(hashes, out, count, n);
+            }
+            return;
+        }
+#endif
+        if (method == Method::barrett)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                // Same as BarrettRed64::calc_full().
+                const uint64_t q = util::mulhi64(hashes[i], r);
+                uint64_t t = hashes[i] - q * n;
+                if (t >= n)
+                {
+                    t -= n;
+                }
+                out[i] = static_cast<uint32_t>(t);
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                out[i] = static_cast<uint32_t>(util::mulhi64(hashes[i], n));
+            }
+        }
+    }
+
+    // counts[p] += number of hashes in partition p. 'counts' has n entries.
+    void histogram(const uint64_t *hashes, const std::size_t count, uint64_t *counts) const
+    {
+        std::array<uint32_t, chunk> idx{};
+        for (std::size_t i = 0; i < count; i += chunk)
+        {
+            const std::size_t k = std::min(chunk, count - i);
+            index(hashes + i, idx.data(), k);
+            for (std::size_t j = 0; j < k; ++j)
+            {
+                ++counts[idx[j]];
+            }
+        }
+    }
+
+    // Radix-style partitioning: 'out' receives the hashes grouped by partition, in input order within each.
+    // Returns the n + 1 partition boundaries: partition p is out[offsets[p] .. offsets[p + 1]).
+    auto scatter(const uint64_t *hashes, const std::size_t count, uint64_t *out) const -> std::vector<std::size_t>
+    {
+        std::vector<uint64_t> counts(n, 0);
+        histogram(hashes, count, counts.data());
+
+        std::vector<std::size_t> offsets(static_cast<std::size_t>(n) + 1, 0);
+        for (std::size_t p = 0; p < n; ++p)
+        {
+            offsets[p + 1] = offsets[p] + counts[p];
+        }
+
+        // Write-combining buffers: one cache line per partition.
+        std::vector<Line> lines(n);
+        std::vector<std::size_t> fill(n, 0);
+        std::vector<std::size_t> pos(offsets.begin(), offsets.end() - 1);
+
+        std::array<uint32_t, chunk> idx{};
+        for (std::size_t i = 0; i < count; i += chunk)
+        {
+            const std::size_t k = std::min(chunk, count - i);
+            index(hashes + i, idx.data(), k);
+            for (std::size_t j = 0; j < k; ++j)
+            {
+                const uint32_t p = idx[j];
+                lines[p].v[fill[p]++] = hashes[i + j];
+                if (fill[p] == line_size)
+                {
+                    std::memcpy(out + pos[p], lines[p].v.data(), sizeof(Line));
+                    pos[p] += line_size;
+                    fill[p] = 0;
+                }
+            }
+        }
+        for (std::size_t p = 0; p < n; ++p)
+        {
+            std::memcpy(out + pos[p], lines[p].v.data(), fill[p] * sizeof(uint64_t));
+        }
+
+        return offsets;
+    }
+
+    [[nodiscard]] auto get_n() const -> uint32_t
+    {
+        return n;
+    }
+
+  private:
+    static constexpr std::size_t chunk = 1024;
+    static constexpr std::size_t line_size = 64 / sizeof(uint64_t);
+
+    struct alignas(64) Line
+    {
+        std::array<uint64_t, line_size> v;
+    };
+
+    uint32_t n;
+    Method method;
+    bool pow2{false};
+    uint64_t r{0};
+};
+
+// out[i] = hashes[i] mod n for i < count.
+inline void partition_index(const uint64_t *hashes, uint32_t *out, const std::size_t count, const uint32_t n)
+{
+    Partitioner(n).index(hashes, out, count);
+}
+
+} // namespace br
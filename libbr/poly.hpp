@@ -0,0 +1,550 @@
+/*
+Polynomial arithmetic over GF(p) for NTT primes, p < 2^63.
+
+Polynomials are coefficient vectors, lowest degree first.
+- mul(): schoolbook for short operands, with 128-bit accumulators that are reduced once per run of products
+  (BarrettRed128::calc_full()), and NTT multiplication above mul_threshold.
+- inv_series() and divmod(): Newton iteration b' = b * (2 - a * b) mod x^(2k), which doubles the number of
+  correct terms per step, so inversion and division cost O(M(n)). Each step runs on transforms of size 2k:
+  a * b mod x^(2k) - 1 only wraps onto the k terms already known, and the transform of b is used twice.
+- Divisor: division by a fixed b, with the inverse of reversed b and the transforms of both precomputed.
+  The remainder only needs a - q * b mod x^N - 1 for N >= deg b, folding a and q to N terms, so it takes
+  one transform pair of size N instead of a full product.
+- eval() at many points: Horner's rule across batches of points, with per-point Shoup quotients,
+  and AVX2 for p < 2^31.
+- eval_tree() and interpolate(): subproduct tree of the points, O(M(n) log n). The remainders are pushed down
+  the tree until a node holds at most horner_threshold points, where batched Horner takes over.
+  Below tree_threshold points the quadratic batched Horner is faster, so eval_tree() uses it directly.
+
+References:
+https://cr.yp.to/lineartime/multapps-20080515.pdf
+https://en.wikipedia.org/wiki/Polynomial_evaluation#Multipoint_evaluation
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "libbr/br.hpp"
+#include "libbr/field.hpp"
+#include "libbr/ntt.hpp"
+#include "libbr/simd.hpp"
+
+namespace br
+{
+
+class PolyRing
+{
+#ifdef __SIZEOF_INT128__
+    using uint128_t = unsigned __int128;
+#endif
+
+  public:
+    using Poly = std::vector<uint64_t>;
+
+    // Below this many coefficients in the shorter operand, mul() uses schoolbook multiplication.
+    static constexpr std::size_t mul_threshold = 32;
+    // Subproduct tree nodes with at most this many points are evaluated with batched Horner.
+    static constexpr std::size_t horner_threshold = 256;
+    // eval_tree() falls back to batched Horner up to this many points and coefficients,
+    // higher with the AVX2 kernel (p < 2^31).
+    static constexpr std::size_t tree_threshold = 1024;
+    static constexpr std::size_t tree_threshold_avx2 = 8192;
+
+    // 'max_len' bounds the length of NTT products, it must divide p - 1 once rounded up to a power of 2.
+    PolyRing(const uint64_t p, const std::size_t max_len)
+        : field(p), ntt(p, ceil_pow2(std::max<std::size_t>(max_len, 2)))
+    {
+        // Number of products (p - 1)^2 that fit in a 128-bit accumulator on top of a reduced value.
+        const uint128_t sq = static_cast<uint128_t>(p - 1) * (p - 1);
+        const uint128_t run = (~static_cast<uint128_t>(0) - (p - 1)) / sq;
+        lazy_run = run > SIZE_MAX ? SIZE_MAX : static_cast<std::size_t>(run);
+    }
+
+    // a * b.
+    [[nodiscard]] auto mul(const Poly &a, const Poly &b) const -> Poly
+    {
+        if (a.empty() || b.empty())
+        {
+            return {};
+        }
+        if (std::min(a.size(), b.size()) <= mul_threshold)
+        {
+            return mul_schoolbook(a, b);
+        }
+        const std::size_t len = a.size() + b.size() - 1;
+        const std::size_t size = transform_size(len);
+        Poly fa(size, 0);
+        Poly fb(size, 0);
+        std::copy(a.begin(), a.end(), fa.begin());
+        std::copy(b.begin(), b.end(), fb.begin());
+        ntt.forward(fa.data(), size);
+        ntt.forward(fb.data(), size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            fa[i] = field.mul(fa[i], fb[i]);
+        }
+        ntt.inverse(fa.data(), size);
+        fa.resize(len);
+        return fa;
+    }
+
+    // a^-1 mod x^n, for a[0] != 0.
+    [[nodiscard]] auto inv_series(const Poly &a, const std::size_t n) const -> Poly
+    {
+        if (a.empty() || a[0] == 0)
+        {
+            throw std::invalid_argument("Series must have a nonzero constant term.");
+        }
+        Poly b = {field.inv(a[0])};
+        for (std::size_t k = 1; k < n; k *= 2)
+        {
+            // b = b * (2 - a * b) mod x^(2k) = b + b * (1 - a * b): a * b = 1 mod x^k, so only terms >= k are new.
+            const std::size_t len = std::min(2 * k, n);
+            Poly t;
+            if (k <= mul_threshold)
+            {
+                Poly ab = mul(truncate(a, len), b);
+                ab.resize(len, 0);
+                Poly e(ab.begin() + static_cast<std::ptrdiff_t>(k), ab.end());
+                t = mul(e, b);
+            }
+            else
+            {
+                // k is a power of 2. Both products are taken mod x^(2k) - 1: the terms from 2k on wrap
+                // onto [0, k), which are known (a * b) or not needed (x^k * e * b).
+                const std::size_t size = transform_size(2 * k);
+                Poly fb(size, 0);
+                std::copy(b.begin(), b.end(), fb.begin());
+                ntt.forward(fb.data(), size);
+                Poly fa(size, 0);
+                std::copy_n(a.begin(), std::min(a.size(), len), fa.begin());
+                ntt.forward(fa.data(), size);
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    fa[i] = field.mul(fa[i], fb[i]);
+                }
+                ntt.inverse(fa.data(), size);
+                // fa = x^k * e, e = (a * b)[k, len).
+                std::fill(fa.begin(), fa.begin() + static_cast<std::ptrdiff_t>(k), 0);
+                std::fill(fa.begin() + static_cast<std::ptrdiff_t>(len), fa.end(), 0);
+                ntt.forward(fa.data(), size);
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    fa[i] = field.mul(fa[i], fb[i]);
+                }
+                ntt.inverse(fa.data(), size);
+                t.assign(fa.begin() + static_cast<std::ptrdiff_t>(k), fa.begin() + static_cast<std::ptrdiff_t>(len));
+            }
+            t.resize(len - k, 0);
+            b.resize(len, 0);
+            for (std::size_t i = k; i < len; ++i)
+            {
+                b[i] = field.neg(t[i - k]);
+            }
+        }
+        b.resize(n, 0);
+        return b;
+    }
+
+    // Division by a fixed polynomial b, for dividends of up to max_len coefficients.
+    class Divisor
+    {
+      public:
+        Divisor(const PolyRing &_ring, const Poly &_b, const std::size_t max_len) : ring(&_ring), b(_b)
+        {
+            if (b.empty() || b.back() == 0)
+            {
+                throw std::invalid_argument("Divisor must have a nonzero leading coefficient.");
+            }
+            qmax = max_len >= b.size() ? max_len - b.size() + 1 : 0;
+            if (qmax <= mul_threshold || b.size() <= mul_threshold)
+            {
+                return;
+            }
+            // rev(b)^-1 mod x^qmax, transformed with room for rev(a) * rev(b)^-1 without wrapping.
+            const Poly rb(b.rbegin(), b.rend());
+            inv_hat = ring->inv_series(rb, qmax);
+            inv_hat.resize(ring->transform_size(2 * qmax - 1), 0);
+            ring->ntt.forward(inv_hat.data(), inv_hat.size());
+            // b mod x^N - 1 for N >= deg b.
+            b_hat.assign(ring->transform_size(b.size() - 1), 0);
+            for (std::size_t i = 0; i < b.size(); ++i)
+            {
+                b_hat[i % b_hat.size()] = ring->field.add(b_hat[i % b_hat.size()], b[i]);
+            }
+            ring->ntt.forward(b_hat.data(), b_hat.size());
+        }
+
+        // Quotient and remainder of a / b.
+        [[nodiscard]] auto divmod(const Poly &a) const -> std::pair<Poly, Poly>
+        {
+            if (a.size() < b.size())
+            {
+                return {{}, a};
+            }
+            const std::size_t qlen = a.size() - b.size() + 1;
+            if (qlen > qmax)
+            {
+                std::cout << "len=" << a.size() << " max_len=" << qmax + b.size() - 1 << "\n";
+                throw std::invalid_argument("Dividend is longer than the Divisor was set up for.");
+            }
+            const PrimeField &field = ring->field;
+            const NTT &ntt = ring->ntt;
+            if (inv_hat.empty() || qlen <= mul_threshold)
+            {
+                Poly q = ring->div_schoolbook(a, b);
+                const Poly qb = ring->mul(q, b);
+                Poly r(b.size() - 1);
+                for (std::size_t i = 0; i < r.size(); ++i)
+                {
+                    r[i] = field.sub(a[i], qb[i]);
+                }
+                return {q, r};
+            }
+
+            // rev(q) = rev(a) * rev(b)^-1 mod x^qlen.
+            Poly q(inv_hat.size(), 0);
+            std::copy_n(a.rbegin(), qlen, q.begin());
+            ntt.forward(q.data(), q.size());
+            for (std::size_t i = 0; i < q.size(); ++i)
+            {
+                q[i] = field.mul(q[i], inv_hat[i]);
+            }
+            ntt.inverse(q.data(), q.size());
+            q.resize(qlen);
+            std::reverse(q.begin(), q.end());
+
+            // a = q * b + r with deg r < deg b <= N: r = (a mod x^N - 1) - (q mod x^N - 1) * b_hat on [0, deg b).
+            const std::size_t size = b_hat.size();
+            Poly fq(size, 0);
+            for (std::size_t i = 0; i < qlen; ++i)
+            {
+                fq[i % size] = field.add(fq[i % size], q[i]);
+            }
+            ntt.forward(fq.data(), size);
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                fq[i] = field.mul(fq[i], b_hat[i]);
+            }
+            ntt.inverse(fq.data(), size);
+            Poly r(b.size() - 1, 0);
+            for (std::size_t i = 0; i < a.size(); ++i)
+            {
+                if (i % size < r.size())
+                {
+                    r[i % size] = field.add(r[i % size], a[i]);
+                }
+            }
+            for (std::size_t i = 0; i < r.size(); ++i)
+            {
+                r[i] = field.sub(r[i], fq[i]);
+            }
+            return {q, r};
+        }
+
+        [[nodiscard]] auto rem(const Poly &a) const -> Poly
+        {
+            return divmod(a).second;
+        }
+
+        [[nodiscard]] auto divisor() const -> const Poly &
+        {
+            return b;
+        }
+
+      private:
+        const PolyRing *ring;
+        Poly b;
+        std::size_t qmax{0};
+        Poly inv_hat; // transformed rev(b)^-1 mod x^qmax, empty for schoolbook division
+        Poly b_hat;   // transformed b mod x^N - 1
+    };
+
+    // Quotient and remainder of a / b. b must not have a zero leading coefficient.
+    [[nodiscard]] auto divmod(const Poly &a, const Poly &b) const -> std::pair<Poly, Poly>
+    {
+        return Divisor(*this, b, a.size()).divmod(a);
+    }
+
+    [[nodiscard]] auto rem(const Poly &a, const Poly &b) const -> Poly
+    {
+        return divmod(a, b).second;
+    }
+
+    // out[j] = a(xs[j]) for j < count, by Horner's rule over batches of points. xs[j] < p.
+    void eval(const Poly &a, const uint64_t *xs, uint64_t *out, const std::size_t count) const
+    {
+        Poly xs_shoup(count);
+#ifdef BR_X86_SIMD
+        const uint64_t p = field.get_p();
+        if (p < (1UL << 31U) && simd::has_avx2())
+        {
+            for (std::size_t j = 0; j < count; ++j)
+            {
+                xs_shoup[j] = (xs[j] << 32U) / p;
+            }
+            simd::shoup31_horner_avx2(a.data(), a.size(), xs, xs_shoup.data(), out, count, static_cast<uint32_t>(p));
+            return;
+        }
+#endif
+        for (std::size_t j = 0; j < count; ++j)
+        {
+            xs_shoup[j] = field.shoup(xs[j]);
+        }
+        // Independent dependency chains, one per point of a batch.
+        constexpr std::size_t batch = 8;
+        std::size_t j = 0;
+        for (; j + batch <= count; j += batch)
+        {
+            std::array<uint64_t, batch> acc{};
+            for (std::size_t i = a.size(); i-- > 0;)
+            {
+                for (std::size_t l = 0; l < batch; ++l)
+                {
+                    acc[l] = field.add(field.mul_shoup(acc[l], xs[j + l], xs_shoup[j + l]), a[i]);
+                }
+            }
+            std::copy(acc.begin(), acc.end(), out + j);
+        }
+        for (; j < count; ++j)
+        {
+            uint64_t acc = 0;
+            for (std::size_t i = a.size(); i-- > 0;)
+            {
+                acc = field.add(field.mul_shoup(acc, xs[j], xs_shoup[j]), a[i]);
+            }
+            out[j] = acc;
+        }
+    }
+
+    // out[j] = a(xs[j]) for j < count, with a subproduct tree.
+    void eval_tree(const Poly &a, const uint64_t *xs, uint64_t *out, const std::size_t count) const
+    {
+        std::size_t threshold = tree_threshold;
+#ifdef BR_X86_SIMD
+        if (field.get_p() < (1UL << 31U) && simd::has_avx2())
+        {
+            threshold = tree_threshold_avx2;
+        }
+#endif
+        if (count <= threshold || a.size() <= horner_threshold)
+        {
+            eval(a, xs, out, count);
+            return;
+        }
+        const Tree tree = build_tree(xs, count);
+        descend(tree, tree.size() - 1, 0, rem(a, tree.back()[0]), xs, out);
+    }
+
+    // The polynomial of degree < count through the points (xs[j], ys[j]). The xs must be distinct.
+    [[nodiscard]] auto interpolate(const uint64_t *xs, const uint64_t *ys, const std::size_t count) const -> Poly
+    {
+        if (count == 0)
+        {
+            return {};
+        }
+        const Tree tree = build_tree(xs, count);
+        // y_j / M'(x_j), with M the product of all (x - x_j). deg M' < deg M, so M' needs no reduction.
+        const Poly &m = tree.back()[0];
+        Poly dm(m.size() - 1);
+        for (std::size_t i = 1; i < m.size(); ++i)
+        {
+            dm[i - 1] = field.mul(m[i], i);
+        }
+        Poly w(count);
+        if (count <= horner_threshold)
+        {
+            eval(dm, xs, w.data(), count);
+        }
+        else
+        {
+            descend(tree, tree.size() - 1, 0, dm, xs, w.data());
+        }
+        field.batch_inv(w.data(), count);
+        for (std::size_t j = 0; j < count; ++j)
+        {
+            w[j] = field.mul(w[j], ys[j]);
+        }
+
+        // Combine upwards: f_node = f_left * M_right + f_right * M_left.
+        std::vector<Poly> level(count);
+        for (std::size_t j = 0; j < count; ++j)
+        {
+            level[j] = {w[j]};
+        }
+        for (std::size_t d = 0; d + 1 < tree.size(); ++d)
+        {
+            std::vector<Poly> next((level.size() + 1) / 2);
+            for (std::size_t i = 0; i < next.size(); ++i)
+            {
+                if (2 * i + 1 == level.size())
+                {
+                    next[i] = std::move(level[2 * i]);
+                    continue;
+                }
+                Poly l = mul(level[2 * i], tree[d][2 * i + 1]);
+                const Poly r = mul(level[2 * i + 1], tree[d][2 * i]);
+                l.resize(std::max(l.size(), r.size()), 0);
+                for (std::size_t t = 0; t < r.size(); ++t)
+                {
+                    l[t] = field.add(l[t], r[t]);
+                }
+                next[i] = std::move(l);
+            }
+            level = std::move(next);
+        }
+        Poly f = std::move(level[0]);
+        f.resize(count, 0);
+        return f;
+    }
+
+    [[nodiscard]] auto get_field() const -> const PrimeField &
+    {
+        return field;
+    }
+
+    [[nodiscard]] auto get_ntt() const -> const NTT &
+    {
+        return ntt;
+    }
+
+  private:
+    // tree[d][i] = product of (x - xs[j]) over the i-th group of 2^d points.
+    using Tree = std::vector<std::vector<Poly>>;
+
+    static auto ceil_pow2(const std::size_t n) -> std::size_t
+    {
+        std::size_t size = 1;
+        while (size < n)
+        {
+            size <<= 1U;
+        }
+        return size;
+    }
+
+    // Transform size for a cyclic product of len coefficients.
+    auto transform_size(const std::size_t len) const -> std::size_t
+    {
+        const std::size_t size = ceil_pow2(len);
+        if (size > ntt.get_max_size())
+        {
+            std::cout << "len=" << len << " max_size=" << ntt.get_max_size() << "\n";
+            throw std::invalid_argument("Product is longer than the NTT size.");
+        }
+        return size;
+    }
+
+    static auto truncate(const Poly &a, const std::size_t n) -> Poly
+    {
+        return Poly(a.begin(), a.begin() + static_cast<std::ptrdiff_t>(std::min(a.size(), n)));
+    }
+
+    auto mul_schoolbook(const Poly &a, const Poly &b) const -> Poly
+    {
+        const Poly &s = a.size() <= b.size() ? a : b;
+        const Poly &l = a.size() <= b.size() ? b : a;
+        std::vector<uint128_t> acc(a.size() + b.size() - 1, 0);
+        for (std::size_t i0 = 0; i0 < s.size(); i0 += lazy_run)
+        {
+            const std::size_t i1 = std::min(s.size(), i0 + std::min(lazy_run, s.size()));
+            // Each accumulator gets at most one product per row of the run; reduce before it can overflow.
+            if (i0 > 0)
+            {
+                for (auto &v : acc)
+                {
+                    v = field.reducer().calc_full(v);
+                }
+            }
+            for (std::size_t i = i0; i < i1; ++i)
+            {
+                for (std::size_t j = 0; j < l.size(); ++j)
+                {
+                    acc[i + j] += static_cast<uint128_t>(s[i]) * l[j];
+                }
+            }
+        }
+        Poly res(acc.size());
+        for (std::size_t i = 0; i < acc.size(); ++i)
+        {
+            res[i] = field.reducer().calc_full(acc[i]);
+        }
+        return res;
+    }
+
+    auto div_schoolbook(const Poly &a, const Poly &b) const -> Poly
+    {
+        const std::size_t qlen = a.size() - b.size() + 1;
+        const uint64_t lead_inv = field.inv(b.back());
+        Poly r = a;
+        Poly q(qlen);
+        for (std::size_t i = qlen; i-- > 0;)
+        {
+            const uint64_t c = field.mul(r[i + b.size() - 1], lead_inv);
+            q[i] = c;
+            if (c == 0)
+            {
+                continue;
+            }
+            const uint64_t c_shoup = field.shoup(c);
+            for (std::size_t t = 0; t < b.size(); ++t)
+            {
+                r[i + t] = field.sub(r[i + t], field.mul_shoup(b[t], c, c_shoup));
+            }
+        }
+        return q;
+    }
+
+    auto build_tree(const uint64_t *xs, const std::size_t count) const -> Tree
+    {
+        Tree tree(1);
+        tree[0].resize(count);
+        for (std::size_t j = 0; j < count; ++j)
+        {
+            tree[0][j] = {field.neg(xs[j]), 1};
+        }
+        while (tree.back().size() > 1)
+        {
+            const std::vector<Poly> &prev = tree.back();
+            std::vector<Poly> next((prev.size() + 1) / 2);
+            for (std::size_t i = 0; i < next.size(); ++i)
+            {
+                next[i] = 2 * i + 1 < prev.size() ? mul(prev[2 * i], prev[2 * i + 1]) : prev[2 * i];
+            }
+            tree.push_back(std::move(next));
+        }
+        return tree;
+    }
+
+    // Evaluate f (already reduced modulo tree[d][i]) at the points of node (d, i).
+    void descend(const Tree &tree, const std::size_t d, const std::size_t i, const Poly &f, const uint64_t *xs,
+                 uint64_t *out) const
+    {
+        const std::size_t first = i << d;
+        const std::size_t count = tree[d][i].size() - 1;
+        if (count <= horner_threshold)
+        {
+            eval(f, xs + first, out + first, count);
+            return;
+        }
+        const std::size_t child = 2 * i;
+        descend(tree, d - 1, child, rem(f, tree[d - 1][child]), xs, out);
+        if (child + 1 < tree[d - 1].size())
+        {
+            descend(tree, d - 1, child + 1, rem(f, tree[d - 1][child + 1]), xs, out);
+        }
+    }
+
+    PrimeField field;
+    NTT ntt;
+    std::size_t lazy_run{1};
+};
+
+} // namespace br
@@ -0,0 +1,224 @@
+/*
+Carter-Wegman polynomial universal hash.
+
+The message is split into little-endian blocks m_1, ..., m_L of B bytes, where B is the largest
+byte count whose values are always below the modulus. The last block is padded with a 0x01 byte,
+so messages that differ only in trailing zero bytes do not collide. The hash is
+H = k^L + m_1 * k^(L-1) + ... + m_L mod n.
+The leading k^L term makes messages of different lengths distinct polynomials.
+For distinct messages of at most L blocks the collision probability is at most L / n for a uniform key k.
+
+Blocks are consumed four at a time with the precomputed powers k^2, k^3 and k^4:
+H' = H * k^4 + m_1 * k^3 + m_2 * k^2 + m_3 * k + m_4.
+Only the first product depends on the previous state, the others can be computed in parallel.
+
+For a Carter-Wegman MAC add a fresh one-time pad to the hash: finalize(pad).
+
+Reducer can be BarrettRed128 (any modulus > 256) or MersenneRed61.
+
+References:
+https://en.wikipedia.org/wiki/Universal_hashing#Hashing_strings
+https://en.wikipedia.org/wiki/UMAC
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "libbr/br.hpp"
+
+namespace br
+{
+
+template <typename Reducer> class PolyHash
+{
+#ifdef __SIZEOF_INT128__
+    using uint128_t = unsigned __int128;
+#endif
+
+  public:
+    static constexpr std::size_t blocks_per_step = 4;
+
+    PolyHash(const Reducer &_br, const uint64_t _key) : br(_br), n(br.get_n()), key(_key)
+    {
+        if (n <= UINT8_MAX + 1)
+        {
+            std::cout << "n=" << n << "\n";
+            throw std::invalid_argument("Modulus must be > 256.");
+        }
+        if (key >= n)
+        {
+            std::cout << "key=" << key << ", n=" << n << "\n";
+            throw std::invalid_argument("Key must be less than modulus.");
+        }
+
+        std::size_t bitlen = 0;
+        while (bitlen < 64 && (n >> bitlen) != 0)
+        {
+            ++bitlen;
+        }
+        block_bytes = (bitlen - 1) / 8;
+
+        pow[0] = key;
+        for (std::size_t i = 1; i < blocks_per_step; ++i)
+        {
+            pow[i] = br.mul(pow[i - 1], key);
+        }
+
+        // A step's products and block can be summed before reducing when the sum fits in 128 bits.
+        lazy = n < (1UL << 62U);
+
+        reset();
+    }
+
+    void reset()
+    {
+        h = 1;
+        buf_len = 0;
+    }
+
+    void update(const uint8_t *data, std::size_t len)
+    {
+        // memcpy() needs a valid pointer even for 0 bytes, and update(nullptr, 0) is a valid empty update.
+        if (len == 0)
+        {
+            return;
+        }
+        const std::size_t step_bytes = blocks_per_step * block_bytes;
+
+        if (buf_len != 0)
+        {
+            const std::size_t take = std::min(len, step_bytes - buf_len);
+            std::memcpy(buf.data() + buf_len, data, take);
+            buf_len += take;
+            data += take;
+            len -= take;
+            if (buf_len < step_bytes)
+            {
+                return;
+            }
+            absorb(buf.data());
+            buf_len = 0;
+        }
+
+        while (len >= step_bytes)
+        {
+            absorb(data);
+            data += step_bytes;
+            len -= step_bytes;
+        }
+
+        std::memcpy(buf.data(), data, len);
+        buf_len = len;
+    }
+
+    [[nodiscard]] auto finalize() const -> uint64_t
+    {
+        uint64_t res = h;
+        std::size_t pos = 0;
+        for (; pos + block_bytes <= buf_len; pos += block_bytes)
+        {
+            res = add(br.mul(res, key), load(buf.data() + pos, block_bytes));
+        }
+        const std::size_t rem = buf_len - pos;
+        const uint64_t last = load(buf.data() + pos, rem) | (1UL << (8 * rem));
+        return add(br.mul(res, key), last);
+    }
+
+    // Carter-Wegman tag: hash + pad mod n, with pad < n used only once.
+    [[nodiscard]] auto finalize(const uint64_t pad) const -> uint64_t
+    {
+        return add(finalize(), pad);
+    }
+
+    // One-shot hash of a whole message.
+    [[nodiscard]] auto hash(const uint8_t *data, const std::size_t len) const -> uint64_t
+    {
+        PolyHash ph(*this);
+        ph.reset();
+        ph.update(data, len);
+        return ph.finalize();
+    }
+
+    [[nodiscard]] auto get_block_bytes() const -> std::size_t
+    {
+        return block_bytes;
+    }
+
+  private:
+    [[nodiscard]] static auto load(const uint8_t *data, const std::size_t len) -> uint64_t
+    {
+        uint64_t v = 0;
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            v |= static_cast<uint64_t>(data[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    [[nodiscard]] auto add(const uint64_t a, const uint64_t b) const -> uint64_t // a + b mod n
+    {
+        uint64_t c = a + b;
+        if (c < a || c >= n)
+        {
+            c -= n;
+        }
+        return c;
+    }
+
+    // Consume 'blocks_per_step' blocks.
+    void absorb(const uint8_t *data)
+    {
+        const std::size_t step_bytes = blocks_per_step * block_bytes;
+        const uint64_t mask = UINT64_MAX >> (64 - 8 * block_bytes);
+        std::array<uint64_t, blocks_per_step> m{};
+        for (std::size_t i = 0; i < blocks_per_step; ++i)
+        {
+            const std::size_t pos = i * block_bytes;
+            if (pos + sizeof(uint64_t) <= step_bytes)
+            {
+                // Little-endian load of a whole word, trimmed to the block size.
+                uint64_t v = 0;
+                std::memcpy(&v, data + pos, sizeof(v));
+                m[i] = v & mask;
+            }
+            else
+            {
+                m[i] = load(data + pos, block_bytes);
+            }
+        }
+
+        if (lazy)
+        {
+            const uint128_t acc = static_cast<uint128_t>(h) * pow[3] + static_cast<uint128_t>(m[0]) * pow[2] +
+                                  static_cast<uint128_t>(m[1]) * pow[1] + static_cast<uint128_t>(m[2]) * pow[0] + m[3];
+            h = br.calc_full(acc);
+        }
+        else
+        {
+            const uint64_t a = add(br.mul(h, pow[3]), br.mul(m[0], pow[2]));
+            const uint64_t b = add(br.mul(m[1], pow[1]), br.mul(m[2], pow[0]));
+            h = add(add(a, b), m[3]);
+        }
+    }
+
+    Reducer br;
+    uint64_t n;
+    uint64_t key;
+    std::size_t block_bytes{0};
+    // pow[i] = key^(i + 1) mod n
+    std::array<uint64_t, blocks_per_step> pow{};
+    bool lazy{false};
+
+    uint64_t h{1};
+    std::array<uint8_t, blocks_per_step * 8> buf{};
+    std::size_t buf_len{0};
+};
+
+} // namespace br
@@ -0,0 +1,518 @@
+/*
+Polynomial multiplication over Z_n for any 64-bit modulus n accepted by BarrettRed128.
+
+Coefficients are < n, lowest degree first.
+- schoolbook: each output coefficient is a sum of 128-bit products kept in a 192-bit accumulator
+  (128-bit sum plus a carry count), reduced once at the end as lo mod n + carries * (2^128 mod n).
+  So there is one reduction per output coefficient instead of one per product.
+- karatsuba: equal-length blocks are split recursively down to kara_threshold coefficients, where the
+  schoolbook product takes over. Karatsuba does 3 half-size products per level, Toom-3 (from toom_threshold,
+  needs gcd(n, 6) = 1 to divide by 2 and 3) does 5 third-size products. The recombination works on reduced
+  coefficients, with modular additions only (and one product by 1/3 for Toom-3).
+  Unbalanced operands are cut into blocks of the shorter length.
+  Temporaries come from the thread's Arena (see buffer.hpp), so calls do not allocate once it is warm.
+- ntt: the exact integer product is computed modulo three NTT primes p1 < p2 < p3 of 61 and 62 bits,
+  and rebuilt modulo n with Garner's mixed-radix CRT: x = r1 + p1 * t2 + p1 * p2 * t3 with t2 < p2, t3 < p3.
+  The exact coefficients are below len * n^2 < 2^(128 + 55), within p1 * p2 * p3 > 2^183.
+  mul_exact() returns those exact coefficients, as 3 limbs each, for operands of any 64-bit values: the
+  product of two big integers is then a carry propagation away.
+Method::automatic picks schoolbook below kara_threshold coefficients in the shorter operand, karatsuba up to
+ntt_threshold, and the NTT from there when it was set up.
+
+References:
+https://en.wikipedia.org/wiki/Karatsuba_algorithm
+https://en.wikipedia.org/wiki/Toom%E2%80%93Cook_multiplication (Bodrato's interpolation sequence)
+https://en.wikipedia.org/wiki/Mixed_radix#Application
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "libbr/br.hpp"
+#include "libbr/buffer.hpp"
+#include "libbr/counters.hpp"
+#include "libbr/field.hpp"
+#include "libbr/ntt.hpp"
+
+namespace br
+{
+
+class PolyMulMod
+{
+#ifdef __SIZEOF_INT128__
+    using uint128_t = unsigned __int128;
+#endif
+
+  public:
+    using Poly = std::vector<uint64_t>;
+
+    enum class Method
+    {
+        automatic,
+        schoolbook,
+        karatsuba,
+        ntt
+    };
+
+    static constexpr std::size_t kara_threshold = 64;
+    static constexpr std::size_t toom_threshold = 192;
+    static constexpr std::size_t ntt_threshold = 2048;
+    static constexpr std::array<uint64_t, 3> ntt_primes = {1945555039024054273UL, 2287828610704211969UL,
+                                                           4179340454199820289UL};
+
+    // 'max_len' bounds the product length of NTT multiplications, 0 disables the NTT.
+    explicit PolyMulMod(const uint64_t _n, const std::size_t max_len = 0) : br(_n), n(_n)
+    {
+        // 2^128 mod n = (2^64 mod n)^2 mod n, with 2^64 mod n = 2^64 - r * n.
+        const uint64_t r = UINT64_MAX / n;
+        const uint128_t c64 = static_cast<uint128_t>(UINT64_MAX - r * n) + 1;
+        c128 = br.calc_full(c64 * c64);
+        if (n % 2 != 0 && n % 3 != 0)
+        {
+            // 3 * inv3 = 1 mod n, inv3 = (n + 1) / 3 or (2n + 1) / 3.
+            inv3 = n % 3 == 2 ? n / 3 + 1 : 2 * (n / 3) + 1;
+        }
+
+        if (max_len > 0)
+        {
+            std::size_t size = 2;
+            while (size < max_len)
+            {
+                size <<= 1U;
+            }
+            for (std::size_t i = 0; i < ntt_primes.size(); ++i)
+            {
+                ntt[i] = std::make_unique<NTT>(ntt_primes[i], size);
+            }
+            const PrimeField &f2 = ntt[1]->get_field();
+            const PrimeField &f3 = ntt[2]->get_field();
+            inv_p1_p2 = f2.inv(ntt_primes[0]);
+            inv_p1_p2_shoup = f2.shoup(inv_p1_p2);
+            p1_p3 = ntt_primes[0];
+            p1_p3_shoup = f3.shoup(p1_p3);
+            inv_p1p2_p3 = f3.inv(f3.mul(ntt_primes[0], ntt_primes[1]));
+            inv_p1p2_p3_shoup = f3.shoup(inv_p1p2_p3);
+            p1_n = br.calc_full(static_cast<uint128_t>(ntt_primes[0]));
+            p1p2_n = br.calc_full(static_cast<uint128_t>(ntt_primes[0]) * ntt_primes[1]);
+        }
+    }
+
+    [[nodiscard]] auto mul(const Poly &a, const Poly &b, const Method method = Method::automatic) const -> Poly
+    {
+        if (a.empty() || b.empty())
+        {
+            return {};
+        }
+        Poly out(a.size() + b.size() - 1);
+        mul(a.data(), a.size(), b.data(), b.size(), out.data(), method);
+        return out;
+    }
+
+    // out[0 .. na + nb - 1) = a * b. 'out' must not overlap the inputs.
+    void mul(const uint64_t *a, const std::size_t na, const uint64_t *b, const std::size_t nb, uint64_t *out,
+             Method method = Method::automatic) const
+    {
+        if (na == 0 || nb == 0)
+        {
+            return;
+        }
+        counters::add(counters::Event::polymul_coefficients, na + nb - 1);
+        if (method == Method::automatic)
+        {
+            const std::size_t m = std::min(na, nb);
+            method = Method::karatsuba;
+            if (m < kara_threshold)
+            {
+                method = Method::schoolbook;
+            }
+            else if (ntt[0] && m >= ntt_threshold)
+            {
+                method = Method::ntt;
+            }
+        }
+        if (method == Method::ntt)
+        {
+            mul_ntt(a, na, b, nb, out);
+        }
+        else if (method == Method::karatsuba)
+        {
+            Arena &arena = Arena::local();
+            const Arena::Scope scope(arena);
+            mul_unbalanced(a, na, b, nb, out, arena.allocate<uint64_t>(unbalanced_scratch(na, nb)).data());
+        }
+        else
+        {
+            mul_schoolbook(a, na, b, nb, out);
+        }
+    }
+
+    // Sum of 128-bit values kept as lo + hi * 2^128, reduced modulo n.
+    [[nodiscard]] auto reduce(const uint64_t hi, const uint128_t lo) const -> uint64_t
+    {
+        uint128_t x = br.calc_full(lo);
+        if (hi != 0)
+        {
+            x += br.calc_full(static_cast<uint128_t>(hi) * c128);
+            if (x >= n)
+            {
+                x -= n;
+            }
+        }
+        return static_cast<uint64_t>(x);
+    }
+
+    // out[3 * k .. 3 * k + 3) = coefficient k of a * b as an exact integer, least significant limb first, for
+    // k < na + nb - 1 and any 64-bit a[i], b[j]. Always uses the NTT: na + nb - 1 <= max_ntt_len(), and
+    // min(na, nb) < 2^55. n plays no part.
+    void mul_exact(const uint64_t *a, const std::size_t na, const uint64_t *b, const std::size_t nb,
+                   uint64_t *out) const
+    {
+        if (na == 0 || nb == 0)
+        {
+            return;
+        }
+        // x = r1 + p1 * t2 + p1 * p2 * t3, with p1 * p2 < 2^123.
+        const uint128_t p1p2 = static_cast<uint128_t>(ntt_primes[0]) * ntt_primes[1];
+        const auto p1p2_lo = static_cast<uint64_t>(p1p2);
+        const auto p1p2_hi = static_cast<uint64_t>(p1p2 >> 64U);
+        garner(a, na, b, nb, [&](const std::size_t j, const uint64_t r1, const uint64_t t2, const uint64_t t3) {
+            const uint128_t low = static_cast<uint128_t>(ntt_primes[0]) * t2 + r1;
+            const uint128_t mid = static_cast<uint128_t>(t3) * p1p2_lo;
+            const uint128_t s0 = static_cast<uint128_t>(static_cast<uint64_t>(low)) + static_cast<uint64_t>(mid);
+            const uint128_t s1 = (s0 >> 64U) + (low >> 64U) + (mid >> 64U) + static_cast<uint128_t>(t3) * p1p2_hi;
+            out[3 * j] = static_cast<uint64_t>(s0);
+            out[3 * j + 1] = static_cast<uint64_t>(s1);
+            out[3 * j + 2] = static_cast<uint64_t>(s1 >> 64U);
+        });
+    }
+
+    [[nodiscard]] auto get_n() const -> uint64_t
+    {
+        return n;
+    }
+
+    [[nodiscard]] auto reducer() const -> const BarrettRed128 &
+    {
+        return br;
+    }
+
+    [[nodiscard]] auto max_ntt_len() const -> std::size_t
+    {
+        return ntt[0] ? ntt[0]->get_max_size() : 0;
+    }
+
+  private:
+    [[nodiscard]] auto add(const uint64_t a, const uint64_t b) const -> uint64_t
+    {
+        // Branch-free: the operands are random-looking, so a branch would mispredict half the time.
+        const uint64_t s = a + b;
+        const uint64_t wrap = static_cast<uint64_t>(s < a) | static_cast<uint64_t>(s >= n);
+        return s - (n & (0 - wrap));
+    }
+
+    [[nodiscard]] auto sub(const uint64_t a, const uint64_t b) const -> uint64_t
+    {
+        const uint64_t d = a - b;
+        return d + (n & (0 - static_cast<uint64_t>(a < b)));
+    }
+
+    // x / 2 mod n, n odd.
+    [[nodiscard]] auto half(const uint64_t x) const -> uint64_t
+    {
+        return (x >> 1U) + (((n >> 1U) + 1) & (0 - (x & 1U)));
+    }
+
+    [[nodiscard]] auto use_toom(const std::size_t m) const -> bool
+    {
+        return inv3 != 0 && m >= toom_threshold;
+    }
+
+    // Scratch words used by mul_balanced() and mul_unbalanced(), mirroring their recursion.
+    [[nodiscard]] auto balanced_scratch(const std::size_t m) const -> std::size_t
+    {
+        if (m < kara_threshold)
+        {
+            return 0;
+        }
+        if (use_toom(m))
+        {
+            const std::size_t k = (m + 2) / 3;
+            return 6 * k + 3 * (2 * k - 1) + balanced_scratch(k);
+        }
+        const std::size_t l = (m + 1) / 2;
+        return 4 * l - 1 + balanced_scratch(l);
+    }
+
+    [[nodiscard]] auto unbalanced_scratch(const std::size_t na, const std::size_t nb) const -> std::size_t
+    {
+        const std::size_t s = std::min(na, nb);
+        const std::size_t r = std::max(na, nb) % s;
+        const std::size_t full = 2 * s - 1 + balanced_scratch(s);
+        return r == 0 ? full : std::max(full, r + s - 1 + unbalanced_scratch(r, s));
+    }
+
+    // out[0 .. na + nb - 1) = a * b, with blocks of the shorter operand multiplied by mul_balanced().
+    void mul_unbalanced(const uint64_t *a, const std::size_t na, const uint64_t *b, const std::size_t nb,
+                        uint64_t *out, uint64_t *tmp) const
+    {
+        if (na < nb)
+        {
+            mul_unbalanced(b, nb, a, na, out, tmp);
+            return;
+        }
+        if (na == nb)
+        {
+            mul_balanced(a, b, na, out, tmp);
+            return;
+        }
+        std::fill(out, out + na + nb - 1, 0);
+        for (std::size_t off = 0; off < na; off += nb)
+        {
+            const std::size_t len = std::min(nb, na - off);
+            if (len == nb)
+            {
+                mul_balanced(a + off, b, nb, tmp, tmp + 2 * nb - 1);
+            }
+            else
+            {
+                mul_unbalanced(b, nb, a + off, len, tmp, tmp + len + nb - 1);
+            }
+            for (std::size_t i = 0; i < len + nb - 1; ++i)
+            {
+                out[off + i] = add(out[off + i], tmp[i]);
+            }
+        }
+    }
+
+    // out[0 .. 2m - 1) = a * b for two operands of m coefficients.
+    void mul_balanced(const uint64_t *a, const uint64_t *b, const std::size_t m, uint64_t *out, uint64_t *tmp) const
+    {
+        if (m < kara_threshold)
+        {
+            mul_schoolbook(a, m, b, m, out);
+        }
+        else if (use_toom(m))
+        {
+            mul_toom3(a, b, m, out, tmp);
+        }
+        else
+        {
+            mul_karatsuba(a, b, m, out, tmp);
+        }
+    }
+
+    // a = a0 + a1 x^l: a * b = p0 + (p1 - p0 - p2) x^l + p2 x^2l with p1 = (a0 + a1)(b0 + b1).
+    void mul_karatsuba(const uint64_t *a, const uint64_t *b, const std::size_t m, uint64_t *out,
+                       uint64_t *tmp) const
+    {
+        const std::size_t l = (m + 1) / 2;
+        const std::size_t h = m - l;
+        uint64_t *sa = tmp;
+        uint64_t *sb = sa + l;
+        uint64_t *p1 = sb + l;
+        uint64_t *rest = p1 + 2 * l - 1;
+        for (std::size_t i = 0; i < h; ++i)
+        {
+            sa[i] = add(a[i], a[l + i]);
+            sb[i] = add(b[i], b[l + i]);
+        }
+        if (h < l)
+        {
+            sa[h] = a[h];
+            sb[h] = b[h];
+        }
+        mul_balanced(sa, sb, l, p1, rest);
+        mul_balanced(a, b, l, out, rest);
+        out[2 * l - 1] = 0;
+        mul_balanced(a + l, b + l, h, out + 2 * l, rest);
+
+        const uint64_t *p0 = out;
+        const uint64_t *p2 = out + 2 * l;
+        for (std::size_t i = 0; i < 2 * l - 1; ++i)
+        {
+            const uint64_t hi = i < 2 * h - 1 ? p2[i] : 0;
+            p1[i] = sub(sub(p1[i], p0[i]), hi);
+        }
+        for (std::size_t i = 0; i < 2 * l - 1; ++i)
+        {
+            out[l + i] = add(out[l + i], p1[i]);
+        }
+    }
+
+    // a = a0 + a1 x^k + a2 x^2k, evaluated at 0, 1, -1, -2 and infinity.
+    void mul_toom3(const uint64_t *a, const uint64_t *b, const std::size_t m, uint64_t *out, uint64_t *tmp) const
+    {
+        const std::size_t k = (m + 2) / 3;
+        const std::size_t h = m - 2 * k; // length of a2 and b2, 0 < h <= k
+        const std::size_t len = 2 * k - 1;
+        uint64_t *ev = tmp; // a(1), a(-1), a(-2), b(1), b(-1), b(-2)
+        uint64_t *r1 = ev + 6 * k;
+        uint64_t *rm1 = r1 + len;
+        uint64_t *rm2 = rm1 + len;
+        uint64_t *rest = rm2 + len;
+
+        const auto evaluate = [&](const uint64_t *x, uint64_t *e) {
+            for (std::size_t i = 0; i < k; ++i)
+            {
+                const uint64_t x2 = i < h ? x[2 * k + i] : 0;
+                const uint64_t t = add(x[i], x2);
+                const uint64_t p1 = add(t, x[k + i]);
+                const uint64_t pm1 = sub(t, x[k + i]);
+                const uint64_t s = add(pm1, x2);
+                e[i] = p1;
+                e[k + i] = pm1;
+                e[2 * k + i] = sub(add(s, s), x[i]);
+            }
+        };
+        evaluate(a, ev);
+        evaluate(b, ev + 3 * k);
+
+        mul_balanced(ev, ev + 3 * k, k, r1, rest);
+        mul_balanced(ev + k, ev + 4 * k, k, rm1, rest);
+        mul_balanced(ev + 2 * k, ev + 5 * k, k, rm2, rest);
+        mul_balanced(a, b, k, out, rest);
+        std::fill(out + len, out + 4 * k, 0);
+        mul_balanced(a + 2 * k, b + 2 * k, h, out + 4 * k, rest);
+
+        const uint64_t *r0 = out;
+        const uint64_t *rinf = out + 4 * k;
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            const uint64_t vinf = i < 2 * h - 1 ? rinf[i] : 0;
+            uint64_t t3 = static_cast<uint64_t>(br.calc_full(static_cast<uint128_t>(sub(rm2[i], r1[i])) * inv3));
+            const uint64_t t1 = half(sub(r1[i], rm1[i]));
+            uint64_t t2 = sub(rm1[i], r0[i]);
+            t3 = add(half(sub(t2, t3)), add(vinf, vinf));
+            t2 = sub(add(t2, t1), vinf);
+            r1[i] = sub(t1, t3);
+            rm1[i] = t2;
+            rm2[i] = t3;
+        }
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            out[k + i] = add(out[k + i], r1[i]);
+            out[2 * k + i] = add(out[2 * k + i], rm1[i]);
+            out[3 * k + i] = add(out[3 * k + i], rm2[i]);
+        }
+    }
+
+    void mul_schoolbook(const uint64_t *a, const std::size_t na, const uint64_t *b, const std::size_t nb,
+                        uint64_t *out) const
+    {
+        for (std::size_t k = 0; k < na + nb - 1; ++k)
+        {
+            const std::size_t i0 = k >= nb ? k - nb + 1 : 0;
+            const std::size_t i1 = std::min(k + 1, na);
+            uint128_t lo = 0;
+            uint64_t hi = 0;
+            for (std::size_t i = i0; i < i1; ++i)
+            {
+                const uint128_t prod = static_cast<uint128_t>(a[i]) * b[k - i];
+                lo += prod;
+                hi += lo < prod ? 1 : 0;
+            }
+            out[k] = reduce(hi, lo);
+        }
+    }
+
+    // a * b modulo the three NTT primes, combined by Garner's mixed-radix CRT: emit(j, r1, t2, t3) gets the
+    // digits of coefficient j = r1 + p1 * t2 + p1 * p2 * t3.
+    template <typename F>
+    void garner(const uint64_t *a, const std::size_t na, const uint64_t *b, const std::size_t nb, F &&emit) const
+    {
+        const std::size_t len = na + nb - 1;
+        std::size_t size = 1;
+        while (size < len)
+        {
+            size <<= 1U;
+        }
+        if (!ntt[0] || size > ntt[0]->get_max_size())
+        {
+            std::cout << "len=" << len << " max_len=" << max_ntt_len() << "\n";
+            throw std::invalid_argument("Product is longer than the NTT size.");
+        }
+
+        // res[i] = a * b mod p_i.
+        Arena &arena = Arena::local();
+        const Arena::Scope scope(arena);
+        const std::array<Span<uint64_t>, 3> res = {arena.allocate<uint64_t>(size), arena.allocate<uint64_t>(size),
+                                                   arena.allocate<uint64_t>(size)};
+        const Span<uint64_t> fb = arena.allocate<uint64_t>(size);
+        for (std::size_t i = 0; i < ntt_primes.size(); ++i)
+        {
+            const NTT &t = *ntt[i];
+            const PrimeField &f = t.get_field();
+            const Span<uint64_t> fa = res[i];
+            std::fill(fa.begin(), fa.end(), 0);
+            std::fill(fb.begin(), fb.end(), 0);
+            // The inputs may exceed p_i (n may, and mul_exact() takes any value), so they are reduced first.
+            for (std::size_t j = 0; j < na; ++j)
+            {
+                fa[j] = f.reducer().calc_full(static_cast<uint128_t>(a[j]));
+            }
+            for (std::size_t j = 0; j < nb; ++j)
+            {
+                fb[j] = f.reducer().calc_full(static_cast<uint128_t>(b[j]));
+            }
+            t.forward(fa.data(), size);
+            t.forward(fb.data(), size);
+            for (std::size_t j = 0; j < size; ++j)
+            {
+                fa[j] = f.mul(fa[j], fb[j]);
+            }
+            t.inverse(fa.data(), size);
+        }
+
+        const PrimeField &f2 = ntt[1]->get_field();
+        const PrimeField &f3 = ntt[2]->get_field();
+        for (std::size_t j = 0; j < len; ++j)
+        {
+            // r1 < p1 < p2 < p3, and t2 < p2 < p3, so no operand needs reducing.
+            const uint64_t r1 = res[0][j];
+            const uint64_t t2 = f2.mul_shoup(f2.sub(res[1][j], r1), inv_p1_p2, inv_p1_p2_shoup);
+            const uint64_t u = f3.sub(f3.sub(res[2][j], r1), f3.mul_shoup(t2, p1_p3, p1_p3_shoup));
+            emit(j, r1, t2, f3.mul_shoup(u, inv_p1p2_p3, inv_p1p2_p3_shoup));
+        }
+    }
+
+    void mul_ntt(const uint64_t *a, const std::size_t na, const uint64_t *b, const std::size_t nb,
+                 uint64_t *out) const
+    {
+        garner(a, na, b, nb, [&](const std::size_t j, const uint64_t r1, const uint64_t t2, const uint64_t t3) {
+            uint128_t x = br.calc_full(r1);
+            x += br.calc_full(static_cast<uint128_t>(t2) * p1_n);
+            x += br.calc_full(static_cast<uint128_t>(t3) * p1p2_n);
+            while (x >= n)
+            {
+                x -= n;
+            }
+            out[j] = static_cast<uint64_t>(x);
+        });
+    }
+
+    BarrettRed128 br;
+    uint64_t n;
+    uint64_t c128{0}; // 2^128 mod n
+    uint64_t inv3{0}; // 1/3 mod n, 0 if Toom-3 is unavailable
+
+    std::array<std::unique_ptr<NTT>, 3> ntt;
+    // Garner constants.
+    uint64_t inv_p1_p2{0};
+    uint64_t inv_p1_p2_shoup{0};
+    uint64_t p1_p3{0};
+    uint64_t p1_p3_shoup{0};
+    uint64_t inv_p1p2_p3{0};
+    uint64_t inv_p1p2_p3_shoup{0};
+    uint64_t p1_n{0};
+    uint64_t p1p2_n{0};
+};
+
+} // namespace br
@@ -0,0 +1,207 @@
+/*
+Unbiased bounded random numbers.
+
+UniformMod maps 64-bit random words to [0, n) with Lemire's multiply-shift: for m = x * n,
+the result is m >> 64, and x is rejected when (m mod 2^64) < 2^64 mod n. The threshold 2^64 mod n
+is derived once from the BarrettRed64 reciprocal r = (2^64 - 1) / n as 2^64 - r * n,
+so no division is done per sample. Rejections are rare: the probability is below n / 2^64.
+
+Xoshiro256x4 runs 4 independent xoshiro256++ streams side by side, so batches of random words
+are produced with AVX2 when the CPU supports it.
+
+References:
+https://arxiv.org/abs/1805.10941
+https://prng.di.unimi.it/
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+#include "libbr/br.hpp"
+#include "libbr/simd.hpp"
+#include "libbr/util.hpp"
+
+namespace br
+{
+
+class Xoshiro256x4
+{
+  public:
+    static constexpr std::size_t lanes = 4;
+
+    explicit Xoshiro256x4(uint64_t seed)
+    {
+        // Expand the seed with splitmix64, as recommended for xoshiro.
+        for (auto &s : state)
+        {
+            seed += 0x9E3779B97F4A7C15UL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9UL;
+            z = (z ^ (z >> 27U)) * 0x94D049BB133111EBUL;
+            s = z ^ (z >> 31U);
+        }
+    }
+
+    auto operator()() -> uint64_t
+    {
+        if (pos == lanes)
+        {
+            next(buf.data(), 1);
+            pos = 0;
+        }
+        return buf[pos++];
+    }
+
+    // count random words.
+    void fill(uint64_t *out, std::size_t count)
+    {
+        while (count > 0 && pos < lanes)
+        {
+            *out++ = buf[pos++];
+            --count;
+        }
+        const std::size_t groups = count / lanes;
+        next(out, groups);
+        out += groups * lanes;
+        count -= groups * lanes;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[i] = (*this)();
+        }
+    }
+
+  private:
+    static auto rotl(const uint64_t x, const uint32_t k) -> uint64_t
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    // Writes 'groups' lane-interleaved groups of outputs.
+    void next(uint64_t *out, const std::size_t groups)
+    {
+#ifdef BR_X86_SIMD
+        if (simd::has_avx2())
+        {
+            simd::xoshiro256pp_x4_avx2(state.data(), out, groups);
+            return;
+        }
+#endif
+        uint64_t *s0 = state.data();
+        uint64_t *s1 = s0 + lanes;
+        uint64_t *s2 = s1 + lanes;
+        uint64_t *s3 = s2 + lanes;
+        for (std::size_t g = 0; g < groups; ++g)
+        {
+            for (std::size_t l = 0; l < lanes; ++l)
+            {
+                out[g * lanes + l] = rotl(s0[l] + s3[l], 23) + s0[l];
+                const uint64_t t = s1[l] << 17U;
+                s2[l] ^= s0[l];
+                s3[l] ^= s1[l];
+                s1[l] ^= s2[l];
+                s0[l] ^= s3[l];
+                s2[l] ^= t;
+                s3[l] = rotl(s3[l], 45);
+            }
+        }
+    }
+
+    // s0, s1, s2 and s3 of the 4 streams: state[4 * j + lane].
+    std::array<uint64_t, 4 * lanes> state{};
+    std::array<uint64_t, lanes> buf{};
+    std::size_t pos{lanes};
+};
+
+class UniformMod
+{
+  public:
+    explicit UniformMod(const uint64_t _n) : n(_n)
+    {
+        if (n == 0)
+        {
+            throw std::invalid_argument("Range must not be empty.");
+        }
+        // 2^64 mod n, which is 0 for powers of 2.
+        if ((n & (n - 1)) != 0)
+        {
+            const uint64_t r = BarrettRed64(n).get_r();
+            threshold = (UINT64_MAX - r * n) + 1;
+        }
+    }
+
+    // Uniform value in [0, n), drawing 64-bit words from 'rng'.
+    template <typename Rng> auto operator()(Rng &rng) const -> uint64_t
+    {
+        return map(rng(), rng);
+    }
+
+    // 'count' uniform values in [0, n).
+    void generate(Xoshiro256x4 &rng, uint64_t *out, std::size_t count) const
+    {
+        std::array<uint64_t, chunk> x{};
+        while (count > 0)
+        {
+            const std::size_t k = std::min(count, chunk);
+            rng.fill(x.data(), k);
+#ifdef BR_X86_SIMD
+            if (n <= UINT32_MAX && simd::has_avx2())
+            {
+                if (simd::lemire32_avx2(x.data(), out, k, static_cast<uint32_t>(n)))
+                {
+                    // Some word may have to be rejected: redo the chunk exactly.
+                    for (std::size_t i = 0; i < k; ++i)
+                    {
+                        out[i] = map(x[i], rng);
+                    }
+                }
+                out += k;
+                count -= k;
+                continue;
+            }
+#endif
+            for (std::size_t i = 0; i < k; ++i)
+            {
+                out[i] = map(x[i], rng);
+            }
+            out += k;
+            count -= k;
+        }
+    }
+
+    [[nodiscard]] auto get_n() const -> uint64_t
+    {
+        return n;
+    }
+
+    [[nodiscard]] auto get_threshold() const -> uint64_t
+    {
+        return threshold;
+    }
+
+  private:
+    static constexpr std::size_t chunk = 256;
+
+    template <typename Rng> auto map(uint64_t x, Rng &rng) const -> uint64_t
+    {
+        uint64_t lo = x * n;
+        if (lo < n)
+        {
+            while (lo < threshold)
+            {
+                x = rng();
+                lo = x * n;
+            }
+        }
+        return util::mulhi64(x, n);
+    }
+
+    uint64_t n;
+    uint64_t threshold{0};
+};
+
+} // namespace br
@@ -0,0 +1,313 @@
+/*
+N-th terms of linear recurrences and powers of small matrices modulo a 64-bit n.
+
+n must be accepted by BarrettRed128, which both classes use through PolyMulMod: n >= 3 and not a power of 2.
+Other moduli throw std::invalid_argument.
+
+LinearRecurrence: a_i = c_1 * a_(i-1) + ... + c_d * a_(i-d) mod n, given a_0, ..., a_(d-1).
+Kitamasa / Fiduccia: with Q(x) = x^d - c_1 x^(d-1) - ... - c_d, a_N = sum_i r_i * a_i where r = x^N mod Q.
+x^N mod Q is computed by square-and-multiply, O(M(d) log N):
+- squares with PolyMulMod (lazy schoolbook, Karatsuba / Toom-3, or three-prime NTT from
+  PolyMulMod::ntt_threshold),
+- reductions modulo Q with a precomputed inverse of the reversed Q (polynomial Barrett reduction),
+  which exists over Z_n since Q is monic: two products per reduction instead of d^2 steps.
+
+MatrixMod: k x k matrix products with one 192-bit accumulator per entry (see PolyMulMod::reduce()),
+and matrix powers by squaring.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "libbr/br.hpp"
+#include "libbr/polymul.hpp"
+
+namespace br
+{
+
+class LinearRecurrence
+{
+#ifdef __SIZEOF_INT128__
+    using uint128_t = unsigned __int128;
+#endif
+
+  public:
+    using Poly = PolyMulMod::Poly;
+
+    // coeffs = c_1, ..., c_d and init = a_0, ..., a_(d-1), all < n.
+    LinearRecurrence(const uint64_t n, Poly _coeffs, Poly _init)
+        : pm(n, _coeffs.size() >= PolyMulMod::ntt_threshold ? 2 * _coeffs.size() : 0), coeffs(std::move(_coeffs)),
+          init(std::move(_init))
+    {
+        const std::size_t d = coeffs.size();
+        if (d == 0 || init.size() != d)
+        {
+            std::cout << "order=" << d << " init=" << init.size() << "\n";
+            throw std::invalid_argument("Recurrence needs as many initial terms as coefficients.");
+        }
+
+        // rev(Q) = 1 - c_1 x - ... - c_d x^d, and its inverse modulo x^(d - 1), enough for quotients of
+        // products of length 2d - 1.
+        Poly rq(d + 1);
+        rq[0] = 1;
+        for (std::size_t i = 0; i < d; ++i)
+        {
+            rq[i + 1] = coeffs[i] == 0 ? 0 : n - coeffs[i];
+        }
+        q_low.assign(rq.rbegin(), rq.rend() - 1);
+        rq_inv = inv_series(rq, d > 1 ? d - 1 : 1);
+    }
+
+    // a_N mod n.
+    [[nodiscard]] auto term(const uint64_t N) const -> uint64_t
+    {
+        const std::size_t d = coeffs.size();
+        if (N < d)
+        {
+            return init[N];
+        }
+        const Poly r = x_pow_mod(N);
+        uint64_t hi = 0;
+        uint128_t lo = 0;
+        for (std::size_t i = 0; i < d; ++i)
+        {
+            const uint128_t prod = static_cast<uint128_t>(r[i]) * init[i];
+            lo += prod;
+            hi += lo < prod ? 1 : 0;
+        }
+        return pm.reduce(hi, lo);
+    }
+
+    // x^N mod Q, d coefficients.
+    [[nodiscard]] auto x_pow_mod(const uint64_t N) const -> Poly
+    {
+        const std::size_t d = coeffs.size();
+        Poly r(d, 0);
+        if (d == 1)
+        {
+            // Q = x - c_1, so x^N mod Q = c_1^N.
+            r[0] = pow_mod(coeffs[0], N);
+            return r;
+        }
+        r[1] = 1; // x
+        int bit = 63;
+        while (((N >> static_cast<unsigned>(bit)) & 1U) == 0)
+        {
+            --bit;
+        }
+        for (--bit; bit >= 0; --bit)
+        {
+            r = reduce(pm.mul(r, r));
+            if (((N >> static_cast<unsigned>(bit)) & 1U) != 0)
+            {
+                r = mul_x(r);
+            }
+        }
+        return r;
+    }
+
+    [[nodiscard]] auto order() const -> std::size_t
+    {
+        return coeffs.size();
+    }
+
+  private:
+    auto pow_mod(uint64_t a, uint64_t e) const -> uint64_t
+    {
+        const BarrettRed128 &br = pm.reducer();
+        uint64_t res = 1;
+        while (e != 0)
+        {
+            if ((e & 1U) != 0)
+            {
+                res = br.calc_full(static_cast<uint128_t>(res) * a);
+            }
+            a = br.calc_full(static_cast<uint128_t>(a) * a);
+            e >>= 1U;
+        }
+        return res;
+    }
+
+    // a^-1 mod x^len for a[0] = 1, by Newton iteration b = b * (2 - a * b).
+    auto inv_series(const Poly &a, const std::size_t len) const -> Poly
+    {
+        const uint64_t n = pm.get_n();
+        Poly b = {1};
+        for (std::size_t k = 1; k < len; k *= 2)
+        {
+            const std::size_t m = std::min(2 * k, len);
+            Poly ab = pm.mul(Poly(a.begin(), a.begin() + static_cast<std::ptrdiff_t>(std::min(a.size(), m))), b);
+            ab.resize(m, 0);
+            // a * b = 1 mod x^k: only the terms from k on are new.
+            Poly e(ab.begin() + static_cast<std::ptrdiff_t>(k), ab.end());
+            Poly t = pm.mul(e, b);
+            t.resize(m - k, 0);
+            b.resize(m, 0);
+            for (std::size_t i = k; i < m; ++i)
+            {
+                b[i] = t[i - k] == 0 ? 0 : n - t[i - k];
+            }
+        }
+        b.resize(len, 0);
+        return b;
+    }
+
+    // f mod Q for f of length 2d - 1 (a product of two reduced polynomials).
+    auto reduce(Poly f) const -> Poly
+    {
+        const std::size_t d = coeffs.size();
+        const uint64_t n = pm.get_n();
+        f.resize(2 * d - 1, 0);
+        // rev(quotient) = rev(f)[0 .. d - 1) * rev(Q)^-1 mod x^(d - 1).
+        const std::size_t qlen = d - 1;
+        Poly rf(f.rbegin(), f.rbegin() + static_cast<std::ptrdiff_t>(qlen));
+        Poly q = pm.mul(rf, rq_inv);
+        q.resize(qlen);
+        std::reverse(q.begin(), q.end());
+        // f - q * Q: only the low d coefficients remain, and Q = x^d + q_low there.
+        const Poly qq = pm.mul(q, q_low);
+        Poly r(f.begin(), f.begin() + static_cast<std::ptrdiff_t>(d));
+        for (std::size_t i = 0; i < d; ++i)
+        {
+            const uint64_t s = qq[i];
+            r[i] = r[i] >= s ? r[i] - s : r[i] + (n - s);
+        }
+        return r;
+    }
+
+    // x * r mod Q: shift, then fold the x^d term with x^d = c_1 x^(d-1) + ... + c_d.
+    auto mul_x(const Poly &r) const -> Poly
+    {
+        const std::size_t d = coeffs.size();
+        const BarrettRed128 &br = pm.reducer();
+        const uint64_t top = r[d - 1];
+        Poly s(d);
+        for (std::size_t i = 0; i < d; ++i)
+        {
+            const uint64_t prev = i == 0 ? 0 : r[i - 1];
+            const uint128_t v = static_cast<uint128_t>(top) * coeffs[d - 1 - i] + prev;
+            s[i] = br.calc_full(v);
+        }
+        return s;
+    }
+
+    PolyMulMod pm;
+    Poly coeffs;
+    Poly init;
+    Poly q_low; // Q - x^d, d coefficients
+    Poly rq_inv;
+};
+
+class MatrixMod
+{
+#ifdef __SIZEOF_INT128__
+    using uint128_t = unsigned __int128;
+#endif
+
+  public:
+    // Row-major k x k matrix.
+    using Matrix = std::vector<uint64_t>;
+
+    MatrixMod(const uint64_t n, const std::size_t _k) : pm(n), k(_k)
+    {
+    }
+
+    [[nodiscard]] auto identity() const -> Matrix
+    {
+        Matrix m(k * k, 0);
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            m[i * k + i] = 1;
+        }
+        return m;
+    }
+
+    // a * b, one lazy 192-bit accumulator per entry.
+    [[nodiscard]] auto mul(const Matrix &a, const Matrix &b) const -> Matrix
+    {
+        // Transposed b, so both operands are read along rows.
+        Matrix bt(k * k);
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            for (std::size_t j = 0; j < k; ++j)
+            {
+                bt[j * k + i] = b[i * k + j];
+            }
+        }
+        Matrix c(k * k);
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            for (std::size_t j = 0; j < k; ++j)
+            {
+                const uint64_t *ra = a.data() + i * k;
+                const uint64_t *rb = bt.data() + j * k;
+                uint128_t lo = 0;
+                uint64_t hi = 0;
+                for (std::size_t t = 0; t < k; ++t)
+                {
+                    const uint128_t prod = static_cast<uint128_t>(ra[t]) * rb[t];
+                    lo += prod;
+                    hi += lo < prod ? 1 : 0;
+                }
+                c[i * k + j] = pm.reduce(hi, lo);
+            }
+        }
+        return c;
+    }
+
+    // a^e by squaring.
+    [[nodiscard]] auto pow(Matrix a, uint64_t e) const -> Matrix
+    {
+        Matrix res = identity();
+        while (e != 0)
+        {
+            if ((e & 1U) != 0)
+            {
+                res = mul(res, a);
+            }
+            e >>= 1U;
+            if (e != 0)
+            {
+                a = mul(a, a);
+            }
+        }
+        return res;
+    }
+
+    // a * v for a column vector v.
+    [[nodiscard]] auto apply(const Matrix &a, const std::vector<uint64_t> &v) const -> std::vector<uint64_t>
+    {
+        std::vector<uint64_t> res(k);
+        for (std::size_t i = 0; i < k; ++i)
+        {
+            uint128_t lo = 0;
+            uint64_t hi = 0;
+            for (std::size_t t = 0; t < k; ++t)
+            {
+                const uint128_t prod = static_cast<uint128_t>(a[i * k + t]) * v[t];
+                lo += prod;
+                hi += lo < prod ? 1 : 0;
+            }
+            res[i] = pm.reduce(hi, lo);
+        }
+        return res;
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t
+    {
+        return k;
+    }
+
+  private:
+    PolyMulMod pm;
+    std::size_t k;
+};
+
+} // namespace br
@@ -0,0 +1,230 @@
+/*
+Rabin-Karp rolling hash using the Barrett reduction.
+
+The hash of a window c_0, ..., c_(w-1) is the polynomial
+H = c_0 * b^(w-1) + c_1 * b^(w-2) + ... + c_(w-1) mod n.
+Sliding the window by one byte is H' = H * b - c_out * b^w + c_in mod n,
+where 'c_out * b^w' is taken from a table precomputed for every byte value.
+
+References:
+https://en.wikipedia.org/wiki/Rolling_hash#Polynomial_rolling_hash
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include "libbr/br.hpp"
+
+namespace br
+{
+
+class RollingHash
+{
+#ifdef __SIZEOF_INT128__
+    using uint128_t = unsigned __int128;
+#endif
+
+  public:
+    // Independent windows hashed in an interleaved fashion by hash_windows().
+    static constexpr std::size_t lanes = 4;
+
+    RollingHash(const uint64_t _n, const uint64_t _base, const std::size_t _window)
+        : br(_n), n(_n), base(_base), window(_window)
+    {
+        if (n <= UINT8_MAX + 1)
+        {
+            std::cout << "n=" << n << "\n";
+            throw std::invalid_argument("Modulus must be > 256.");
+        }
+        if (base < 2 || base >= n)
+        {
+            std::cout << "base=" << base << ", n=" << n << "\n";
+            throw std::invalid_argument("Base must be in [2, modulus).");
+        }
+        if (window == 0)
+        {
+            throw std::invalid_argument("Window must not be empty.");
+        }
+
+        // base^window mod n
+        uint64_t base_w = 1;
+        for (std::size_t i = 0; i < window; ++i)
+        {
+            base_w = br.mul(base_w, base);
+        }
+
+        // drop[c] = -c * base^window mod n
+        for (std::size_t c = 0; c < drop.size(); ++c)
+        {
+            const uint64_t cb = br.mul(c, base_w);
+            drop[c] = cb == 0 ? 0 : n - cb;
+        }
+    }
+
+    // Hash of 'len' bytes using Horner's rule.
+    [[nodiscard]] auto hash(const uint8_t *data, const std::size_t len) const -> uint64_t
+    {
+        uint64_t h = 0;
+        for (std::size_t i = 0; i < len; ++i)
+        {
+            h = step(h, data[i]);
+        }
+        return h;
+    }
+
+    // Hash of the window starting at 'data'.
+    [[nodiscard]] auto hash(const uint8_t *data) const -> uint64_t
+    {
+        return hash(data, window);
+    }
+
+    // Slide the window one byte forward: 'out' leaves it, 'in' enters it.
+    [[nodiscard]] auto roll(const uint64_t h, const uint8_t out, const uint8_t in) const -> uint64_t
+    {
+        // h * b + (n - c_out * b^w) + c_in < n^2 + n + 256 always fits in 128 bits.
+        return br.calc_full(static_cast<uint128_t>(h) * base + drop[out] + in);
+    }
+
+    // Hashes of every window in data[0..len): 'out' receives 'len - window + 1' values.
+    // The output range is split into 'lanes' contiguous segments that are rolled in lockstep,
+    // so the multiply-reduce dependency chains of the segments overlap.
+    void hash_windows(const uint8_t *data, const std::size_t len, uint64_t *out) const
+    {
+        if (len < window)
+        {
+            return;
+        }
+        const std::size_t count = len - window + 1;
+        const std::size_t seg = count / lanes;
+
+        std::array<uint64_t, lanes> h{};
+        if (seg > 1)
+        {
+            for (std::size_t l = 0; l < lanes; ++l)
+            {
+                h[l] = hash(data + l * seg);
+                out[l * seg] = h[l];
+            }
+            for (std::size_t i = 1; i < seg; ++i)
+            {
+                for (std::size_t l = 0; l < lanes; ++l)
+                {
+                    const std::size_t pos = l * seg + i;
+                    h[l] = roll(h[l], data[pos - 1], data[pos - 1 + window]);
+                    out[pos] = h[l];
+                }
+            }
+        }
+
+        // Tail that did not fill a whole segment.
+        std::size_t pos = seg > 1 ? lanes * seg : 0;
+        if (pos == count)
+        {
+            return;
+        }
+        uint64_t t = hash(data + pos);
+        out[pos] = t;
+        for (++pos; pos < count; ++pos)
+        {
+            t = roll(t, data[pos - 1], data[pos - 1 + window]);
+            out[pos] = t;
+        }
+    }
+
+    [[nodiscard]] auto get_n() const -> uint64_t
+    {
+        return n;
+    }
+
+    [[nodiscard]] auto get_base() const -> uint64_t
+    {
+        return base;
+    }
+
+    [[nodiscard]] auto get_window() const -> std::size_t
+    {
+        return window;
+    }
+
+  private:
+    [[nodiscard]] auto step(const uint64_t h, const uint8_t c) const -> uint64_t
+    {
+        return br.calc_full(static_cast<uint128_t>(h) * base + c);
+    }
+
+    BarrettRed128 br;
+    uint64_t n;
+    uint64_t base;
+    std::size_t window;
+    std::array<uint64_t, UINT8_MAX + 1> drop{};
+};
+
+// K rolling hashes with independent moduli evaluated over the same windows, for collision resistance.
+// Window i of hash_windows() is stored in out[i * K .. i * K + K).
+template <std::size_t K> class MultiRollingHash
+{
+  public:
+    MultiRollingHash(const std::array<uint64_t, K> &moduli, const std::array<uint64_t, K> &bases,
+                     const std::size_t window)
+        : hashes(make(moduli, bases, window, std::make_index_sequence<K>{}))
+    {
+    }
+
+    [[nodiscard]] auto hash(const uint8_t *data) const -> std::array<uint64_t, K>
+    {
+        std::array<uint64_t, K> res{};
+        for (std::size_t k = 0; k < K; ++k)
+        {
+            res[k] = hashes[k].hash(data);
+        }
+        return res;
+    }
+
+    void hash_windows(const uint8_t *data, const std::size_t len, uint64_t *out) const
+    {
+        const std::size_t window = hashes[0].get_window();
+        if (len < window)
+        {
+            return;
+        }
+        const std::size_t count = len - window + 1;
+
+        std::array<uint64_t, K> h = hash(data);
+        for (std::size_t k = 0; k < K; ++k)
+        {
+            out[k] = h[k];
+        }
+        for (std::size_t pos = 1; pos < count; ++pos)
+        {
+            // The K chains are independent, which keeps the multipliers busy.
+            for (std::size_t k = 0; k < K; ++k)
+            {
+                h[k] = hashes[k].roll(h[k], data[pos - 1], data[pos - 1 + window]);
+                out[pos * K + k] = h[k];
+            }
+        }
+    }
+
+    [[nodiscard]] auto get(const std::size_t k) const -> const RollingHash &
+    {
+        return hashes[k];
+    }
+
+  private:
+    template <std::size_t... I>
+    static auto make(const std::array<uint64_t, K> &moduli, const std::array<uint64_t, K> &bases,
+                     const std::size_t window, std::index_sequence<I...> /*unused*/) -> std::array<RollingHash, K>
+    {
+        return {RollingHash(moduli[I], bases[I], window)...};
+    }
+
+    std::array<RollingHash, K> hashes;
+};
+
+} // namespace br
@@ -0,0 +1,203 @@
+/*
+Batched Shamir secret sharing over a prime field GF(p), p < 2^63.
+
+Each secret s is hidden as f(0) of a random polynomial f(x) = s + a_1 x + ... + a_{t-1} x^{t-1},
+and share j is f(j + 1). Any t shares give back s = sum_i L_i(0) * f(x_i), L_i being the Lagrange basis
+of the share points.
+
+Secrets are processed in batches, stored as arrays (one array per share, one entry per secret),
+so every step is a multiply-accumulate by a constant over a whole array: PrimeField::mul_add_const(),
+which runs 4 secrets at a time with AVX2: with 32-bit products for p < 2^31, and with 64-bit products built
+from 32-bit ones above, which gains much less. Without AVX2 it is a tight Shoup product loop.
+- split: the powers x_j^i and their Shoup quotients are precomputed, so share j is the Vandermonde
+  row (1, x_j, ..., x_j^{t-1}) applied to the secrets and coefficient arrays.
+- combine: the Lagrange coefficients L_i(0) for a fixed set of share indices are precomputed in a Combiner.
+
+The random coefficients must be uniform in [0, p) and unpredictable: pass them in from a cryptographic
+source. The split() overload that draws them from a Xoshiro256x4 is for testing and benchmarking only.
+
+References:
+https://en.wikipedia.org/wiki/Shamir%27s_secret_sharing
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include "libbr/counters.hpp"
+#include "libbr/field.hpp"
+#include "libbr/random.hpp"
+
+namespace br
+{
+
+class Shamir
+{
+  public:
+    // 'threshold' shares out of 'shares' recover a secret.
+    Shamir(const uint64_t p, const std::size_t _threshold, const std::size_t _shares)
+        : field(p), threshold(_threshold), shares(_shares)
+    {
+        if (threshold == 0 || threshold > shares)
+        {
+            std::cout << "threshold=" << threshold << " shares=" << shares << "\n";
+            throw std::invalid_argument("Threshold must be in [1, shares].");
+        }
+        if (shares >= p)
+        {
+            std::cout << "p=" << p << " shares=" << shares << "\n";
+            throw std::invalid_argument("Share count must be < p.");
+        }
+
+        // pow[j * threshold + i] = x_j^i, x_j = j + 1.
+        pow.resize(shares * threshold);
+        pow_shoup.resize(shares * threshold);
+        for (std::size_t j = 0; j < shares; ++j)
+        {
+            uint64_t x = 1;
+            for (std::size_t i = 0; i < threshold; ++i)
+            {
+                pow[j * threshold + i] = x;
+                pow_shoup[j * threshold + i] = field.shoup(x);
+                x = field.mul(x, j + 1);
+            }
+        }
+    }
+
+    // Reconstructs secrets from a fixed set of 'threshold' share indices.
+    class Combiner
+    {
+      public:
+        Combiner(const Shamir &shamir, const std::size_t *ids) : field(shamir.field), count(shamir.threshold)
+        {
+            std::vector<uint64_t> xs(count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                if (ids[i] >= shamir.shares)
+                {
+                    std::cout << "id=" << ids[i] << " shares=" << shamir.shares << "\n";
+                    throw std::invalid_argument("Share index out of range.");
+                }
+                xs[i] = ids[i] + 1;
+            }
+            const uint64_t zero = 0;
+            coef.resize(count);
+            coef_shoup.resize(count);
+            field.lagrange(xs.data(), count, &zero, 1, coef.data());
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                coef_shoup[i] = field.shoup(coef[i]);
+            }
+        }
+
+        // secrets[c] from shares[i][c], shares[i] being the array of share ids[i].
+        void combine(const uint64_t *const *shares, uint64_t *secrets, const std::size_t len) const
+        {
+            counters::add(counters::Event::shamir_combined, len);
+            for (std::size_t off = 0; off < len; off += block)
+            {
+                const std::size_t n = std::min(block, len - off);
+                std::fill(secrets + off, secrets + off + n, 0);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    field.mul_add_const(shares[i] + off, secrets + off, n, coef[i], coef_shoup[i]);
+                }
+            }
+        }
+
+        // L_i(0) for the i-th share index.
+        [[nodiscard]] auto coefficient(const std::size_t i) const -> uint64_t
+        {
+            return coef[i];
+        }
+
+      private:
+        PrimeField field;
+        std::size_t count;
+        std::vector<uint64_t> coef;
+        std::vector<uint64_t> coef_shoup;
+    };
+
+    // out[j][c] = share j of secrets[c], for secrets[c] < p. coeffs[i - 1][c] is the coefficient a_i of
+    // secret c, for 1 <= i < threshold, each uniform in [0, p).
+    void split(const uint64_t *secrets, const uint64_t *const *coeffs, uint64_t *const *out,
+               const std::size_t len) const
+    {
+        counters::add(counters::Event::shamir_shares, shares * len);
+        for (std::size_t off = 0; off < len; off += block)
+        {
+            const std::size_t n = std::min(block, len - off);
+            for (std::size_t j = 0; j < shares; ++j)
+            {
+                // The x^0 term is the secret itself.
+                std::copy(secrets + off, secrets + off + n, out[j] + off);
+                for (std::size_t i = 1; i < threshold; ++i)
+                {
+                    field.mul_add_const(coeffs[i - 1] + off, out[j] + off, n, pow[j * threshold + i],
+                                        pow_shoup[j * threshold + i]);
+                }
+            }
+        }
+    }
+
+    // split() with coefficients drawn from 'rng'. Not for real secrets: xoshiro is predictable.
+    void split(const uint64_t *secrets, uint64_t *const *out, const std::size_t len, Xoshiro256x4 &rng) const
+    {
+        const UniformMod uniform(field.get_p());
+        std::vector<uint64_t> buf((threshold - 1) * block);
+        std::vector<const uint64_t *> coeffs(threshold);
+        std::vector<uint64_t *> dst(shares);
+        for (std::size_t off = 0; off < len; off += block)
+        {
+            const std::size_t n = std::min(block, len - off);
+            for (std::size_t i = 0; i + 1 < threshold; ++i)
+            {
+                uniform.generate(rng, buf.data() + i * n, n);
+                coeffs[i] = buf.data() + i * n;
+            }
+            for (std::size_t j = 0; j < shares; ++j)
+            {
+                dst[j] = out[j] + off;
+            }
+            split(secrets + off, coeffs.data(), dst.data(), n);
+        }
+    }
+
+    // Evaluation point of share j.
+    [[nodiscard]] static auto point(const std::size_t j) -> uint64_t
+    {
+        return j + 1;
+    }
+
+    [[nodiscard]] auto get_threshold() const -> std::size_t
+    {
+        return threshold;
+    }
+
+    [[nodiscard]] auto get_shares() const -> std::size_t
+    {
+        return shares;
+    }
+
+    [[nodiscard]] auto get_field() const -> const PrimeField &
+    {
+        return field;
+    }
+
+  private:
+    // Secrets processed together, so the arrays being combined stay in L1.
+    static constexpr std::size_t block = 1024;
+
+    PrimeField field;
+    std::size_t threshold;
+    std::size_t shares;
+    std::vector<uint64_t> pow;
+    std::vector<uint64_t> pow_shoup;
+};
+
+} // namespace br
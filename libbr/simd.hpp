@@ -0,0 +1,516 @@
+/*
+SIMD kernels and runtime CPU feature detection.
+
+Kernels are compiled with per-function target attributes, so the library does not need to be built
+with -mavx2. Callers check has_avx2() before using them.
+Defining BR_NO_SIMD leaves the kernels out, as on other targets, so the scalar paths can be tested on x86-64.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "libbr/util.hpp"
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(BR_NO_SIMD)
+#define BR_X86_SIMD 1
+#define BR_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#endif
+
+namespace br::simd
+{
+
+#ifdef BR_X86_SIMD
+
+static inline auto has_avx2() -> bool
+{
+    static const bool res = __builtin_cpu_supports("avx2") != 0;
+    return res;
+}
+
+// out[i] = x[i] mod n, 8 lanes at a time. Same algorithm as BarrettRed32::calc().
+// Returns false if some x[i] >= n2, where n2 = n^2 when n^2 fits in 32 bits and 0 otherwise.
+BR_TARGET_AVX2 static inline auto barrett32_avx2(const uint32_t *x, uint32_t *out, const std::size_t count,
+                                                 const uint32_t n, const uint32_t r, const uint32_t n2) -> bool
+{
+    const __m256i vn = _mm256_set1_epi32(static_cast<int>(n));
+    const __m256i vr = _mm256_set1_epi32(static_cast<int>(r));
+    const __m256i vn2 = _mm256_set1_epi32(static_cast<int>(n2));
+    __m256i bad = _mm256_setzero_si256();
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+        if (n2 != 0)
+        {
+            // x >= n2 <=> max(x, n2) == x
+            bad = _mm256_or_si256(bad, _mm256_cmpeq_epi32(_mm256_max_epu32(vx, vn2), vx));
+        }
+
+        // q = (x * r) >> 32, even and odd lanes separately.
+        const __m256i xr_even = _mm256_mul_epu32(vx, vr);
+        const __m256i xr_odd = _mm256_mul_epu32(_mm256_srli_epi64(vx, 32), vr);
+        const __m256i q = _mm256_blend_epi32(_mm256_srli_epi64(xr_even, 32), xr_odd, 0xAA);
+
+        // x - q * n, then subtract n once more if needed.
+        const __m256i t = _mm256_sub_epi32(vx, _mm256_mullo_epi32(q, vn));
+        const __m256i res = _mm256_min_epu32(t, _mm256_sub_epi32(t, vn));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), res);
+    }
+
+    bool ok = _mm256_testz_si256(bad, bad) != 0;
+    for (; i < count; ++i)
+    {
+        if (n2 != 0 && x[i] >= n2)
+        {
+            ok = false;
+        }
+        const uint32_t q = (static_cast<uint64_t>(x[i]) * r) >> 32U;
+        uint32_t t = x[i] - q * n;
+        if (t >= n)
+        {
+            t -= n;
+        }
+        out[i] = t;
+    }
+    return ok;
+}
+
+// out[i] = a[i] * b mod n, 8 lanes at a time, with b_prep = Plantard32::prepare(b). Same algorithm as
+// Plantard32::mul(). Returns false if some a[i] >= n while any_input is false.
+BR_TARGET_AVX2 static inline auto plantard32_avx2(const uint32_t *a, uint32_t *out, const std::size_t count,
+                                                  const uint32_t n, const uint64_t b_prep, const bool any_input)
+    -> bool
+{
+    const __m256i vn = _mm256_set1_epi32(static_cast<int>(n));
+    const __m256i vb_lo = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(b_prep)));
+    const __m256i vb_hi = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(b_prep >> 32U)));
+    const __m256i ones = _mm256_set1_epi32(1);
+    __m256i bad = _mm256_setzero_si256();
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        if (!any_input)
+        {
+            // a >= n <=> max(a, n) == a
+            bad = _mm256_or_si256(bad, _mm256_cmpeq_epi32(_mm256_max_epu32(va, vn), va));
+        }
+
+        // (a * b_prep mod 2^64) >> 32 = ((a * b_lo) >> 32) + a * b_hi mod 2^32.
+        const __m256i p_even = _mm256_mul_epu32(va, vb_lo);
+        const __m256i p_odd = _mm256_mul_epu32(_mm256_srli_epi64(va, 32), vb_lo);
+        const __m256i t_hi = _mm256_add_epi32(_mm256_blend_epi32(_mm256_srli_epi64(p_even, 32), p_odd, 0xAA),
+                                              _mm256_mullo_epi32(va, vb_hi));
+
+        // ((t_hi + 1) * n) >> 32. t_hi + 1 does not wrap to 0 within the range of the method.
+        const __m256i u = _mm256_add_epi32(t_hi, ones);
+        const __m256i r_even = _mm256_mul_epu32(u, vn);
+        const __m256i r_odd = _mm256_mul_epu32(_mm256_srli_epi64(u, 32), vn);
+        const __m256i res = _mm256_blend_epi32(_mm256_srli_epi64(r_even, 32), r_odd, 0xAA);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), res);
+    }
+
+    bool ok = _mm256_testz_si256(bad, bad) != 0;
+    for (; i < count; ++i)
+    {
+        if (!any_input && a[i] >= n)
+        {
+            ok = false;
+        }
+        const uint64_t t = static_cast<uint64_t>(a[i]) * b_prep;
+        out[i] = static_cast<uint32_t>((((t >> 32U) + 1) * n) >> 32U);
+    }
+    return ok;
+}
+
+// Running sums over 'len' bytes, a multiple of 32: s1 += data[i], s2 += s1, as in Adler-32 and Fletcher-16.
+// Results are left unreduced in 8 lanes each; their lane sums are the totals.
+// The caller bounds 'len' so that the totals fit in 32 bits.
+BR_TARGET_AVX2 static inline void byte_sums_avx2(const uint8_t *data, const std::size_t len, const uint32_t s1,
+                                                 const uint32_t s2, uint32_t *s1_lanes, uint32_t *s2_lanes)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15,
+                                             14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    __m256i vs1 = _mm256_setr_epi32(static_cast<int>(s1), 0, 0, 0, 0, 0, 0, 0);
+    __m256i vs2 = _mm256_setr_epi32(static_cast<int>(s2), 0, 0, 0, 0, 0, 0, 0);
+    // Sum of s1 at the start of every 32-byte block; each of them is added 32 times to s2.
+    __m256i vs1_blocks = zero;
+
+    for (std::size_t i = 0; i < len; i += 32)
+    {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        vs1_blocks = _mm256_add_epi32(vs1_blocks, vs1);
+        vs1 = _mm256_add_epi32(vs1, _mm256_sad_epu8(v, zero));
+        // Within a block byte j is added to s2 '32 - j' times.
+        vs2 = _mm256_add_epi32(vs2, _mm256_madd_epi16(_mm256_maddubs_epi16(v, weights), ones));
+    }
+    vs2 = _mm256_add_epi32(vs2, _mm256_slli_epi32(vs1_blocks, 5));
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(s1_lanes), vs1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(s2_lanes), vs2);
+}
+
+// High 64 bits of a * b for 4 lanes, with b split into 32-bit halves b_lo and b_hi.
+BR_TARGET_AVX2 static inline auto mulhi64_avx2(const __m256i a, const __m256i b_lo, const __m256i b_hi) -> __m256i
+{
+    const __m256i lo_mask = _mm256_set1_epi64x(UINT32_MAX);
+    const __m256i a_hi = _mm256_srli_epi64(a, 32);
+    const __m256i p00 = _mm256_mul_epu32(a, b_lo);
+    const __m256i p01 = _mm256_mul_epu32(a, b_hi);
+    const __m256i p10 = _mm256_mul_epu32(a_hi, b_lo);
+    const __m256i p11 = _mm256_mul_epu32(a_hi, b_hi);
+    const __m256i mid = _mm256_add_epi64(_mm256_add_epi64(_mm256_srli_epi64(p00, 32), _mm256_and_si256(p01, lo_mask)),
+                                         _mm256_and_si256(p10, lo_mask));
+    return _mm256_add_epi64(_mm256_add_epi64(p11, _mm256_srli_epi64(mid, 32)),
+                            _mm256_add_epi64(_mm256_srli_epi64(p01, 32), _mm256_srli_epi64(p10, 32)));
+}
+
+// Low 32 bits of 4 64-bit lanes, stored as 4 consecutive 32-bit values.
+BR_TARGET_AVX2 static inline void store_lo32_avx2(uint32_t *out, const __m256i v)
+{
+    const __m256i packed = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm256_castsi256_si128(packed));
+}
+
+// out[i] = x[i] mod n for any 64-bit x[i] and 32-bit n, 4 lanes at a time.
+// Same algorithm as BarrettRed64::calc_full(), with r = (2^64 - 1) / n.
+BR_TARGET_AVX2 static inline void barrett64_mod32_avx2(const uint64_t *x, uint32_t *out, const std::size_t count,
+                                                       const uint32_t n, const uint64_t r)
+{
+    const __m256i vn = _mm256_set1_epi64x(n);
+    const __m256i r_lo = _mm256_set1_epi64x(static_cast<int64_t>(r & UINT32_MAX));
+    const __m256i r_hi = _mm256_set1_epi64x(static_cast<int64_t>(r >> 32U));
+
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+        const __m256i q = mulhi64_avx2(vx, r_lo, r_hi);
+        // Only the low 64 bits of q * n are needed, and n has 32 bits.
+        const __m256i q_hi_n = _mm256_mul_epu32(_mm256_srli_epi64(q, 32), vn);
+        const __m256i qn = _mm256_add_epi64(_mm256_mul_epu32(q, vn), _mm256_slli_epi64(q_hi_n, 32));
+        // t < 2n < 2^33, so the signed comparison is exact.
+        const __m256i t = _mm256_sub_epi64(vx, qn);
+        const __m256i lt = _mm256_cmpgt_epi64(vn, t);
+        store_lo32_avx2(out + i, _mm256_sub_epi64(t, _mm256_andnot_si256(lt, vn)));
+    }
+    for (; i < count; ++i)
+    {
+        const uint64_t q = util::mulhi64(x[i], r);
+        uint64_t t = x[i] - q * n;
+        if (t >= n)
+        {
+            t -= n;
+        }
+        out[i] = static_cast<uint32_t>(t);
+    }
+}
+
+// out[i] = (x[i] * n) >> 64 for 32-bit n, 4 lanes at a time: a fair map of 64-bit hashes to [0, n).
+BR_TARGET_AVX2 static inline void mulshift32_avx2(const uint64_t *x, uint32_t *out, const std::size_t count,
+                                                  const uint32_t n)
+{
+    const __m256i vn = _mm256_set1_epi64x(n);
+
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+        const __m256i lo = _mm256_srli_epi64(_mm256_mul_epu32(vx, vn), 32);
+        const __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(vx, 32), vn);
+        store_lo32_avx2(out + i, _mm256_srli_epi64(_mm256_add_epi64(hi, lo), 32));
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = static_cast<uint32_t>(util::mulhi64(x[i], n));
+    }
+}
+
+// Lemire's multiply-shift for 32-bit n: out[i] = (x[i] * n) >> 64, 4 lanes at a time.
+// Returns true if for some i the low half (x[i] * n) mod 2^64 is < n, i.e. a candidate for rejection.
+BR_TARGET_AVX2 static inline auto lemire32_avx2(const uint64_t *x, uint64_t *out, const std::size_t count,
+                                                const uint32_t n) -> bool
+{
+    const __m256i vn = _mm256_set1_epi64x(n);
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i vn_signed = _mm256_xor_si256(vn, sign);
+    __m256i low = _mm256_setzero_si256();
+
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+        const __m256i p_lo = _mm256_mul_epu32(vx, vn);
+        const __m256i p_hi = _mm256_mul_epu32(_mm256_srli_epi64(vx, 32), vn);
+        const __m256i hi = _mm256_srli_epi64(_mm256_add_epi64(p_hi, _mm256_srli_epi64(p_lo, 32)), 32);
+        const __m256i lo = _mm256_add_epi64(p_lo, _mm256_slli_epi64(p_hi, 32));
+        // Unsigned lo < n as a signed comparison with the sign bits flipped.
+        low = _mm256_or_si256(low, _mm256_cmpgt_epi64(vn_signed, _mm256_xor_si256(lo, sign)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), hi);
+    }
+
+    bool any_low = _mm256_testz_si256(low, low) == 0;
+    for (; i < count; ++i)
+    {
+        out[i] = util::mulhi64(x[i], n);
+        any_low = any_low || x[i] * n < n;
+    }
+    return any_low;
+}
+
+// xoshiro256++ on 4 independent streams. 'state' holds s0, s1, s2, s3 for the 4 streams: state[4 * j + lane].
+// Writes 4 * groups outputs, lane-interleaved.
+BR_TARGET_AVX2 static inline void xoshiro256pp_x4_avx2(uint64_t *state, uint64_t *out, const std::size_t groups)
+{
+    __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state));
+    __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state + 4));
+    __m256i s2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state + 8));
+    __m256i s3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(state + 12));
+
+    for (std::size_t g = 0; g < groups; ++g)
+    {
+        const __m256i sum = _mm256_add_epi64(s0, s3);
+        const __m256i res =
+            _mm256_add_epi64(_mm256_or_si256(_mm256_slli_epi64(sum, 23), _mm256_srli_epi64(sum, 41)), s0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 4 * g), res);
+
+        const __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state), s0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state + 4), s1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state + 8), s2);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(state + 12), s3);
+}
+
+// acc[i] = acc[i] + x[i] * w mod p for p < 2^31 and x[i], acc[i] < p held in 64-bit lanes, 4 lanes at a time.
+// Shoup multiplication with the 32-bit quotient w_shoup = floor(w * 2^32 / p).
+BR_TARGET_AVX2 static inline void shoup31_mul_add_avx2(const uint64_t *x, uint64_t *acc, const std::size_t count,
+                                                       const uint32_t w, const uint32_t w_shoup, const uint32_t p)
+{
+    const __m256i vw = _mm256_set1_epi64x(w);
+    const __m256i vws = _mm256_set1_epi64x(w_shoup);
+    const __m256i vp = _mm256_set1_epi64x(p);
+
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+        const __m256i q = _mm256_srli_epi64(_mm256_mul_epu32(vx, vws), 32);
+        // Values are < 2^33, so signed comparisons are exact.
+        __m256i r = _mm256_sub_epi64(_mm256_mul_epu32(vx, vw), _mm256_mul_epu32(q, vp));
+        r = _mm256_sub_epi64(r, _mm256_andnot_si256(_mm256_cmpgt_epi64(vp, r), vp));
+        r = _mm256_add_epi64(r, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + i)));
+        r = _mm256_sub_epi64(r, _mm256_andnot_si256(_mm256_cmpgt_epi64(vp, r), vp));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + i), r);
+    }
+    for (; i < count; ++i)
+    {
+        const uint64_t q = (x[i] * w_shoup) >> 32U;
+        uint64_t r = x[i] * w - q * p;
+        if (r >= p)
+        {
+            r -= p;
+        }
+        r += acc[i];
+        if (r >= p)
+        {
+            r -= p;
+        }
+        acc[i] = r;
+    }
+}
+
+// Low 64 bits of a * b for 4 lanes, with b split into 32-bit halves b_lo and b_hi.
+BR_TARGET_AVX2 static inline auto mullo64_avx2(const __m256i a, const __m256i b_lo, const __m256i b_hi) -> __m256i
+{
+    const __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b_lo), _mm256_mul_epu32(a, b_hi));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b_lo), _mm256_slli_epi64(cross, 32));
+}
+
+// acc[i] = acc[i] + x[i] * w mod p for p < 2^63 and x[i], acc[i] < p, 4 lanes at a time.
+// Same algorithm as util::shoup_mul(), with w_shoup = floor(w * 2^64 / p). AVX2 has no 64-bit multiplication,
+// so the products are built from 32-bit ones. Both corrections subtract p and add it back when the result is
+// negative, which the signed comparison tells since the values are within (-p, p).
+BR_TARGET_AVX2 static inline void shoup63_mul_add_avx2(const uint64_t *x, uint64_t *acc, const std::size_t count,
+                                                       const uint64_t w, const uint64_t w_shoup, const uint64_t p)
+{
+    const __m256i w_lo = _mm256_set1_epi64x(static_cast<int64_t>(w & UINT32_MAX));
+    const __m256i w_hi = _mm256_set1_epi64x(static_cast<int64_t>(w >> 32U));
+    const __m256i ws_lo = _mm256_set1_epi64x(static_cast<int64_t>(w_shoup & UINT32_MAX));
+    const __m256i ws_hi = _mm256_set1_epi64x(static_cast<int64_t>(w_shoup >> 32U));
+    const __m256i p_lo = _mm256_set1_epi64x(static_cast<int64_t>(p & UINT32_MAX));
+    const __m256i p_hi = _mm256_set1_epi64x(static_cast<int64_t>(p >> 32U));
+    const __m256i vp = _mm256_set1_epi64x(static_cast<int64_t>(p));
+    const __m256i zero = _mm256_setzero_si256();
+
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m256i vx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+        const __m256i q = mulhi64_avx2(vx, ws_lo, ws_hi);
+        __m256i r = _mm256_sub_epi64(_mm256_sub_epi64(mullo64_avx2(vx, w_lo, w_hi), mullo64_avx2(q, p_lo, p_hi)), vp);
+        r = _mm256_add_epi64(r, _mm256_and_si256(_mm256_cmpgt_epi64(zero, r), vp));
+        r = _mm256_sub_epi64(_mm256_add_epi64(r, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + i))), vp);
+        r = _mm256_add_epi64(r, _mm256_and_si256(_mm256_cmpgt_epi64(zero, r), vp));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + i), r);
+    }
+    for (; i < count; ++i)
+    {
+        const uint64_t r = acc[i] + util::shoup_mul(x[i], w, w_shoup, p) - p;
+        acc[i] = r + (p & (0 - (r >> 63U)));
+    }
+}
+
+// acc * x + c mod p for p < 2^31 and acc, x, c < p in 64-bit lanes, with xs = floor(x * 2^32 / p) (Shoup).
+BR_TARGET_AVX2 static inline auto shoup31_mul_add_step_avx2(const __m256i acc, const __m256i x, const __m256i xs,
+                                                            const __m256i c, const __m256i p) -> __m256i
+{
+    const __m256i q = _mm256_srli_epi64(_mm256_mul_epu32(acc, xs), 32);
+    __m256i r = _mm256_sub_epi64(_mm256_mul_epu32(acc, x), _mm256_mul_epu32(q, p));
+    r = _mm256_sub_epi64(r, _mm256_andnot_si256(_mm256_cmpgt_epi64(p, r), p));
+    r = _mm256_add_epi64(r, c);
+    return _mm256_sub_epi64(r, _mm256_andnot_si256(_mm256_cmpgt_epi64(p, r), p));
+}
+
+// out[j] = c[0] + c[1] * x[j] + ... + c[len - 1] * x[j]^(len - 1) mod p for p < 2^31, by Horner's rule,
+// with x_shoup[j] = floor(x[j] * 2^32 / p). 16 points are evaluated together, so 4 independent dependency
+// chains hide the multiplication latency.
+BR_TARGET_AVX2 static inline void shoup31_horner_avx2(const uint64_t *c, const std::size_t len, const uint64_t *x,
+                                                      const uint64_t *x_shoup, uint64_t *out, const std::size_t count,
+                                                      const uint32_t p)
+{
+    const __m256i vp = _mm256_set1_epi64x(p);
+
+    std::size_t j = 0;
+    for (; j + 16 <= count; j += 16)
+    {
+        const __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + j));
+        const __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + j + 4));
+        const __m256i x2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + j + 8));
+        const __m256i x3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + j + 12));
+        const __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x_shoup + j));
+        const __m256i s1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x_shoup + j + 4));
+        const __m256i s2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x_shoup + j + 8));
+        const __m256i s3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x_shoup + j + 12));
+        __m256i a0 = _mm256_setzero_si256();
+        __m256i a1 = _mm256_setzero_si256();
+        __m256i a2 = _mm256_setzero_si256();
+        __m256i a3 = _mm256_setzero_si256();
+        for (std::size_t i = len; i-- > 0;)
+        {
+            const __m256i vc = _mm256_set1_epi64x(static_cast<int64_t>(c[i]));
+            a0 = shoup31_mul_add_step_avx2(a0, x0, s0, vc, vp);
+            a1 = shoup31_mul_add_step_avx2(a1, x1, s1, vc, vp);
+            a2 = shoup31_mul_add_step_avx2(a2, x2, s2, vc, vp);
+            a3 = shoup31_mul_add_step_avx2(a3, x3, s3, vc, vp);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + j), a0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + j + 4), a1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + j + 8), a2);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + j + 12), a3);
+    }
+    for (; j + 4 <= count; j += 4)
+    {
+        const __m256i x0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + j));
+        const __m256i s0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x_shoup + j));
+        __m256i a0 = _mm256_setzero_si256();
+        for (std::size_t i = len; i-- > 0;)
+        {
+            a0 = shoup31_mul_add_step_avx2(a0, x0, s0, _mm256_set1_epi64x(static_cast<int64_t>(c[i])), vp);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + j), a0);
+    }
+    for (; j < count; ++j)
+    {
+        uint64_t acc = 0;
+        for (std::size_t i = len; i-- > 0;)
+        {
+            const uint64_t q = (acc * x_shoup[j]) >> 32U;
+            acc = acc * x[j] - q * p;
+            if (acc >= p)
+            {
+                acc -= p;
+            }
+            acc += c[i];
+            if (acc >= p)
+            {
+                acc -= p;
+            }
+        }
+        out[j] = acc;
+    }
+}
+
+// out[0] and out[1] = values of the 16 decimal digits at a and at b, one 128-bit lane each:
+// pairs, then groups of 4 and 8 digits are combined with multiply-adds.
+// Returns false if some byte is not a digit, out is then unspecified.
+BR_TARGET_AVX2 static inline auto digits16x2_avx2(const char *a, const char *b, uint64_t *out) -> bool
+{
+    const __m256i raw = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b)), 1);
+    const __m256i v = _mm256_sub_epi8(raw, _mm256_set1_epi8('0'));
+    const __m256i nine = _mm256_set1_epi8(9);
+    const bool ok = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(v, nine), nine)) == -1;
+
+    // Weights (10, 1), then (100, 1) and (10000, 1) on adjacent 16-bit values. The groups of 4 digits are
+    // packed back to 16 bits, as madd only multiplies 16-bit values.
+    const __m256i d2 = _mm256_maddubs_epi16(v, _mm256_set1_epi16(0x010a));
+    const __m256i d4 = _mm256_madd_epi16(d2, _mm256_set1_epi32(0x00010064));
+    const __m256i d8 = _mm256_madd_epi16(_mm256_packus_epi32(d4, d4), _mm256_set1_epi32(0x00012710));
+    const auto lo = static_cast<uint64_t>(_mm256_extract_epi32(d8, 0));
+    const auto lo2 = static_cast<uint64_t>(_mm256_extract_epi32(d8, 1));
+    const auto hi = static_cast<uint64_t>(_mm256_extract_epi32(d8, 4));
+    const auto hi2 = static_cast<uint64_t>(_mm256_extract_epi32(d8, 5));
+    out[0] = lo * 100000000 + lo2;
+    out[1] = hi * 100000000 + hi2;
+    return ok;
+}
+
+// out[4 * i .. 4 * i + 4) = the 4 decimal digits of v[i] < 10000, for i < 16.
+// The digits come from repeated division by 10 as a 16-bit multiply-high and shift, exact below 43690.
+BR_TARGET_AVX2 static inline void format4x16_avx2(const uint16_t *v, char *out)
+{
+    const __m256i magic = _mm256_set1_epi16(static_cast<int16_t>(52429)); // ceil(2^19 / 10)
+    const __m256i ten = _mm256_set1_epi16(10);
+    const __m256i t0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(v));
+    const __m256i t1 = _mm256_srli_epi16(_mm256_mulhi_epu16(t0, magic), 3);
+    const __m256i t2 = _mm256_srli_epi16(_mm256_mulhi_epu16(t1, magic), 3);
+    const __m256i t3 = _mm256_srli_epi16(_mm256_mulhi_epu16(t2, magic), 3);
+    const __m256i d0 = _mm256_sub_epi16(t0, _mm256_mullo_epi16(t1, ten));
+    const __m256i d1 = _mm256_sub_epi16(t1, _mm256_mullo_epi16(t2, ten));
+    const __m256i d2 = _mm256_sub_epi16(t2, _mm256_mullo_epi16(t3, ten));
+    // Bytes d3 d2 and d1 d0 per 16-bit lane, interleaved into d3 d2 d1 d0 per value.
+    const __m256i a = _mm256_or_si256(t3, _mm256_slli_epi16(d2, 8));
+    const __m256i b = _mm256_or_si256(d1, _mm256_slli_epi16(d0, 8));
+    const __m256i zeros = _mm256_set1_epi8('0');
+    const __m256i lo = _mm256_add_epi8(_mm256_unpacklo_epi16(a, b), zeros); // values 0-3 and 8-11
+    const __m256i hi = _mm256_add_epi8(_mm256_unpackhi_epi16(a, b), zeros); // values 4-7 and 12-15
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+#else
+
+static inline auto has_avx2() -> bool
+{
+    return false;
+}
+
+#endif
+
+} // namespace br::simd
@@ -0,0 +1,485 @@
+/*
+Machine-local tuning of batch reductions.
+
+Which batch kernel is fastest depends on the CPU and on the size of the modulus. TuningProfile records the
+fastest kernel per reducer width and modulus bit length. tune() finds them by timing every candidate on this
+machine, and the result is kept in a small text file: br-tune writes it at install time, or
+TuningProfile::machine() tunes and saves it on first use. BatchReducer32 and BatchReducer64 consult a profile
+when they are constructed.
+
+Candidates:
+- 32-bit x mod n: BarrettRed32 scalar loop, BarrettRed32 AVX2 kernel, Plantard32 (odd n < 2^31 only).
+- 64-bit x mod n, any x: BarrettRed64::calc_full() loop, BarrettJit64 generated kernel.
+A kernel that cannot serve a modulus or this CPU is replaced by the default choice for that width.
+
+Profile file:
+  libbr-tune <version> avx2=<0|1> jit=<0|1>
+  br32 <bits> <kernel>     for bits = 2, ..., 32
+  br64 <bits> <kernel>     for bits = 2, ..., 64
+load() rejects a file of another version or for other CPU features, and machine() then tunes again.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "libbr/br.hpp"
+#include "libbr/jit.hpp"
+#include "libbr/simd.hpp"
+
+namespace br
+{
+
+enum class Kernel
+{
+    scalar,
+    avx2,
+    plantard,
+    jit
+};
+
+inline auto kernel_name(const Kernel k) -> const char *
+{
+    switch (k)
+    {
+    case Kernel::avx2:
+        return "avx2";
+    case Kernel::plantard:
+        return "plantard";
+    case Kernel::jit:
+        return "jit";
+    default:
+        return "scalar";
+    }
+}
+
+namespace detail
+{
+
+inline auto jit_available() -> bool
+{
+    static const bool res = BarrettJit64(3).jitted();
+    return res;
+}
+
+inline auto bit_length(uint64_t n) -> unsigned
+{
+    unsigned bits = 0;
+    for (; n != 0; n >>= 1U)
+    {
+        ++bits;
+    }
+    return bits;
+}
+
+} // namespace detail
+
+class TuningProfile;
+
+// out[i] = x[i] mod n with the 32-bit kernel chosen by a tuning profile.
+class BatchReducer32
+{
+  public:
+    // The kernel of the profile for the bit length of n.
+    BatchReducer32(uint32_t _n, const TuningProfile &profile);
+
+    // A given kernel, or the default one if it cannot serve n on this CPU.
+    BatchReducer32(const uint32_t _n, const Kernel k) : br(_n), kernel(usable(k, _n) ? k : default_kernel())
+    {
+        if (kernel == Kernel::plantard)
+        {
+            pl = std::make_unique<const Plantard32>(_n);
+        }
+    }
+
+    [[nodiscard]] static auto usable(const Kernel k, const uint32_t n) -> bool
+    {
+        switch (k)
+        {
+        case Kernel::scalar:
+            return true;
+        case Kernel::avx2:
+            return simd::has_avx2();
+        case Kernel::plantard:
+            return (n & 1U) != 0 && n < (1U << 31U);
+        default:
+            return false;
+        }
+    }
+
+    [[nodiscard]] static auto default_kernel() -> Kernel
+    {
+        return simd::has_avx2() ? Kernel::avx2 : Kernel::scalar;
+    }
+
+    // x[i] must be < n^2, as for BarrettRed32::calc(). Only the Barrett kernels check it.
+    // 'out' may be the same array as 'x'.
+    void calc(const uint32_t *x, uint32_t *out, const std::size_t count) const
+    {
+        switch (kernel)
+        {
+        case Kernel::avx2:
+            br.calc(x, out, count);
+            return;
+        case Kernel::plantard:
+            pl->calc(x, out, count);
+            return;
+        default:
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                out[i] = br.calc(x[i]);
+            }
+        }
+    }
+
+    [[nodiscard]] auto get_kernel() const -> Kernel
+    {
+        return kernel;
+    }
+
+  private:
+    BarrettRed32 br;
+    Kernel kernel;
+    std::unique_ptr<const Plantard32> pl;
+};
+
+// out[i] = x[i] mod n for any 64-bit x[i], with the kernel chosen by a tuning profile.
+class BatchReducer64
+{
+  public:
+    // The kernel of the profile for the bit length of n.
+    BatchReducer64(uint64_t _n, const TuningProfile &profile);
+
+    BatchReducer64(const uint64_t _n, const Kernel k) : br(_n), kernel(usable(k) ? k : default_kernel())
+    {
+        if (kernel == Kernel::jit)
+        {
+            jit = std::make_unique<const BarrettJit64>(_n);
+        }
+    }
+
+    [[nodiscard]] static auto usable(const Kernel k) -> bool
+    {
+        return k == Kernel::scalar || (k == Kernel::jit && detail::jit_available());
+    }
+
+    [[nodiscard]] static auto default_kernel() -> Kernel
+    {
+        return detail::jit_available() ? Kernel::jit : Kernel::scalar;
+    }
+
+    // 'out' may be the same array as 'x'.
+    void calc(const uint64_t *x, uint64_t *out, const std::size_t count) const
+    {
+        if (kernel == Kernel::jit)
+        {
+            jit->calc(x, out, count);
+            return;
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out[i] = br.calc_full(x[i]);
+        }
+    }
+
+    [[nodiscard]] auto get_kernel() const -> Kernel
+    {
+        return kernel;
+    }
+
+  private:
+    BarrettRed64 br;
+    Kernel kernel;
+    std::unique_ptr<const BarrettJit64> jit;
+};
+
+class TuningProfile
+{
+  public:
+    static constexpr int version = 1;
+    static constexpr unsigned max_bits32 = 32;
+    static constexpr unsigned max_bits64 = 64;
+
+    // The default choices, without measurements.
+    TuningProfile()
+    {
+        br32.fill(BatchReducer32::default_kernel());
+        br64.fill(BatchReducer64::default_kernel());
+    }
+
+    // Time every usable kernel for every bit length, on a modulus of that length.
+    [[nodiscard]] static auto tune() -> TuningProfile
+    {
+        TuningProfile res;
+        std::mt19937_64 gen(12345);
+        std::vector<uint32_t> x32(tune_values);
+        std::vector<uint32_t> out32(tune_values);
+        for (unsigned bits = 2; bits <= max_bits32; ++bits)
+        {
+            const auto n = static_cast<uint32_t>(sample_modulus(bits));
+            // Inputs below n^2, as the Barrett kernels require.
+            const uint64_t n2 = static_cast<uint64_t>(n) * n;
+            for (auto &v : x32)
+            {
+                v = static_cast<uint32_t>(n2 > UINT32_MAX ? gen() : gen() % n2);
+            }
+            double best = 1e300;
+            for (const Kernel k : {Kernel::scalar, Kernel::avx2, Kernel::plantard})
+            {
+                if (!BatchReducer32::usable(k, n))
+                {
+                    continue;
+                }
+                const BatchReducer32 red(n, k);
+                const double t = time([&] { red.calc(x32.data(), out32.data(), tune_values); });
+                if (t < best)
+                {
+                    best = t;
+                    res.br32[bits] = k;
+                }
+            }
+        }
+
+        std::vector<uint64_t> x64(tune_values);
+        std::vector<uint64_t> out64(tune_values);
+        for (auto &v : x64)
+        {
+            v = gen();
+        }
+        for (unsigned bits = 2; bits <= max_bits64; ++bits)
+        {
+            const uint64_t n = sample_modulus(bits);
+            double best = 1e300;
+            for (const Kernel k : {Kernel::scalar, Kernel::jit})
+            {
+                if (!BatchReducer64::usable(k))
+                {
+                    continue;
+                }
+                const BatchReducer64 red(n, k);
+                const double t = time([&] { red.calc(x64.data(), out64.data(), tune_values); });
+                if (t < best)
+                {
+                    best = t;
+                    res.br64[bits] = k;
+                }
+            }
+        }
+        return res;
+    }
+
+    // Reads 'path' into 'profile'. False, leaving 'profile' unchanged, if the file is missing, malformed,
+    // of another version, or was tuned for other CPU features.
+    [[nodiscard]] static auto load(const std::string &path, TuningProfile &profile) -> bool
+    {
+        std::ifstream in(path);
+        std::string line;
+        if (!in || !std::getline(in, line) || line != header())
+        {
+            return false;
+        }
+        TuningProfile res;
+        std::array<bool, max_bits32 + 1> seen32{};
+        std::array<bool, max_bits64 + 1> seen64{};
+        while (std::getline(in, line))
+        {
+            std::istringstream fields(line);
+            std::string width;
+            unsigned bits = 0;
+            std::string name;
+            if (!(fields >> width >> bits >> name))
+            {
+                return false;
+            }
+            const bool w32 = width == "br32";
+            if ((!w32 && width != "br64") || bits < 2 || bits > (w32 ? max_bits32 : max_bits64))
+            {
+                return false;
+            }
+            Kernel k = Kernel::scalar;
+            if (!parse_kernel(name, k))
+            {
+                return false;
+            }
+            (w32 ? res.br32[bits] : res.br64[bits]) = k;
+            (w32 ? seen32[bits] : seen64[bits]) = true;
+        }
+        const auto complete = [](const auto &seen) {
+            return std::all_of(seen.begin() + 2, seen.end(), [](const bool b) { return b; });
+        };
+        if (!complete(seen32) || !complete(seen64))
+        {
+            return false;
+        }
+        profile = res;
+        return true;
+    }
+
+    // Writes the profile to 'path' through a temporary file, creating the directory. False on failure.
+    [[nodiscard]] auto save(const std::string &path) const -> bool
+    {
+        std::error_code ec;
+        const std::filesystem::path file(path);
+        if (file.has_parent_path())
+        {
+            std::filesystem::create_directories(file.parent_path(), ec);
+        }
+        const std::string tmp = path + ".tmp" + std::to_string(std::random_device()());
+        {
+            std::ofstream out(tmp);
+            out << header() << "\n";
+            for (unsigned bits = 2; bits <= max_bits32; ++bits)
+            {
+                out << "br32 " << bits << " " << kernel_name(br32[bits]) << "\n";
+            }
+            for (unsigned bits = 2; bits <= max_bits64; ++bits)
+            {
+                out << "br64 " << bits << " " << kernel_name(br64[bits]) << "\n";
+            }
+            out.close();
+            if (!out)
+            {
+                std::filesystem::remove(tmp, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(tmp, file, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        return true;
+    }
+
+    // The profile in 'path', or a freshly tuned one, which is then saved there (best effort).
+    // An empty path tunes without saving.
+    [[nodiscard]] static auto load_or_tune(const std::string &path) -> TuningProfile
+    {
+        TuningProfile res;
+        if (!path.empty() && load(path, res))
+        {
+            return res;
+        }
+        res = tune();
+        if (!path.empty())
+        {
+            static_cast<void>(res.save(path));
+        }
+        return res;
+    }
+
+    // $BR_TUNE_PROFILE, or ~/.cache/libbr/tune.txt, or empty without a home directory.
+    [[nodiscard]] static auto default_path() -> std::string
+    {
+        if (const char *p = std::getenv("BR_TUNE_PROFILE"))
+        {
+            return p;
+        }
+        if (const char *home = std::getenv("HOME"))
+        {
+            return std::string(home) + "/.cache/libbr/tune.txt";
+        }
+        return "";
+    }
+
+    // The profile of this machine: loaded from default_path(), or tuned there on first use.
+    [[nodiscard]] static auto machine() -> const TuningProfile &
+    {
+        static const TuningProfile profile = load_or_tune(default_path());
+        return profile;
+    }
+
+    [[nodiscard]] auto kernel32(const uint32_t n) const -> Kernel
+    {
+        return br32[std::max(2U, detail::bit_length(n))];
+    }
+
+    [[nodiscard]] auto kernel64(const uint64_t n) const -> Kernel
+    {
+        return br64[std::max(2U, detail::bit_length(n))];
+    }
+
+    void set_kernel32(const unsigned bits, const Kernel k)
+    {
+        br32.at(bits) = k;
+    }
+
+    void set_kernel64(const unsigned bits, const Kernel k)
+    {
+        br64.at(bits) = k;
+    }
+
+  private:
+    static constexpr std::size_t tune_values = 1U << 14U;
+
+    // CPU features the choices depend on.
+    static auto header() -> std::string
+    {
+        return "libbr-tune " + std::to_string(version) + " avx2=" + (simd::has_avx2() ? "1" : "0") +
+               " jit=" + (detail::jit_available() ? "1" : "0");
+    }
+
+    static auto parse_kernel(const std::string &name, Kernel &k) -> bool
+    {
+        for (const Kernel c : {Kernel::scalar, Kernel::avx2, Kernel::plantard, Kernel::jit})
+        {
+            if (name == kernel_name(c))
+            {
+                k = c;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // An odd modulus of the given bit length that is not a power of 2: 2^bits - 3, or 3.
+    static auto sample_modulus(const unsigned bits) -> uint64_t
+    {
+        return bits == 2 ? 3 : (bits == 64 ? UINT64_MAX : (1UL << bits) - 1) - 2;
+    }
+
+    // Best of several runs of 'f', in seconds.
+    template <typename F> static auto time(F &&f) -> double
+    {
+        double best = 1e300;
+        for (int rep = 0; rep < 7; ++rep)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < 4; ++i)
+            {
+                f();
+            }
+            const auto stop = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double>(stop - start).count());
+        }
+        return best;
+    }
+
+    std::array<Kernel, max_bits32 + 1> br32{};
+    std::array<Kernel, max_bits64 + 1> br64{};
+};
+
+inline BatchReducer32::BatchReducer32(const uint32_t _n, const TuningProfile &profile)
+    : BatchReducer32(_n, profile.kernel32(_n))
+{
+}
+
+inline BatchReducer64::BatchReducer64(const uint64_t _n, const TuningProfile &profile)
+    : BatchReducer64(_n, profile.kernel64(_n))
+{
+}
+
+} // namespace br
@@ -151,4 +151,24 @@ static inline auto longdiv128_1s(const uint64_t d) -> uint64_t
     return q;
 }
 
+// Shoup's precomputed quotient for multiplying by a fixed w < n: floor(w * 2^64 / n).
+static inline auto shoup_precomp(const uint64_t w, const uint64_t n) -> uint64_t
+{
+#ifdef __SIZEOF_INT128__
+    return (static_cast<unsigned __int128>(w) << 64U) / n;
+#else
+    return longdiv128(w, 0, n);
+#endif
+}
+
+// x * w mod n, for any 64-bit x, with w < n < 2^63 and w_shoup = shoup_precomp(w, n).
+// The estimate q = (x * w_shoup) >> 64 is at most 1 below the exact quotient, so x * w - q * n < 2n.
+static inline auto shoup_mul(const uint64_t x, const uint64_t w, const uint64_t w_shoup, const uint64_t n) -> uint64_t
+{
+    const uint64_t q = mulhi64(x, w_shoup);
+    // Branch-free correction: r - n is negative (sign bit set) exactly when r < n, since n < 2^63.
+    const uint64_t r = x * w - q * n - n;
+    return r + (n & (0 - (r >> 63U)));
+}
+
 } // namespace br::util